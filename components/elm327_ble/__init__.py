@@ -1,24 +1,214 @@
+import re
+
 import esphome.codegen as cg
 import esphome.config_validation as cv
+import esphome.final_validate as fv
+from esphome import automation
 from esphome.components import ble_client
-from esphome.const import CONF_ID
+from esphome.components import time as time_
+from esphome.const import CONF_ID, CONF_PORT, CONF_TIME_ID, CONF_TRIGGER_ID
+from esphome.core import CORE
 
 CODEOWNERS = ["@rubenmuehlhans"]
 DEPENDENCIES = ["ble_client"]
-AUTO_LOAD = ["sensor", "text_sensor", "binary_sensor"]
 MULTI_CONF = True
 
+
+def AUTO_LOAD():
+    """socket nur für den Download-Server des Datenloggers (elm327_data_log_esp32.h)."""
+    components = ["sensor", "text_sensor", "binary_sensor"]
+    hubs = (CORE.raw_config or {}).get("elm327_ble") or []
+    if isinstance(hubs, dict):
+        hubs = [hubs]
+    if any(isinstance(hub, dict) and CONF_DATA_LOG in hub for hub in hubs):
+        components.append("socket")
+    return components
+
+
 CONF_ELM327_BLE_ID = "elm327_ble_id"
 CONF_SERVICE_UUID = "service_uuid"
 CONF_CHAR_TX_UUID = "char_tx_uuid"
 CONF_CHAR_RX_UUID = "char_rx_uuid"
 CONF_REQUEST_INTERVAL = "request_interval"
 CONF_REQUEST_TIMEOUT = "request_timeout"
+CONF_ADAPTIVE_TIMING = "adaptive_timing"
+CONF_BATCH_PIDS = "batch_pids"
+CONF_MAX_THROUGHPUT = "max_throughput"
+CONF_HEADERS = "headers"
+CONF_FAST_RECONNECT = "fast_reconnect"
+CONF_STATS_INTERVAL = "stats_interval"
+CONF_MONITOR_DURATION = "monitor_duration"
+CONF_MTU = "mtu"
+CONF_WRITE_WITHOUT_RESPONSE = "write_without_response"
+CONF_TRACE_SIZE = "trace_size"
+CONF_CONNECTION_PARAMETERS = "connection_parameters"
+CONF_ACTIVE_INTERVAL = "active_interval"
+CONF_IDLE_INTERVAL = "idle_interval"
+CONF_IDLE_LATENCY = "idle_latency"
+CONF_SUPERVISION_TIMEOUT = "supervision_timeout"
+CONF_POLLING_PROFILES = "polling_profiles"
+CONF_ENGINE_OFF_DELAY = "engine_off_delay"
+CONF_RUNNING_VOLTAGE = "running_voltage"
+CONF_PARKED_INTERVAL = "parked_interval"
+CONF_SLEEP_AFTER = "sleep_after"
+CONF_WAKE_INTERVAL = "wake_interval"
+CONF_TRIP_COMPUTER = "trip_computer"
+CONF_FUEL_TYPE = "fuel_type"
+CONF_AIR_FUEL_RATIO = "air_fuel_ratio"
+CONF_FUEL_DENSITY = "fuel_density"
+CONF_RESET_ON_ENGINE_START = "reset_on_engine_start"
+CONF_DATA_LOG = "data_log"
+CONF_BUFFER_SIZE = "buffer_size"
+CONF_PARTITION = "partition"
+CONF_MIN_INTERVAL = "min_interval"
+CONF_FLUSH_INTERVAL = "flush_interval"
+CONF_ON_COMMAND_RESPONSE = "on_command_response"
+CONF_COMMAND = "command"
+CONF_PRIORITY = "priority"
+CONF_HEADER = "header"
+CONF_PID = "pid"
+CONF_FRAME = "frame"
+
+# AT-Befehle, die per send_command erlaubt sind. Muss READ_ONLY_COMMANDS in
+# elm327_protocol.cpp entsprechen, make -C host prüft das (host/check_commands.py).
+READ_ONLY_COMMANDS = ["ATRV", "ATI", "AT@1", "ATDP", "ATDPN", "ATIGN", "STI", "STDI"]
+
+# Stöchiometrisches Verhältnis und Dichte (g/L) für die Schätzung aus der Luftmasse
+FUEL_TYPES = {
+    "gasoline": {CONF_AIR_FUEL_RATIO: 14.7, CONF_FUEL_DENSITY: 745.0},
+    "diesel": {CONF_AIR_FUEL_RATIO: 14.5, CONF_FUEL_DENSITY: 832.0},
+}
 
 elm327_ble_ns = cg.esphome_ns.namespace("elm327_ble")
 ELM327BLEHub = elm327_ble_ns.class_(
     "ELM327BLEHub", cg.Component, ble_client.BLEClientNode
 )
+CommandResponseTrigger = elm327_ble_ns.class_(
+    "CommandResponseTrigger",
+    automation.Trigger.template(cg.std_string, cg.std_string, cg.bool_),
+)
+SendCommandAction = elm327_ble_ns.class_("SendCommandAction", automation.Action)
+DumpTraceAction = elm327_ble_ns.class_("DumpTraceAction", automation.Action)
+
+
+def validate_header(value):
+    """ATSH-Header: 3 Hex-Ziffern (11 Bit, z.B. 7E0) oder 6 (29 Bit, z.B. DA10F1)."""
+    value = cv.string_strict(value).upper()
+    if not re.fullmatch(r"[0-9A-F]{3}|[0-9A-F]{6}", value):
+        raise cv.Invalid("Header muss aus 3 oder 6 Hex-Ziffern bestehen, z.B. 7E0")
+    return value
+
+
+def validate_command(value):
+    """OBD-Anfrage als Hex (z.B. 03, 0902) oder ein lesender AT-Befehl (ATRV)."""
+    value = cv.string_strict(value).upper().replace(" ", "")
+    if value in READ_ONLY_COMMANDS:
+        return value
+    if not re.fullmatch(r"([0-9A-F]{2}){1,10}", value):
+        raise cv.Invalid(
+            "Befehl muss eine OBD-Anfrage in Hex (z.B. 03) oder einer von "
+            f"{', '.join(READ_ONLY_COMMANDS)} sein"
+        )
+    return value
+
+
+POLLING_PROFILES_SCHEMA = cv.Schema(
+    {
+        # Ohne Drehzahl > 0 und Ladespannung so lange → Stand
+        cv.Optional(
+            CONF_ENGINE_OFF_DELAY, default="30s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_RUNNING_VOLTAGE, default=13.2): cv.float_range(
+            min=12.0, max=15.0
+        ),
+        # Im Stand nur Batteriespannung und Drehzahl (Startprobe)
+        cv.Optional(
+            CONF_PARKED_INTERVAL, default="60s"
+        ): cv.positive_time_period_milliseconds,
+        # Danach Adapter per ATLP schlafen legen, 0s = nie
+        cv.Optional(
+            CONF_SLEEP_AFTER, default="10min"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(
+            CONF_WAKE_INTERVAL, default="5min"
+        ): cv.positive_time_period_milliseconds,
+    }
+)
+
+TRIP_COMPUTER_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_FUEL_TYPE, default="gasoline"): cv.one_of(
+            *FUEL_TYPES, lower=True
+        ),
+        # Überschreiben die Werte des Kraftstofftyps
+        cv.Optional(CONF_AIR_FUEL_RATIO): cv.float_range(min=5.0, max=30.0),
+        cv.Optional(CONF_FUEL_DENSITY): cv.float_range(min=500.0, max=1000.0),
+        # Neue Fahrt, sobald die Motorlaufzeit (PID 0x1F) neu beginnt
+        cv.Optional(CONF_RESET_ON_ENGINE_START, default=False): cv.boolean,
+    }
+)
+
+DATA_LOG_SCHEMA = cv.Schema(
+    {
+        # RAM-Ring in Bytes, mit psram: auch mehrere MB
+        cv.Optional(CONF_BUFFER_SIZE, default=32768): cv.int_range(
+            min=1024, max=8 * 1024 * 1024
+        ),
+        # Datenpartition aus partitions.csv, ohne Angabe nur RAM
+        cv.Optional(CONF_PARTITION): cv.All(cv.string_strict, cv.Length(max=16)),
+        # Pro Sensor höchstens ein Wert in diesem Abstand
+        cv.Optional(
+            CONF_MIN_INTERVAL, default="1s"
+        ): cv.positive_time_period_milliseconds,
+        # Angefangene Blöcke spätestens dann in den Flash
+        cv.Optional(
+            CONF_FLUSH_INTERVAL, default="10min"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_PORT, default=7327): cv.port,
+        # Unix-Zeit in den Blockköpfen, sonst nur die Uptime
+        cv.Optional(CONF_TIME_ID): cv.use_id(time_.RealTimeClock),
+    }
+)
+
+CONNECTION_INTERVAL = cv.All(
+    cv.positive_time_period_microseconds,
+    cv.Range(min=cv.TimePeriod(microseconds=7500), max=cv.TimePeriod(seconds=4)),
+)
+
+
+def validate_connection_parameters(config):
+    """Der Supervision Timeout muss mehr als zwei ausgelassene Intervalle abdecken."""
+    timeout_ms = config[CONF_SUPERVISION_TIMEOUT].total_milliseconds
+    for interval, latency in (
+        (config[CONF_ACTIVE_INTERVAL], 0),
+        (config[CONF_IDLE_INTERVAL], config[CONF_IDLE_LATENCY]),
+    ):
+        if timeout_ms <= 2 * (1 + latency) * interval.total_microseconds / 1000:
+            raise cv.Invalid(
+                f"'{CONF_SUPERVISION_TIMEOUT}' muss größer als "
+                f"2 × (1 + {CONF_IDLE_LATENCY}) × Intervall sein"
+            )
+    return config
+
+
+CONNECTION_PARAMETERS_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            # Solange abgefragt wird
+            cv.Optional(CONF_ACTIVE_INTERVAL, default="15ms"): CONNECTION_INTERVAL,
+            # Im Stand und Schlaf (polling_profiles), der Adapter darf idle_latency Events auslassen
+            cv.Optional(CONF_IDLE_INTERVAL, default="500ms"): CONNECTION_INTERVAL,
+            cv.Optional(CONF_IDLE_LATENCY, default=4): cv.int_range(min=0, max=499),
+            cv.Optional(CONF_SUPERVISION_TIMEOUT, default="6s"): cv.All(
+                cv.positive_time_period_milliseconds,
+                cv.Range(
+                    min=cv.TimePeriod(milliseconds=100), max=cv.TimePeriod(seconds=32)
+                ),
+            ),
+        }
+    ),
+    validate_connection_parameters,
+)
 
 CONFIG_SCHEMA = (
     cv.Schema(
@@ -33,6 +223,45 @@ CONFIG_SCHEMA = (
             cv.Optional(
                 CONF_REQUEST_TIMEOUT, default="5s"
             ): cv.positive_time_period_milliseconds,
+            # Timeout pro Anfrage aus gemessenen Antwortzeiten, ATST/ATAT daran anpassen
+            cv.Optional(CONF_ADAPTIVE_TIMING, default=True): cv.boolean,
+            cv.Optional(CONF_BATCH_PIDS, default=False): cv.boolean,
+            # Nächste Anfrage direkt nach dem Prompt, request_interval = Mindestabstand
+            cv.Optional(CONF_MAX_THROUGHPUT, default=False): cv.boolean,
+            # ATH1: Antworten nach Steuergerät (CAN-ID) trennen, nur bei CAN-Protokollen
+            cv.Optional(CONF_HEADERS, default=False): cv.boolean,
+            cv.Optional(CONF_FAST_RECONNECT, default=True): cv.boolean,
+            # Ausgabe der Diagnose-Sensoren (Latenz, Antworten/s, Fehlerzähler)
+            cv.Optional(
+                CONF_STATS_INTERVAL, default="60s"
+            ): cv.positive_time_period_milliseconds,
+            # CAN-Monitor (nur mit can_id-Sensoren): Mindestdauer zwischen zwei Abfragerunden
+            cv.Optional(
+                CONF_MONITOR_DURATION, default="10s"
+            ): cv.positive_time_period_milliseconds,
+            # BLE: angefragte MTU (23 = nicht aushandeln), Write ohne Quittung wenn möglich
+            cv.Optional(CONF_MTU, default=247): cv.int_range(min=23, max=517),
+            cv.Optional(CONF_WRITE_WITHOUT_RESPONSE, default=True): cv.boolean,
+            # Mitschnitt der Kommunikation (elm327_ble.dump_trace), 0 = aus
+            cv.Optional(CONF_TRACE_SIZE, default=4096): cv.Any(
+                cv.one_of(0, int=True), cv.int_range(min=1024, max=65536)
+            ),
+            # Kurzes Verbindungsintervall beim Abfragen, langes im Stand
+            cv.Optional(CONF_CONNECTION_PARAMETERS): CONNECTION_PARAMETERS_SCHEMA,
+            # Abfrageprofile nach Motorzustand (laufend / Stand / Adapter schläft)
+            cv.Optional(CONF_POLLING_PROFILES): POLLING_PROFILES_SCHEMA,
+            # Bordcomputer (Sensoren mit type: trip_distance usw.)
+            cv.Optional(CONF_TRIP_COMPUTER): TRIP_COMPUTER_SCHEMA,
+            # Werte puffern und gesammelt herunterladen (ohne WLAN unterwegs)
+            cv.Optional(CONF_DATA_LOG): DATA_LOG_SCHEMA,
+            # Ergebnis von send_command/read_dtc/clear_dtc/read_freeze_frame
+            cv.Optional(CONF_ON_COMMAND_RESPONSE): automation.validate_automation(
+                {
+                    cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(
+                        CommandResponseTrigger
+                    ),
+                }
+            ),
         }
     )
     .extend(cv.COMPONENT_SCHEMA)
@@ -40,6 +269,50 @@ CONFIG_SCHEMA = (
 )
 
 
+def _activity_probe_interval(sensor_config):
+    """Abfrageintervall (ms), wenn der Sensor Motoraktivität zeigt (ATRV, Drehzahl), sonst None."""
+    voltage = sensor_config.get("at_command") == "ATRV\r"
+    rpm = (
+        sensor_config.get("mode") == 0x01
+        and sensor_config.get("pid") == 0x0C
+        and "header" not in sensor_config
+    )
+    if not (voltage or rpm) or "update_interval" not in sensor_config:
+        return None
+    return sensor_config["update_interval"].total_milliseconds
+
+
+def final_validate_polling_profiles(config):
+    """Ohne battery_voltage-Sensor fragt der Kern ATRV mit engine_off_delay / 3 ab. Mit
+    eigenem Sensor muss Spannung oder Drehzahl mindestens zweimal pro engine_off_delay
+    kommen, sonst wechselt das Profil bei laufendem Motor in den Stand."""
+    if CONF_POLLING_PROFILES not in config:
+        return config
+    delay_ms = config[CONF_POLLING_PROFILES][CONF_ENGINE_OFF_DELAY].total_milliseconds
+    voltage_sensor = False
+    probe_ms = None
+    for sensor_config in fv.full_config.get().get("sensor", []):
+        if sensor_config.get("platform") != "elm327_ble":
+            continue
+        if sensor_config[CONF_ELM327_BLE_ID].id != config[CONF_ID].id:
+            continue
+        interval = _activity_probe_interval(sensor_config)
+        if interval is None:
+            continue
+        voltage_sensor |= sensor_config.get("at_command") == "ATRV\r"
+        probe_ms = interval if probe_ms is None else min(probe_ms, interval)
+    if voltage_sensor and delay_ms < 2 * probe_ms:
+        raise cv.Invalid(
+            f"'{CONF_ENGINE_OFF_DELAY}' ({delay_ms} ms) muss mindestens doppelt so lang sein "
+            f"wie das kürzeste 'update_interval' der Sensoren battery_voltage und rpm "
+            f"({probe_ms} ms)"
+        )
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = final_validate_polling_profiles
+
+
 async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(var, config)
@@ -50,3 +323,160 @@ async def to_code(config):
     cg.add(var.set_char_rx_uuid(config[CONF_CHAR_RX_UUID]))
     cg.add(var.set_request_interval(config[CONF_REQUEST_INTERVAL]))
     cg.add(var.set_request_timeout(config[CONF_REQUEST_TIMEOUT]))
+    cg.add(var.set_adaptive_timing(config[CONF_ADAPTIVE_TIMING]))
+    cg.add(var.set_batch_pids(config[CONF_BATCH_PIDS]))
+    cg.add(var.set_max_throughput(config[CONF_MAX_THROUGHPUT]))
+    cg.add(var.set_headers(config[CONF_HEADERS]))
+    cg.add(var.set_fast_reconnect(config[CONF_FAST_RECONNECT]))
+    cg.add(var.set_stats_interval(config[CONF_STATS_INTERVAL]))
+    cg.add(var.set_monitor_duration(config[CONF_MONITOR_DURATION]))
+    cg.add(var.set_mtu(config[CONF_MTU]))
+    cg.add(var.set_write_without_response(config[CONF_WRITE_WITHOUT_RESPONSE]))
+    cg.add(var.set_trace_size(config[CONF_TRACE_SIZE]))
+    if CONF_CONNECTION_PARAMETERS in config:
+        params = config[CONF_CONNECTION_PARAMETERS]
+        # Einheiten der BLE-Spezifikation: Intervall 1,25 ms, Timeout 10 ms
+        cg.add(
+            var.set_connection_parameters(
+                round(params[CONF_ACTIVE_INTERVAL].total_microseconds / 1250),
+                round(params[CONF_IDLE_INTERVAL].total_microseconds / 1250),
+                params[CONF_IDLE_LATENCY],
+                round(params[CONF_SUPERVISION_TIMEOUT].total_milliseconds / 10),
+            )
+        )
+    if CONF_POLLING_PROFILES in config:
+        profiles = config[CONF_POLLING_PROFILES]
+        cg.add(
+            var.set_polling_profiles(
+                profiles[CONF_ENGINE_OFF_DELAY],
+                profiles[CONF_RUNNING_VOLTAGE],
+                profiles[CONF_PARKED_INTERVAL],
+                profiles[CONF_SLEEP_AFTER],
+                profiles[CONF_WAKE_INTERVAL],
+            )
+        )
+    if CONF_TRIP_COMPUTER in config:
+        trip = config[CONF_TRIP_COMPUTER]
+        fuel = FUEL_TYPES[trip[CONF_FUEL_TYPE]]
+        cg.add(
+            var.set_trip_computer(
+                trip.get(CONF_AIR_FUEL_RATIO, fuel[CONF_AIR_FUEL_RATIO]),
+                trip.get(CONF_FUEL_DENSITY, fuel[CONF_FUEL_DENSITY]),
+                trip[CONF_RESET_ON_ENGINE_START],
+            )
+        )
+    if CONF_DATA_LOG in config:
+        log = config[CONF_DATA_LOG]
+        cg.add_define("USE_ELM327_DATA_LOG")
+        cg.add(
+            var.set_data_log(
+                log[CONF_BUFFER_SIZE],
+                log.get(CONF_PARTITION, ""),
+                log[CONF_MIN_INTERVAL],
+                log[CONF_FLUSH_INTERVAL],
+                log[CONF_PORT],
+            )
+        )
+        if CONF_TIME_ID in log:
+            clock = await cg.get_variable(log[CONF_TIME_ID])
+            cg.add(var.set_data_log_time(clock))
+    for conf in config.get(CONF_ON_COMMAND_RESPONSE, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(
+            trigger,
+            [
+                (cg.std_string, "command"),
+                (cg.std_string, "response"),
+                (cg.bool_, "success"),
+            ],
+            conf,
+        )
+
+
+# ============================================================
+# Aktionen: einmalige Befehle vor der regulären Abfrage
+# ============================================================
+COMMAND_ACTION_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.use_id(ELM327BLEHub),
+        # Reihenfolge wartender Befehle, alle laufen vor der regulären Abfrage
+        cv.Optional(CONF_PRIORITY, default=0): cv.templatable(cv.uint8_t),
+        cv.Optional(CONF_HEADER, default=""): cv.templatable(
+            cv.Any(cv.one_of(""), validate_header)
+        ),
+    }
+)
+
+SEND_COMMAND_SCHEMA = COMMAND_ACTION_SCHEMA.extend(
+    {cv.Required(CONF_COMMAND): cv.templatable(validate_command)}
+)
+
+READ_FREEZE_FRAME_SCHEMA = COMMAND_ACTION_SCHEMA.extend(
+    {
+        # PID 02 = DTC, der den Freeze Frame ausgelöst hat
+        cv.Optional(CONF_PID, default=0x02): cv.hex_uint8_t,
+        cv.Optional(CONF_FRAME, default=0): cv.uint8_t,
+    }
+)
+
+
+async def build_command_action(config, action_id, template_arg, args, command):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    cg.add(var.set_command(await cg.templatable(command, args, cg.std_string)))
+    cg.add(
+        var.set_priority(await cg.templatable(config[CONF_PRIORITY], args, cg.uint8))
+    )
+    cg.add(
+        var.set_header(await cg.templatable(config[CONF_HEADER], args, cg.std_string))
+    )
+    return var
+
+
+@automation.register_action(
+    "elm327_ble.send_command", SendCommandAction, SEND_COMMAND_SCHEMA
+)
+async def send_command_to_code(config, action_id, template_arg, args):
+    return await build_command_action(
+        config, action_id, template_arg, args, config[CONF_COMMAND]
+    )
+
+
+@automation.register_action(
+    "elm327_ble.read_dtc",
+    SendCommandAction,
+    automation.maybe_simple_id(COMMAND_ACTION_SCHEMA),
+)
+async def read_dtc_to_code(config, action_id, template_arg, args):
+    return await build_command_action(config, action_id, template_arg, args, "03")
+
+
+@automation.register_action(
+    "elm327_ble.clear_dtc",
+    SendCommandAction,
+    automation.maybe_simple_id(COMMAND_ACTION_SCHEMA),
+)
+async def clear_dtc_to_code(config, action_id, template_arg, args):
+    return await build_command_action(config, action_id, template_arg, args, "04")
+
+
+@automation.register_action(
+    "elm327_ble.read_freeze_frame", SendCommandAction, READ_FREEZE_FRAME_SCHEMA
+)
+async def read_freeze_frame_to_code(config, action_id, template_arg, args):
+    command = f"02{config[CONF_PID]:02X}{config[CONF_FRAME]:02X}"
+    return await build_command_action(config, action_id, template_arg, args, command)
+
+
+# ============================================================
+# Mitschnitt ins Log schreiben
+# ============================================================
+@automation.register_action(
+    "elm327_ble.dump_trace",
+    DumpTraceAction,
+    automation.maybe_simple_id({cv.GenerateID(): cv.use_id(ELM327BLEHub)}),
+)
+async def dump_trace_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    return var
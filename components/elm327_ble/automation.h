@@ -0,0 +1,39 @@
+#pragma once
+
+#include "esphome/core/automation.h"
+#include "elm327_ble.h"
+
+#include <string>
+
+namespace esphome {
+namespace elm327_ble {
+
+// on_command_response: Befehl, bereinigte Antwort (leer ohne Antwort), Erfolg
+class CommandResponseTrigger : public Trigger<std::string, std::string, bool> {
+ public:
+  explicit CommandResponseTrigger(ELM327BLEHub *hub) {
+    hub->add_on_command_response_callback(
+        [this](std::string command, std::string response, bool success) { this->trigger(command, response, success); });
+  }
+};
+
+// elm327_ble.send_command sowie read_dtc, clear_dtc und read_freeze_frame (feste Befehle)
+template<typename... Ts> class SendCommandAction : public Action<Ts...>, public Parented<ELM327BLEHub> {
+ public:
+  TEMPLATABLE_VALUE(std::string, command)
+  TEMPLATABLE_VALUE(uint8_t, priority)
+  TEMPLATABLE_VALUE(std::string, header)
+
+  void play(Ts... x) override {
+    this->parent_->queue_command(this->command_.value(x...), this->priority_.value(x...), this->header_.value(x...));
+  }
+};
+
+// elm327_ble.dump_trace
+template<typename... Ts> class DumpTraceAction : public Action<Ts...>, public Parented<ELM327BLEHub> {
+ public:
+  void play(Ts... x) override { this->parent_->dump_trace(); }
+};
+
+}  // namespace elm327_ble
+}  // namespace esphome
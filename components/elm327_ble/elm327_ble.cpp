@@ -1,15 +1,87 @@
 #include "elm327_ble.h"
+#include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 namespace espbt = esphome::esp32_ble_tracker;
 
 namespace esphome {
 namespace elm327_ble {
 
 static const char *TAG = "elm327_ble";
+static const char *TRACE_TAG = "elm327_ble.trace";  // elm327_tracedump sucht Zeilen mit diesem Tag
 
 void ELM327BLEHub::setup() {
   ESP_LOGCONFIG(TAG, "ELM327 BLE Hub wird initialisiert...");
+  this->protocol_.set_transport(this);
+  this->protocol_.set_listener(this);
+
+  if (this->mtu_ > 23) {
+    // Gilt für den ganzen BLE-Stack, die MTU-Anfrage nach dem Verbinden nutzt diesen Wert
+    auto status = esp_ble_gatt_set_local_mtu(this->mtu_);
+    if (status != ESP_OK)
+      ESP_LOGW(TAG, "BLE: Lokale MTU %u nicht gesetzt: %d", this->mtu_, status);
+  }
+
+  if (this->fast_reconnect_) {
+    // Cache gehört zu genau diesem Adapter und diesen UUIDs
+    uint32_t hash = fnv1_hash("elm327_ble_session_v3" + this->service_uuid_str_ + this->char_tx_uuid_str_ +
+                              this->char_rx_uuid_str_) ^
+                    (uint32_t) this->parent()->get_address();
+    this->pref_ = global_preferences->make_preference<ELM327SessionCache>(hash);
+    if (this->pref_.load(&this->cache_)) {
+      ESP_LOGI(TAG, "Gespeicherte Verbindungsdaten: TX=0x%04X, RX=0x%04X, Protokoll %c",
+               this->cache_.tx_handle, this->cache_.rx_handle, this->cache_.protocol ? this->cache_.protocol : '-');
+      this->protocol_.set_known_protocol(this->cache_.protocol);
+      this->protocol_.set_supported_pids(this->cache_.supported_pids);
+      if (this->cache_.flags & SESSION_FLAG_ADAPTER_KNOWN) {
+        AdapterInfo adapter;
+        adapter.known = true;
+        adapter.response_count = this->cache_.flags & SESSION_FLAG_RESPONSE_COUNT;
+        adapter.stpx = this->cache_.flags & SESSION_FLAG_STPX;
+        adapter.id.assign(this->cache_.adapter, strnlen(this->cache_.adapter, sizeof(this->cache_.adapter)));
+        this->protocol_.set_adapter_info(adapter);
+      }
+    } else {
+      this->cache_ = {};
+    }
+  }
+
+  if (this->protocol_.trip().is_enabled()) {
+    // Fahrtsummen überstehen Neustarts, gespeichert wird nur bei Änderungen
+    uint32_t hash = fnv1_hash("elm327_ble_trip_v1") ^ (uint32_t) this->parent()->get_address();
+    this->trip_pref_ = global_preferences->make_preference<TripTotals>(hash);
+    TripTotals totals;
+    if (this->trip_pref_.load(&totals)) {
+      this->protocol_.trip().restore(totals);
+      ESP_LOGI(TAG, "Gespeicherte Fahrt: %.1f km, %.2f L", totals.distance_km, totals.fuel_l);
+    }
+    this->trip_saved_revision_ = this->protocol_.trip().revision();
+    this->set_interval("trip", TRIP_SAVE_MS, [this]() { this->save_trip(); });
+  }
+
+#ifdef USE_ELM327_DATA_LOG
+  this->setup_data_log();
+#endif
+
+  if (this->trace_size_ > 0) {
+    // Wie der Datenlogger bevorzugt im PSRAM, bleibt bis zum Neustart belegt
+    RAMAllocator<uint8_t> allocator;
+    uint8_t *buffer = allocator.allocate(this->trace_size_);
+    if (buffer == nullptr) {
+      ESP_LOGE(TAG, "Mitschnitt: %u Bytes RAM nicht verfuegbar", this->trace_size_);
+    } else {
+      this->trace_.set_buffer(buffer, this->trace_size_);
+    }
+  }
+
+  if (!this->stats_sensors_.empty()) {
+    this->stats_window_start_ = millis();
+    this->set_interval("stats", this->stats_interval_, [this]() { this->publish_stats(); });
+  }
 }
 
 void ELM327BLEHub::dump_config() {
@@ -17,11 +89,229 @@ void ELM327BLEHub::dump_config() {
   ESP_LOGCONFIG(TAG, "  Service UUID: %s", this->service_uuid_str_.c_str());
   ESP_LOGCONFIG(TAG, "  TX Char UUID: %s", this->char_tx_uuid_str_.c_str());
   ESP_LOGCONFIG(TAG, "  RX Char UUID: %s", this->char_rx_uuid_str_.c_str());
-  ESP_LOGCONFIG(TAG, "  Abfrageintervall: %u ms", this->request_interval_);
-  ESP_LOGCONFIG(TAG, "  Timeout: %u ms", this->request_timeout_);
-  ESP_LOGCONFIG(TAG, "  Registrierte PID-Sensoren: %d", (int) this->pid_sensors_.size());
+  ESP_LOGCONFIG(TAG, "  Abfrageintervall: %u ms", this->protocol_.get_request_interval());
+  ESP_LOGCONFIG(TAG, "  Timeout: %u ms", this->protocol_.get_request_timeout());
+  ESP_LOGCONFIG(TAG, "  Gelernte Timeouts (ATST/ATAT): %s", this->protocol_.get_adaptive_timing() ? "ja" : "nein");
+  ESP_LOGCONFIG(TAG, "  Multi-PID-Abfragen: %s", this->protocol_.get_batch_pids() ? "ja" : "nein");
+  ESP_LOGCONFIG(TAG, "  Max. Durchsatz: %s", this->protocol_.get_max_throughput() ? "ja" : "nein");
+  ESP_LOGCONFIG(TAG, "  CAN-Header (ATH1): %s", this->protocol_.get_headers() ? "ja" : "nein");
+  ESP_LOGCONFIG(TAG, "  Schnellstart: %s", this->fast_reconnect_ ? "ja" : "nein");
+  const AdapterInfo &adapter = this->protocol_.get_adapter_info();
+  if (adapter.known)
+    ESP_LOGCONFIG(TAG, "  Adapter: %s (Antwortanzahl %s, STPX %s)", adapter.id.c_str(),
+                  adapter.response_count ? "ja" : "nein", adapter.stpx ? "ja" : "nein");
+  ESP_LOGCONFIG(TAG, "  MTU: %u (ausgehandelt %u)", this->mtu_, this->negotiated_mtu_);
+  ESP_LOGCONFIG(TAG, "  Write ohne Quittung: %s", this->write_without_response_ ? "wenn unterstuetzt" : "nein");
+  if (this->trace_.is_enabled())
+    ESP_LOGCONFIG(TAG, "  Mitschnitt: %u Bytes", (unsigned) this->trace_.get_size());
+  if (this->conn_params_enabled_)
+    ESP_LOGCONFIG(TAG, "  Verbindungsintervall: %.2f ms aktiv, %.2f ms (Latency %u) in Ruhe, Timeout %u ms",
+                  this->active_interval_ * 1.25f, this->idle_interval_ * 1.25f, this->idle_latency_,
+                  this->supervision_timeout_ * 10);
+  ESP_LOGCONFIG(TAG, "  Registrierte PID-Sensoren: %d", (int) this->protocol_.entries().size());
+  const auto &entries = this->protocol_.entries();
+  for (int i = 0; i < (int) entries.size(); i++) {
+    const auto &config = entries[i].config;
+    if (config.is_can_signal) {
+      ESP_LOGCONFIG(TAG, "    CAN 0x%03X: Byte %u, %u Bytes", (unsigned) config.can_id, config.can_byte,
+                    entries[i].descriptor.length);
+    } else {
+      std::string cmd = config.command.substr(0, config.command.find('\r'));
+      ESP_LOGCONFIG(TAG, "    %s: Intervall %u ms, Prioritaet %u", cmd.c_str(), entries[i].schedule.update_interval,
+                    entries[i].schedule.priority);
+      if (!config.header.empty() || entries[i].formula != nullptr)
+        ESP_LOGCONFIG(TAG, "      Header %s, Formel %s", config.header.empty() ? "Standard" : config.header.c_str(),
+                      entries[i].formula != nullptr ? "aus YAML" : "Standard");
+      if (config.ecu != 0)
+        ESP_LOGCONFIG(TAG, "      Steuergeraet %X", (unsigned) config.ecu);
+    }
+    if (i < (int) this->channels_.size() && (this->channels_[i].deadband > 0 || this->channels_[i].heartbeat > 0))
+      ESP_LOGCONFIG(TAG, "      Deadband %g%s, Heartbeat %u ms",
+                    this->channels_[i].deadband * (this->channels_[i].deadband_percent ? 100 : 1),
+                    this->channels_[i].deadband_percent ? " %" : "", this->channels_[i].heartbeat);
+  }
   if (this->dtc_text_sensor_ != nullptr)
-    ESP_LOGCONFIG(TAG, "  DTC Text Sensor: ja");
+    ESP_LOGCONFIG(TAG, "  DTC Text Sensor: ja (Intervall %u ms)",
+                  this->protocol_.get_dtc_schedule().update_interval);
+  for (const auto &info : this->protocol_.get_vehicle_info())
+    ESP_LOGCONFIG(TAG, "  Fahrzeug-Info 09%02X: %s", info.pid, info.value.empty() ? "(noch nicht gelesen)" : info.value.c_str());
+  const PowerProfileConfig &profiles = this->protocol_.get_power_profiles();
+  if (profiles.enabled) {
+    ESP_LOGCONFIG(TAG, "  Abfrageprofile: Stand nach %u ms ohne Drehzahl bzw. unter %.1f V, dann alle %u ms",
+                  profiles.engine_off_delay, profiles.running_voltage, profiles.parked_interval);
+    if (profiles.sleep_after > 0)
+      ESP_LOGCONFIG(TAG, "    ATLP nach %u ms im Stand, Weckprobe alle %u ms", profiles.sleep_after,
+                    profiles.wake_interval);
+  }
+  const ELM327TripComputer &trip = this->protocol_.trip();
+  if (trip.is_enabled())
+    ESP_LOGCONFIG(TAG, "  Bordcomputer: %d Sensoren, AFR %.1f, Dichte %.0f g/L, neue Fahrt bei Motorstart: %s",
+                  (int) this->trip_sensors_.size(), trip.get_air_fuel_ratio(), trip.get_fuel_density(),
+                  trip.get_reset_on_engine_start() ? "ja" : "nein");
+#ifdef USE_ELM327_DATA_LOG
+  if (this->data_log_.is_enabled()) {
+    ESP_LOGCONFIG(TAG, "  Datenlogger: %u KiB RAM, je Kanal hoechstens alle %u ms, Download auf Port %u",
+                  this->data_log_.get_ram_blocks() * (unsigned) ELM327DataLog::BLOCK_SIZE / 1024,
+                  this->log_min_interval_, this->log_server_.get_port());
+    if (this->data_log_.get_flash_blocks() > 0)
+      ESP_LOGCONFIG(TAG, "    Partition '%s': %u KiB, spaetestens alle %u ms geschrieben", this->log_partition_.c_str(),
+                    this->data_log_.get_flash_blocks() * (unsigned) ELM327DataLog::BLOCK_SIZE / 1024,
+                    this->log_flush_interval_);
+  }
+#endif
+  if (this->protocol_.has_monitor())
+    ESP_LOGCONFIG(TAG, "  CAN-Monitor: ja (mindestens %u ms je Phase)", this->protocol_.get_monitor_duration());
+  if (!this->stats_sensors_.empty())
+    ESP_LOGCONFIG(TAG, "  Diagnose-Sensoren: %d (Intervall %u ms)", (int) this->stats_sensors_.size(),
+                  this->stats_interval_);
+}
+
+// ============================================================
+// Bordcomputer
+// ============================================================
+void ELM327BLEHub::publish_trip(uint32_t now) {
+  const ELM327TripComputer &trip = this->protocol_.trip();
+  if (this->trip_sensors_.empty() || trip.revision() == this->trip_published_revision_)
+    return;
+  // Laufende Summen höchstens einmal pro Sekunde
+  if (this->trip_published_at_ != 0 && now - this->trip_published_at_ < TRIP_PUBLISH_MS)
+    return;
+  this->trip_published_revision_ = trip.revision();
+  this->trip_published_at_ = now;
+  for (const auto &output : this->trip_sensors_)
+    output.sensor->publish_state(trip.value(output.type));
+}
+
+void ELM327BLEHub::save_trip() {
+  const ELM327TripComputer &trip = this->protocol_.trip();
+  if (!trip.is_enabled() || trip.revision() == this->trip_saved_revision_)
+    return;
+  this->trip_saved_revision_ = trip.revision();
+  this->trip_pref_.save(&trip.totals());
+  ESP_LOGD(TAG, "Fahrt gespeichert: %.2f km, %.3f L", trip.totals().distance_km, trip.totals().fuel_l);
+}
+
+#ifdef USE_ELM327_DATA_LOG
+// ============================================================
+// Datenlogger
+// ============================================================
+void ELM327BLEHub::setup_data_log() {
+  // Mit PSRAM landet der Puffer dort, sonst im internen RAM
+  RAMAllocator<uint8_t> allocator;
+  uint8_t *buffer = allocator.allocate(this->log_buffer_size_);
+  if (buffer == nullptr) {
+    ESP_LOGE(TAG, "Datenlogger: %u Bytes RAM nicht verfuegbar", this->log_buffer_size_);
+    return;
+  }
+  this->data_log_.set_buffer(buffer, this->log_buffer_size_);
+
+  this->log_pref_ = global_preferences->make_preference<DataLogState>(fnv1_hash("elm327_ble_data_log_v1"));
+  if (!this->log_pref_.load(&this->log_state_))
+    this->log_state_ = {};
+  this->log_state_.boot++;
+  this->log_pref_.save(&this->log_state_);
+  this->data_log_.set_boot(this->log_state_.boot);
+  this->data_log_.set_first_sequence(this->log_state_.first_sequence);
+
+  if (!this->log_partition_.empty()) {
+    if (this->log_storage_.open(this->log_partition_)) {
+      this->data_log_.set_storage(&this->log_storage_);
+      this->data_log_.set_flush_blocks(ELM327PartitionStorage::BLOCKS_PER_SECTOR);
+    } else {
+      ESP_LOGE(TAG, "Datenlogger: Partition '%s' nicht gefunden, Werte nur im RAM", this->log_partition_.c_str());
+    }
+  }
+  this->log_server_.set_log(&this->data_log_);
+  // Angefangene Blöcke spätestens nach flush_interval sichern
+  this->set_interval("data_log", this->log_flush_interval_, [this]() {
+    if (!this->log_server_.is_active())
+      this->data_log_.flush(true, 1);
+  });
+}
+
+void ELM327BLEHub::loop_data_log(uint32_t now) {
+  if (!this->data_log_.is_enabled())
+    return;
+#ifdef USE_TIME
+  if (this->log_time_ != nullptr && (this->log_clock_at_ == 0 || now - this->log_clock_at_ >= LOG_CLOCK_MS)) {
+    ESPTime time = this->log_time_->now();
+    if (time.is_valid()) {
+      this->data_log_.set_clock(time.timestamp, now);
+      this->log_clock_at_ = now;
+    }
+  }
+#endif
+  this->log_server_.loop();
+  // Ein Block pro Durchlauf (Sektor löschen dauert ~50 ms), während eines Downloads gar nicht
+  if (!this->log_server_.is_active())
+    this->data_log_.flush(false, 1);
+}
+
+void ELM327BLEHub::log_value(int channel, float value) {
+  const auto &entries = this->protocol_.entries();
+  if (!this->data_log_.is_enabled() || channel >= (int) entries.size())
+    return;
+  if (this->log_times_.size() < entries.size())
+    this->log_times_.resize(entries.size(), 0);
+  uint32_t now = millis();
+  uint32_t &last = this->log_times_[channel];
+  if (last != 0 && now - last < this->log_min_interval_)
+    return;
+  last = now;
+  this->data_log_.add_value(entries[channel].config, value, now);
+}
+
+void ELM327BLEHub::clear_data_log() {
+  ESP_LOGI(TAG, "Datenlogger geleert");
+  this->data_log_.clear();
+  this->log_state_.first_sequence = this->data_log_.get_first_sequence();
+  this->log_pref_.save(&this->log_state_);
+}
+#endif
+
+// ============================================================
+// Mitschnitt
+// ============================================================
+void ELM327BLEHub::dump_trace() {
+  if (!this->trace_.is_enabled()) {
+    ESP_LOGW(TAG, "Mitschnitt ist abgeschaltet (trace_size: 0)");
+    return;
+  }
+  if (!this->trace_dump_.empty()) {
+    ESP_LOGW(TAG, "Mitschnitt wird bereits ausgegeben");
+    return;
+  }
+  // Kopie, damit neue Einträge die laufende Ausgabe nicht verändern
+  this->trace_dump_.resize(this->trace_.export_size());
+  this->trace_.export_to(this->trace_dump_.data(), millis());
+  this->trace_dump_pos_ = 0;
+  ESP_LOGI(TRACE_TAG, "Beginn: %u Bytes, %u Eintraege, %u ueberschrieben", (unsigned) this->trace_dump_.size(),
+           this->trace_.get_count(), this->trace_.get_dropped());
+}
+
+void ELM327BLEHub::loop_trace_dump() {
+  if (this->trace_dump_.empty())
+    return;
+  static const char HEX[] = "0123456789ABCDEF";
+  char line[TRACE_DUMP_LINE * 2 + 1];
+  for (uint32_t i = 0; i < TRACE_DUMP_LINES && this->trace_dump_pos_ < this->trace_dump_.size(); i++) {
+    size_t n = this->trace_dump_.size() - this->trace_dump_pos_;
+    if (n > TRACE_DUMP_LINE)
+      n = TRACE_DUMP_LINE;
+    const uint8_t *data = this->trace_dump_.data() + this->trace_dump_pos_;
+    for (size_t j = 0; j < n; j++) {
+      line[2 * j] = HEX[data[j] >> 4];
+      line[2 * j + 1] = HEX[data[j] & 0x0F];
+    }
+    line[2 * n] = '\0';
+    // Offset vorweg: elm327_tracedump erkennt so verlorene Logzeilen
+    ESP_LOGI(TRACE_TAG, "%04X %s", (unsigned) this->trace_dump_pos_, line);
+    this->trace_dump_pos_ += n;
+  }
+  if (this->trace_dump_pos_ < this->trace_dump_.size())
+    return;
+  ESP_LOGI(TRACE_TAG, "Ende");
+  std::vector<uint8_t>().swap(this->trace_dump_);  // Speicher freigeben
 }
 
 // ============================================================
@@ -30,23 +320,69 @@ void ELM327BLEHub::dump_config() {
 void ELM327BLEHub::gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if,
                                          esp_ble_gattc_cb_param_t *param) {
   switch (event) {
+    case ESP_GATTC_CONNECT_EVT: {
+      // Vom Stack beim Verbindungsaufbau gewählte Parameter
+      this->conn_interval_ = param->connect.conn_params.interval;
+      this->conn_latency_ = param->connect.conn_params.latency;
+      this->conn_mode_ = CONNECTION_DEFAULT;
+      this->conn_update_pending_ = false;
+      this->trace_.add_event(TRACE_EVENT_CONNECT, this->conn_interval_, millis());
+      ESP_LOGD(TAG, "BLE: Verbindungsintervall %.2f ms, Slave Latency %u", this->conn_interval_ * 1.25f,
+               this->conn_latency_);
+      break;
+    }
+
     case ESP_GATTC_OPEN_EVT: {
+      this->trace_.add_event(TRACE_EVENT_OPEN, param->open.status, millis());
       if (param->open.status == ESP_GATT_OK) {
         ESP_LOGI(TAG, "BLE: Verbunden mit ELM327");
-        this->state_ = STATE_CONNECTED;
+        if (this->connected_before_)
+          this->reconnects_++;
+        this->connected_before_ = true;
         if (this->connected_binary_sensor_ != nullptr)
           this->connected_binary_sensor_->publish_state(false);  // noch nicht initialisiert
+
+        // Größere MTU: Antworten kommen in weniger Notifies. Hat der BLE-Client die MTU
+        // schon ausgehandelt, lehnt der Stack die zweite Anfrage ab (ESP_GATTC_CFG_MTU_EVT).
+        this->reset_write_state();
+        this->negotiated_mtu_ = 23;
+        if (this->mtu_ > 23) {
+          auto status = esp_ble_gattc_send_mtu_req(gattc_if, param->open.conn_id);
+          if (status != ESP_OK)
+            ESP_LOGW(TAG, "BLE: MTU-Anfrage fehlgeschlagen: %d", status);
+        }
+
+        // Schnellstart: gespeicherte Handles sofort nutzen, Service Discovery bestätigt sie später
+        if (this->fast_reconnect_ && this->cache_.tx_handle != 0 && this->cache_.rx_handle != 0) {
+          this->char_tx_handle_ = this->cache_.tx_handle;
+          this->char_rx_handle_ = this->cache_.rx_handle;
+          this->cccd_handle_ = this->cache_.cccd_handle;
+          this->write_no_rsp_ = this->write_without_response_ && (this->cache_.flags & SESSION_FLAG_WRITE_NR);
+          this->handles_resolved_ = true;
+          this->cached_handles_ = true;
+          ESP_LOGI(TAG, "BLE: Schnellstart mit gespeicherten Handles TX=0x%04X, RX=0x%04X",
+                   this->char_tx_handle_, this->char_rx_handle_);
+          this->register_notify();
+        }
       }
       break;
     }
 
     case ESP_GATTC_DISCONNECT_EVT: {
       ESP_LOGW(TAG, "BLE: ELM327 getrennt!");
-      this->state_ = STATE_IDLE;
+      this->trace_.add_event(TRACE_EVENT_DISCONNECT, param->disconnect.reason, millis());
       this->handles_resolved_ = false;
-      this->init_step_ = 0;
-      this->waiting_for_response_ = false;
-      this->response_buffer_.clear();
+      this->cached_handles_ = false;
+      this->reset_write_state();
+      this->conn_interval_ = 0;
+      this->conn_mode_ = CONNECTION_DEFAULT;
+      this->conn_update_pending_ = false;
+      this->protocol_.stop();
+      this->engine_running_ = false;
+      this->save_trip();
+#ifdef USE_ELM327_DATA_LOG
+      this->data_log_.flush(true, 1);
+#endif
       if (this->connected_binary_sensor_ != nullptr)
         this->connected_binary_sensor_->publish_state(false);
       break;
@@ -66,27 +402,85 @@ void ELM327BLEHub::gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t
         break;
       }
 
+      auto *cccd = this->parent()->get_config_descriptor(chr_rx->handle);
+      uint16_t cccd_handle = cccd != nullptr ? cccd->handle : 0;
+      // Ohne Quittung muss der nächste Befehl nicht auf die Write Response warten
+      this->write_no_rsp_ = this->write_without_response_ && (chr_tx->properties & ESP_GATT_CHAR_PROP_BIT_WRITE_NR);
+
+      if (this->cached_handles_) {
+        this->cached_handles_ = false;
+        if (chr_tx->handle == this->char_tx_handle_ && chr_rx->handle == this->char_rx_handle_) {
+          ESP_LOGD(TAG, "BLE: Gespeicherte Handles bestaetigt");
+          this->save_session_cache();  // während der Discovery erkanntes Protokoll nachtragen
+          break;
+        }
+        // Adapter-Firmware hat sich geändert → mit den richtigen Handles neu starten
+        ESP_LOGW(TAG, "BLE: Gespeicherte Handles veraltet, starte neu");
+        this->protocol_.stop();
+      }
+
       this->char_tx_handle_ = chr_tx->handle;
       this->char_rx_handle_ = chr_rx->handle;
+      this->cccd_handle_ = cccd_handle;
       this->handles_resolved_ = true;
+      this->trace_.add_event(TRACE_EVENT_SERVICES, (uint32_t) chr_tx->handle << 16 | chr_rx->handle, millis());
 
-      ESP_LOGI(TAG, "BLE: TX Handle=0x%04X, RX Handle=0x%04X",
-               this->char_tx_handle_, this->char_rx_handle_);
+      ESP_LOGI(TAG, "BLE: TX Handle=0x%04X, RX Handle=0x%04X, Write %s",
+               this->char_tx_handle_, this->char_rx_handle_, this->write_no_rsp_ ? "ohne Quittung" : "mit Quittung");
 
-      // Notify registrieren für RX Characteristic
-      auto status = esp_ble_gattc_register_for_notify(
-          this->parent()->get_gattc_if(), this->parent()->get_remote_bda(), this->char_rx_handle_);
-      if (status != ESP_OK) {
-        ESP_LOGW(TAG, "BLE: Notify-Registrierung fehlgeschlagen: %d", status);
-      }
+      this->save_session_cache();
+      this->register_notify();
       break;
     }
 
     case ESP_GATTC_REG_FOR_NOTIFY_EVT: {
+      if (this->cached_handles_ && this->cccd_handle_ != 0) {
+        // Vor der Service Discovery kennt der BLE-Client den Descriptor noch nicht,
+        // Notifications daher selbst einschalten
+        uint8_t notify_enable[2] = {0x01, 0x00};
+        auto status = esp_ble_gattc_write_char_descr(this->parent()->get_gattc_if(), this->parent()->get_conn_id(),
+                                                     this->cccd_handle_, sizeof(notify_enable), notify_enable,
+                                                     ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+        if (status != ESP_OK)
+          ESP_LOGW(TAG, "BLE: Notify aktivieren fehlgeschlagen: %d", status);
+      }
+      if (this->protocol_.is_active())
+        break;
       ESP_LOGI(TAG, "BLE: Notify registriert, starte Initialisierung...");
-      this->state_ = STATE_INITIALIZING;
-      this->init_step_ = 0;
-      this->last_init_time_ = 0;
+      this->trace_.add_event(TRACE_EVENT_NOTIFY, 0, millis());
+      this->protocol_.start(millis());
+      break;
+    }
+
+    case ESP_GATTC_CFG_MTU_EVT: {
+      if (param->cfg_mtu.status != ESP_GATT_OK) {
+        ESP_LOGD(TAG, "BLE: MTU-Anfrage abgelehnt: %d", param->cfg_mtu.status);
+        break;
+      }
+      this->negotiated_mtu_ = param->cfg_mtu.mtu;
+      this->trace_.add_event(TRACE_EVENT_MTU, this->negotiated_mtu_, millis());
+      ESP_LOGI(TAG, "BLE: MTU %u", this->negotiated_mtu_);
+      break;
+    }
+
+    case ESP_GATTC_WRITE_CHAR_EVT: {
+      if (param->write.handle != this->char_tx_handle_ || !this->write_in_flight_)
+        break;
+      this->write_in_flight_ = false;
+      this->trace_.add_event(TRACE_EVENT_WRITE_ACK, param->write.status, millis());
+      if (param->write.status != ESP_GATT_OK) {
+        ESP_LOGW(TAG, "BLE Write nicht quittiert: %d", param->write.status);
+        this->protocol_.on_write_failed();
+      } else {
+        ESP_LOGV(TAG, "BLE Write quittiert nach %u ms", (unsigned) (millis() - this->write_started_));
+      }
+      // Zurückgehaltenen Befehl sofort hinterherschicken
+      if (this->queued_write_len_ > 0) {
+        uint8_t len = this->queued_write_len_;
+        this->queued_write_len_ = 0;
+        if (!this->send_write(this->queued_write_, len))
+          this->protocol_.on_write_failed();
+      }
       break;
     }
 
@@ -94,17 +488,12 @@ void ELM327BLEHub::gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t
       if (param->notify.handle != this->char_rx_handle_)
         break;
 
-      // Daten zum Puffer hinzufügen
-      std::string chunk((char *) param->notify.value, param->notify.value_len);
-      ESP_LOGV(TAG, "Empfangen (raw): %s", chunk.c_str());
-      this->response_buffer_ += chunk;
-
-      // Prüfe ob Antwort komplett (ELM327 sendet '>' als Prompt)
-      if (this->response_buffer_.find('>') != std::string::npos) {
-        std::string full = this->response_buffer_;
-        this->response_buffer_.clear();
-        this->process_response(full);
-      }
+      ESP_LOGV(TAG, "Empfangen (raw): %.*s", param->notify.value_len, (const char *) param->notify.value);
+      uint32_t now = millis();
+      this->trace_.add(TRACE_RX, param->notify.value, param->notify.value_len, now);
+      // Mit max_throughput sendet receive() nach dem Prompt auch gleich die nächste Anfrage
+      this->protocol_.receive(param->notify.value, param->notify.value_len, now);
+      this->flush_values(now);
       break;
     }
 
@@ -114,396 +503,411 @@ void ELM327BLEHub::gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t
 }
 
 // ============================================================
-// Main Loop
+// Verbindungsparameter
 // ============================================================
-void ELM327BLEHub::loop() {
-  uint32_t now = millis();
-
-  switch (this->state_) {
-    case STATE_INITIALIZING:
-      this->run_init_sequence();
-      break;
+// Jede Anfrage braucht mehrere Connection Events (Write, Quittung, Notifies). Solange
+// abgefragt wird, gilt das kurze Intervall. Im Stand und Schlaf (polling_profiles) darf
+// der Adapter mit langem Intervall und Slave Latency Events auslassen und Strom sparen.
+void ELM327BLEHub::loop_connection_params(uint32_t now) {
+  if (!this->conn_params_enabled_ || !this->handles_resolved_)
+    return;
+  if (this->conn_update_pending_ && now - this->conn_requested_at_ < CONN_UPDATE_TIMEOUT_MS)
+    return;
+  bool active = this->protocol_.get_profile() == PROFILE_RUNNING || this->protocol_.get_queued_commands() > 0;
+  ConnectionMode mode = active ? CONNECTION_ACTIVE : CONNECTION_IDLE;
+  if (mode == this->conn_mode_)
+    return;
 
-    case STATE_READY:
-      // Nächste PID-Abfrage senden
-      if (!this->waiting_for_response_ && (now - this->last_request_time_ >= this->request_interval_)) {
-        this->request_next_pid();
-      }
-      // Timeout prüfen
-      if (this->waiting_for_response_ && (now - this->last_request_time_ >= this->request_timeout_)) {
-        ESP_LOGW(TAG, "Antwort-Timeout, mache weiter...");
-        this->waiting_for_response_ = false;
-        this->response_buffer_.clear();
-      }
-      break;
+  esp_ble_conn_update_params_t params{};
+  memcpy(params.bda, this->parent()->get_remote_bda(), sizeof(esp_bd_addr_t));
+  params.min_int = active ? this->active_interval_ : this->idle_interval_;
+  params.max_int = params.min_int;
+  params.latency = active ? 0 : this->idle_latency_;
+  params.timeout = this->supervision_timeout_;
+  // Auch bei einem Fehler nicht sofort wiederholen, erst beim nächsten Wechsel
+  this->conn_mode_ = mode;
+  this->conn_requested_at_ = now;
+  esp_err_t err = esp_ble_gap_update_conn_params(&params);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "BLE: Verbindungsparameter nicht angefragt: %d", err);
+    return;
+  }
+  this->conn_update_pending_ = true;
+  ESP_LOGD(TAG, "BLE: %s, Intervall %.2f ms, Slave Latency %u angefragt", active ? "Abfrage" : "Ruhe",
+           params.min_int * 1.25f, params.latency);
+}
 
-    default:
-      break;
+void ELM327BLEHub::gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
+  if (event != ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT || this->parent()->get_remote_bda() == nullptr ||
+      memcmp(param->update_conn_params.bda, this->parent()->get_remote_bda(), sizeof(esp_bd_addr_t)) != 0)
+    return;  // auch Updates anderer Verbindungen des ESP32 kommen hier an
+  this->conn_update_pending_ = false;
+  if (param->update_conn_params.status != ESP_BT_STATUS_SUCCESS) {
+    ESP_LOGW(TAG, "BLE: Verbindungsparameter nicht uebernommen: %d", (int) param->update_conn_params.status);
+    return;
   }
+  this->conn_interval_ = param->update_conn_params.conn_int;
+  this->conn_latency_ = param->update_conn_params.latency;
+  this->trace_.add_event(TRACE_EVENT_CONN_PARAMS, (uint32_t) this->conn_interval_ << 16 | this->conn_latency_,
+                         millis());
+  ESP_LOGI(TAG, "BLE: Verbindungsintervall %.2f ms, Slave Latency %u", this->conn_interval_ * 1.25f,
+           this->conn_latency_);
 }
 
 // ============================================================
-// ELM327 Initialisierung
+// Main Loop
 // ============================================================
-void ELM327BLEHub::run_init_sequence() {
+void ELM327BLEHub::loop() {
   uint32_t now = millis();
-
-  struct InitCmd {
-    const char *cmd;
-    uint32_t delay_after;
-    const char *description;
-  };
-
-  static const InitCmd init_cmds[] = {
-    {"ATZ\r",   2000, "Reset"},
-    {"ATE0\r",   500, "Echo aus"},
-    {"ATL0\r",   500, "Linefeed aus"},
-    {"ATS0\r",   500, "Spaces aus"},
-    {"ATH0\r",   500, "Headers aus"},
-    {"ATSP0\r", 1000, "Auto-Protokoll"},
-    {"0100\r",  5000, "Protokoll-Erkennung"},
-  };
-
-  if (this->init_step_ >= INIT_STEPS_COUNT) {
-    // Initialisierung abgeschlossen
-    ESP_LOGI(TAG, "ELM327 initialisiert - bereit fuer Abfragen");
-    this->state_ = STATE_READY;
-    this->current_pid_index_ = 0;
-    this->waiting_for_response_ = false;
-    if (this->connected_binary_sensor_ != nullptr)
-      this->connected_binary_sensor_->publish_state(true);
-    return;
+  this->protocol_.loop(now);
+  uint32_t timeouts = this->protocol_.get_stats().timeouts;
+  if (timeouts != this->trace_timeouts_) {
+    this->trace_timeouts_ = timeouts;
+    this->trace_.add_event(TRACE_EVENT_TIMEOUT, timeouts, now);
   }
-
-  if (this->last_init_time_ == 0 || (now - this->last_init_time_ >= init_cmds[this->init_step_].delay_after)) {
-    if (this->last_init_time_ != 0) {
-      // Nächster Schritt
-      this->init_step_++;
-      if (this->init_step_ >= INIT_STEPS_COUNT) {
-        // Letzter Delay abgelaufen, fertig
-        this->run_init_sequence();
-        return;
-      }
-    }
-
-    ESP_LOGD(TAG, "Init [%d/%d]: %s", this->init_step_ + 1, INIT_STEPS_COUNT,
-             init_cmds[this->init_step_].description);
-    this->send_command(init_cmds[this->init_step_].cmd);
-    this->last_init_time_ = now;
+  this->loop_connection_params(now);
+  this->flush_values(now);
+#ifdef USE_ELM327_DATA_LOG
+  this->loop_data_log(now);
+#endif
+  this->loop_trace_dump();
+
+  // Heartbeat: unveränderte Werte nach spätestens `heartbeat` ms erneut senden
+  for (auto &channel : this->channels_) {
+    if (channel.heartbeat == 0 || std::isnan(channel.value) || now - channel.published_at < channel.heartbeat ||
+        !this->protocol_.is_ready())
+      continue;
+    channel.published = channel.value;
+    channel.published_at = now;
+    channel.sensor->publish_state(channel.value);
   }
 }
 
 // ============================================================
-// BLE Write
+// BLE Write (ELM327Transport)
 // ============================================================
-void ELM327BLEHub::send_command(const std::string &cmd) {
+bool ELM327BLEHub::write(const uint8_t *data, size_t len) {
+  this->trace_.add(TRACE_TX, data, len, millis());
   if (!this->handles_resolved_) {
     ESP_LOGW(TAG, "Kann nicht senden - BLE Handles nicht aufgeloest");
-    return;
+    return false;
   }
 
-  auto status = esp_ble_gattc_write_char(
-      this->parent()->get_gattc_if(),
-      this->parent()->get_conn_id(),
-      this->char_tx_handle_,
-      cmd.size(),
-      (uint8_t *) cmd.data(),
-      ESP_GATT_WRITE_TYPE_RSP,
-      ESP_GATT_AUTH_REQ_NONE);
-
-  if (status != ESP_OK) {
-    ESP_LOGW(TAG, "BLE Write fehlgeschlagen: %d", status);
+  // Der Stack nimmt pro Verbindung nur einen Write mit Quittung an. Steht die Quittung
+  // noch aus, wird der Befehl zurückgehalten und im ESP_GATTC_WRITE_CHAR_EVT gesendet.
+  static_assert(sizeof(queued_write_) >= ELM327Protocol::MAX_WRITE_LENGTH && ELM327Protocol::MAX_WRITE_LENGTH <= 0xFF,
+                "Jeder Befehl des Protokollkerns muss zurueckgehalten werden koennen");
+  if (this->write_in_flight_) {
+    if (len > sizeof(this->queued_write_)) {
+      ESP_LOGW(TAG, "BLE Write verworfen - Befehl zu lang (%u Bytes)", (unsigned) len);
+      return false;
+    }
+    if (this->queued_write_len_ > 0) {
+      ESP_LOGW(TAG, "BLE Write verworfen - vorheriger Befehl noch nicht quittiert");
+      return false;
+    }
+    memcpy(this->queued_write_, data, len);
+    this->queued_write_len_ = len;
+    return true;
   }
+  return this->send_write(data, len);
 }
 
-// ============================================================
-// PID-Abfrage-Zyklus
-// ============================================================
-void ELM327BLEHub::request_next_pid() {
-  if (this->pid_sensors_.empty() && this->dtc_text_sensor_ == nullptr)
-    return;
-
-  // Gesamtliste: PID-Sensoren + optional DTC
-  int total = this->pid_sensors_.size();
-  bool has_dtc = (this->dtc_text_sensor_ != nullptr);
-  if (has_dtc) total++;
-
-  if (total == 0) return;
-
-  int idx = this->current_pid_index_ % total;
+bool ELM327BLEHub::send_write(const uint8_t *data, size_t len) {
+  auto gattc_if = this->parent()->get_gattc_if();
+  auto conn_id = this->parent()->get_conn_id();
+
+  if (this->write_no_rsp_) {
+    // Ohne Quittung höchstens MTU - 3 Bytes pro Write
+    size_t chunk_size = this->negotiated_mtu_ - 3;
+    for (size_t pos = 0; pos < len; pos += chunk_size) {
+      size_t n = len - pos < chunk_size ? len - pos : chunk_size;
+      auto status = esp_ble_gattc_write_char(gattc_if, conn_id, this->char_tx_handle_, n, (uint8_t *) data + pos,
+                                             ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
+      if (status != ESP_OK) {
+        this->trace_.add_event(TRACE_EVENT_WRITE_ERROR, status, millis());
+        ESP_LOGW(TAG, "BLE Write fehlgeschlagen: %d", status);
+        return false;
+      }
+    }
+    return true;
+  }
 
-  std::string cmd;
-  if (idx < (int) this->pid_sensors_.size()) {
-    cmd = this->pid_sensors_[idx].config.command;
-    ESP_LOGD(TAG, "PID[%d/%d] gesendet: %s", idx + 1, total, cmd.c_str());
-  } else {
-    // DTC-Abfrage
-    cmd = "03\r";
-    ESP_LOGD(TAG, "DTC Abfrage [%d/%d] gesendet", idx + 1, total);
+  auto status = esp_ble_gattc_write_char(gattc_if, conn_id, this->char_tx_handle_, len, (uint8_t *) data,
+                                         ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+  if (status != ESP_OK) {
+    this->trace_.add_event(TRACE_EVENT_WRITE_ERROR, status, millis());
+    ESP_LOGW(TAG, "BLE Write fehlgeschlagen: %d", status);
+    return false;
   }
+  this->write_in_flight_ = true;
+  this->write_started_ = millis();
+  return true;
+}
 
-  this->response_buffer_.clear();
-  this->waiting_for_response_ = true;
-  this->last_request_time_ = millis();
-  this->send_command(cmd);
-  this->current_pid_index_ = (idx + 1) % total;
+void ELM327BLEHub::reset_write_state() {
+  this->write_in_flight_ = false;
+  this->queued_write_len_ = 0;
 }
 
 // ============================================================
-// Antwort-Verarbeitung
+// Werte veröffentlichen (ELM327Listener)
 // ============================================================
-void ELM327BLEHub::process_response(const std::string &response) {
-  this->waiting_for_response_ = false;
-
-  // Bereinigen
-  std::string clean;
-  for (char c : response) {
-    if (c != ' ' && c != '\r' && c != '\n' && c != '>') {
-      clean += c;
-    }
-  }
-
-  ESP_LOGD(TAG, "Antwort: %s", clean.c_str());
-
-  // Debug: Raw Text Sensor
-  if (this->raw_text_sensor_ != nullptr) {
-    this->raw_text_sensor_->publish_state(clean);
-  }
-
-  // Fehler ignorieren
-  if (clean.find("NODATA") != std::string::npos ||
-      clean.find("ERROR") != std::string::npos ||
-      clean.find("UNABLE") != std::string::npos ||
-      clean.find("STOPPED") != std::string::npos) {
-    ESP_LOGW(TAG, "Fehler/Keine Daten: %s", clean.c_str());
+// Werte nur merken, veröffentlicht wird nach der kompletten Antwort in flush_values()
+void ELM327BLEHub::on_value(int channel, float value) {
+#ifdef USE_ELM327_DATA_LOG
+  this->log_value(channel, value);
+#endif
+  if (channel >= (int) this->channels_.size() || this->channels_[channel].sensor == nullptr)
     return;
-  }
+  this->channels_[channel].value = value;
+  this->channels_[channel].pending = true;
+  this->values_pending_ = true;
+}
 
-  // DTC-Antwort (Mode 03, beginnt mit "43")
-  if (clean.find("43") != std::string::npos) {
-    this->parse_dtc_response(clean);
+void ELM327BLEHub::flush_values(uint32_t now) {
+  this->publish_trip(now);
+  if (!this->values_pending_)
     return;
+  this->values_pending_ = false;
+  for (auto &channel : this->channels_) {
+    if (!channel.pending)
+      continue;
+    channel.pending = false;
+    float threshold = channel.deadband_percent ? std::fabs(channel.published) * channel.deadband : channel.deadband;
+    bool changed = std::isnan(channel.published) != std::isnan(channel.value) ||
+                   std::fabs(channel.value - channel.published) > threshold;
+    if (!changed && channel.published_at != 0)
+      continue;
+    channel.published = channel.value;
+    channel.published_at = now;
+    channel.sensor->publish_state(channel.value);
   }
+}
 
-  // Batteriespannung (ATRV, z.B. "12.4V")
-  if (clean.find("V") != std::string::npos && clean.find("41") == std::string::npos) {
-    this->parse_voltage_response(clean);
+// Text- und Binary-Sensoren nur bei Änderung senden
+void ELM327BLEHub::on_dtc(const std::string &codes) {
+  if (this->dtc_text_sensor_ == nullptr)
     return;
-  }
-
-  // OBD2 Mode 01 Antwort (beginnt mit "41")
-  if (clean.find("41") != std::string::npos) {
-    this->parse_obd2_response(clean);
+  if (this->dtc_text_sensor_->has_state() && this->dtc_text_sensor_->state == codes)
     return;
-  }
+  this->dtc_text_sensor_->publish_state(codes);
 }
 
-// ============================================================
-// OBD2 PID Parsing
-// ============================================================
-void ELM327BLEHub::parse_obd2_response(const std::string &clean) {
-  size_t pos = clean.find("41");
-  if (pos == std::string::npos) return;
-
-  std::string data = clean.substr(pos);
-  if (data.length() < 6) return;
-
-  auto hex_byte = [](const std::string &s, int off) -> int {
-    if (off + 2 > (int) s.length()) return -1;
-    return (int) strtol(s.substr(off, 2).c_str(), nullptr, 16);
-  };
+void ELM327BLEHub::on_vehicle_info(int index, const std::string &value) {
+  if (index >= (int) this->info_text_sensors_.size() || this->info_text_sensors_[index] == nullptr)
+    return;
+  this->info_text_sensors_[index]->publish_state(value);
+}
 
-  int pid = hex_byte(data, 2);
-  int a = hex_byte(data, 4);
-  int b = (data.length() >= 8) ? hex_byte(data, 6) : 0;
+void ELM327BLEHub::on_response(const ELM327Response &response) {
+  // Debug: Raw Text Sensor
+  if (this->raw_text_sensor_ == nullptr)
+    return;
+  if (this->raw_text_sensor_->has_state() && this->raw_text_sensor_->state == response.raw)
+    return;
+  this->raw_text_sensor_->publish_state(response.raw);
+}
 
-  if (pid < 0 || a < 0) return;
+void ELM327BLEHub::on_ready() {
+  if (this->connected_binary_sensor_ != nullptr)
+    this->connected_binary_sensor_->publish_state(true);
+  this->publish_adapter();
+}
 
-  sensor::Sensor *sensor = this->find_sensor_for_pid(pid);
-  if (sensor == nullptr) {
-    ESP_LOGD(TAG, "Kein Sensor fuer PID 0x%02X registriert", pid);
+void ELM327BLEHub::publish_adapter() {
+  const AdapterInfo &adapter = this->protocol_.get_adapter_info();
+  if (this->adapter_text_sensor_ == nullptr || !adapter.known)
     return;
-  }
+  if (this->adapter_text_sensor_->has_state() && this->adapter_text_sensor_->state == adapter.id)
+    return;
+  this->adapter_text_sensor_->publish_state(adapter.id);
+}
 
-  float value = 0;
-  switch (pid) {
-    case 0x04:  // Motorlast: A*100/255
-      value = (a * 100.0f) / 255.0f;
-      break;
-    case 0x05:  // Kühlmitteltemperatur: A - 40
-      value = a - 40.0f;
-      break;
-    case 0x0B:  // MAP: A
-      value = a;
-      break;
-    case 0x0C:  // Drehzahl: ((A*256)+B)/4
-      value = ((a * 256) + b) / 4.0f;
-      break;
-    case 0x0D:  // Geschwindigkeit: A
-      value = a;
-      break;
-    case 0x0F:  // Ansauglufttemperatur: A - 40
-      value = a - 40.0f;
-      break;
-    case 0x10:  // MAF: ((A*256)+B)/100
-      value = ((a * 256) + b) / 100.0f;
-      break;
-    case 0x11:  // Drosselklappe: A*100/255
-      value = (a * 100.0f) / 255.0f;
-      break;
-    case 0x1F:  // Motorlaufzeit: (A*256)+B
-      value = (a * 256) + b;
-      break;
-    case 0x2E:  // AGR: A*100/255
-      value = (a * 100.0f) / 255.0f;
-      break;
-    case 0x2F:  // Kraftstoffstand: A*100/255
-      value = (a * 100.0f) / 255.0f;
-      break;
-    case 0x33:  // Barometrischer Druck: A
-      value = a;
-      break;
-    case 0x42:  // ECU Spannung: ((A*256)+B)/1000
-      value = ((a * 256) + b) / 1000.0f;
-      break;
-    case 0x46:  // Umgebungstemperatur: A - 40
-      value = a - 40.0f;
-      break;
-    case 0x5C:  // Öltemperatur: A - 40
-      value = a - 40.0f;
-      break;
-    case 0x5E:  // Kraftstoffverbrauch: ((A*256)+B)/20
-      value = ((a * 256) + b) / 20.0f;
-      break;
-    default:
-      // Generische Formel: einfach A zurückgeben
-      value = a;
-      ESP_LOGD(TAG, "PID 0x%02X: generisch A=%d", pid, a);
-      break;
+void ELM327BLEHub::on_engine_running(bool running) {
+  // Kommt mit jedem Drehzahlwert, Fahrt und Datenlog werden nur einmal beim Abstellen gesichert
+  if (this->engine_running_ && !running) {
+    this->save_trip();
+#ifdef USE_ELM327_DATA_LOG
+    this->data_log_.flush(true, 1);
+#endif
   }
+  this->engine_running_ = running;
+  if (this->engine_running_binary_sensor_ == nullptr)
+    return;
+  if (this->engine_running_binary_sensor_->has_state() && this->engine_running_binary_sensor_->state == running)
+    return;
+  this->engine_running_binary_sensor_->publish_state(running);
+}
 
-  sensor->publish_state(value);
-  ESP_LOGD(TAG, "PID 0x%02X = %.2f", pid, value);
+void ELM327BLEHub::on_session_info() {
+  this->save_session_cache();
+  this->publish_adapter();
+}
 
-  // Motor-Lauf-Status aktualisieren (basierend auf RPM)
-  if (pid == 0x0C && this->engine_running_binary_sensor_ != nullptr) {
-    this->engine_running_binary_sensor_->publish_state(value > 0);
-  }
+void ELM327BLEHub::on_pid_unsupported(int channel) {
+  if (channel < (int) this->channels_.size() && this->channels_[channel].sensor != nullptr)
+    ESP_LOGW(TAG, "Sensor '%s' deaktiviert: PID vom Fahrzeug nicht unterstuetzt",
+             this->channels_[channel].sensor->get_name().c_str());
 }
 
 // ============================================================
-// DTC Parsing
+// Diagnose-Sensoren
 // ============================================================
-void ELM327BLEHub::parse_dtc_response(const std::string &clean) {
-  if (this->dtc_text_sensor_ == nullptr) return;
-
-  size_t dpos = clean.find("43");
-  if (dpos == std::string::npos) return;
-
-  std::string dtc_data = clean.substr(dpos);
-  std::string dtc_list;
-  int dtc_count = 0;
-
-  // DTCs starten ab Position 2 (nach "43"), je 4 Hex-Zeichen = 2 Bytes
-  for (size_t i = 2; i + 3 < dtc_data.length(); i += 4) {
-    std::string dtc_raw = dtc_data.substr(i, 4);
-    if (dtc_raw == "0000") continue;
-
-    std::string dtc_code = this->decode_dtc(dtc_raw);
-    if (!dtc_list.empty()) dtc_list += ", ";
-    dtc_list += dtc_code;
-    dtc_count++;
-  }
+void ELM327BLEHub::publish_stats() {
+  uint32_t now = millis();
+  float window_s = (now - this->stats_window_start_) / 1000.0f;
+  const auto &entries = this->protocol_.entries();
+  for (auto &stat : this->stats_sensors_) {
+    const RequestStats *stats = &this->protocol_.get_stats();
+    if (stat.pid >= 0) {
+      stats = nullptr;
+      for (auto &entry : entries) {
+        if (!entry.config.is_at_command && !entry.config.is_can_signal && entry.config.pid == stat.pid) {
+          stats = &entry.stats;
+          break;
+        }
+      }
+      if (stats == nullptr) {
+        ESP_LOGW(TAG, "Sensor '%s': PID 0x%02X wird nicht abgefragt", stat.sensor->get_name().c_str(), stat.pid);
+        continue;
+      }
+    }
 
-  if (dtc_count == 0) {
-    this->dtc_text_sensor_->publish_state("Keine Fehler");
-  } else {
-    this->dtc_text_sensor_->publish_state(dtc_list);
+    float value = NAN;
+    switch (stat.type) {
+      case STAT_LATENCY_MIN:
+        value = stats->latency.count > 0 ? stats->latency.min : NAN;
+        break;
+      case STAT_LATENCY_AVG:
+        value = stats->latency.average();
+        break;
+      case STAT_LATENCY_P95:
+        value = stats->latency.percentile(95);
+        break;
+      case STAT_RESPONSE_RATE:
+        value = window_s > 0 ? stats->responses / window_s : NAN;
+        break;
+      case STAT_TIMEOUTS:
+        value = stats->timeouts;
+        break;
+      case STAT_NO_DATA:
+        value = stats->no_data;
+        break;
+      case STAT_ERRORS:
+        value = stats->errors;
+        break;
+      case STAT_WRITE_FAILURES:
+        value = this->protocol_.get_write_failures();
+        break;
+      case STAT_RECONNECTS:
+        value = this->reconnects_;
+        break;
+      case STAT_CONNECTION_INTERVAL:
+        value = this->conn_interval_ != 0 ? this->conn_interval_ * 1.25f : NAN;
+        break;
+      case STAT_ADAPTER_TIMEOUT:
+        value = this->protocol_.get_adapter_timeout();
+        break;
+    }
+    stat.sensor->publish_state(value);
   }
-  ESP_LOGD(TAG, "DTCs (%d): %s", dtc_count, dtc_list.c_str());
-}
 
-std::string ELM327BLEHub::decode_dtc(const std::string &raw) {
-  if (raw.length() < 4) return "????";
-
-  char first = raw[0];
-  char prefix;
-  switch (first) {
-    case '0': case '1': case '2': case '3': prefix = 'P'; break;
-    case '4': case '5': prefix = 'C'; break;
-    case '6': case '7': prefix = 'B'; break;
-    case '8': case '9': case 'A': case 'B': prefix = 'U'; break;
-    default: prefix = 'P'; break;
+  // Übersicht pro Eintrag für die Feinabstimmung von Intervallen und Timeouts
+  for (auto &entry : entries) {
+    if (entry.stats.latency.count == 0 && entry.stats.timeouts == 0)
+      continue;
+    std::string cmd = entry.config.command.substr(0, entry.config.command.find('\r'));
+    ESP_LOGD(TAG, "Statistik %s: %u Antworten, Latenz avg %.0f ms, p95 %.0f ms, max %u ms, Timeouts %u, NO DATA %u",
+             cmd.c_str(), (unsigned) entry.stats.responses, entry.stats.latency.average(),
+             entry.stats.latency.percentile(95), (unsigned) entry.stats.latency.max, (unsigned) entry.stats.timeouts,
+             (unsigned) entry.stats.no_data);
   }
 
-  char second = '0' + (((first >= 'A' ? first - 'A' + 10 : first - '0') % 4));
-
-  std::string result;
-  result += prefix;
-  result += second;
-  result += raw.substr(1, 3);
-  return result;
+  this->protocol_.reset_stats_window();
+  this->stats_window_start_ = now;
 }
 
 // ============================================================
-// Batteriespannung (ATRV)
+// Schnellstart-Cache
 // ============================================================
-void ELM327BLEHub::parse_voltage_response(const std::string &clean) {
-  sensor::Sensor *sensor = this->find_at_sensor("ATRV\r");
-  if (sensor == nullptr) return;
-
-  std::string volt_str;
-  for (char c : clean) {
-    if ((c >= '0' && c <= '9') || c == '.') {
-      volt_str += c;
-    }
+void ELM327BLEHub::register_notify() {
+  auto status = esp_ble_gattc_register_for_notify(
+      this->parent()->get_gattc_if(), this->parent()->get_remote_bda(), this->char_rx_handle_);
+  if (status != ESP_OK) {
+    ESP_LOGW(TAG, "BLE: Notify-Registrierung fehlgeschlagen: %d", status);
   }
+}
 
-  if (!volt_str.empty()) {
-    float voltage = atof(volt_str.c_str());
-    if (voltage > 0 && voltage < 20) {
-      sensor->publish_state(voltage);
-      ESP_LOGD(TAG, "Batterie: %.1f V", voltage);
-    }
+void ELM327BLEHub::save_session_cache() {
+  if (!this->fast_reconnect_ || !this->handles_resolved_ || this->cached_handles_)
+    return;
+
+  // Feldweise füllen, damit Füllbytes null bleiben und memcmp() aussagekräftig ist
+  ELM327SessionCache cache{};
+  const SupportedPIDs &supported = this->protocol_.get_supported_pids();
+  memcpy(cache.supported_pids.bitmap, supported.bitmap, sizeof(supported.bitmap));
+  cache.supported_pids.known = supported.known;
+  cache.tx_handle = this->char_tx_handle_;
+  cache.rx_handle = this->char_rx_handle_;
+  cache.cccd_handle = this->cccd_handle_;
+  cache.protocol = this->protocol_.get_protocol();
+  cache.flags = this->write_no_rsp_ ? SESSION_FLAG_WRITE_NR : 0;
+  const AdapterInfo &adapter = this->protocol_.get_adapter_info();
+  if (adapter.known) {
+    cache.flags |= SESSION_FLAG_ADAPTER_KNOWN;
+    cache.flags |= adapter.response_count ? SESSION_FLAG_RESPONSE_COUNT : 0;
+    cache.flags |= adapter.stpx ? SESSION_FLAG_STPX : 0;
+    strncpy(cache.adapter, adapter.id.c_str(), sizeof(cache.adapter) - 1);
   }
+  // Flash nur bei Änderungen beschreiben
+  if (memcmp(&cache, &this->cache_, sizeof(cache)) == 0)
+    return;
+  this->cache_ = cache;
+  this->pref_.save(&this->cache_);
+  ESP_LOGD(TAG, "Verbindungsdaten gespeichert (Protokoll %c)", cache.protocol ? cache.protocol : '-');
 }
 
 // ============================================================
 // Sensor-Registrierung
 // ============================================================
-void ELM327BLEHub::register_pid_sensor(sensor::Sensor *sensor, uint8_t mode, uint8_t pid) {
-  PIDSensorEntry entry;
-  entry.sensor = sensor;
-  entry.config.mode = mode;
-  entry.config.pid = pid;
-  entry.config.is_at_command = false;
-  // Befehl generieren: z.B. mode=0x01 pid=0x05 → "0105\r"
-  char cmd[8];
-  snprintf(cmd, sizeof(cmd), "%02X%02X\r", mode, pid);
-  entry.config.command = cmd;
-  this->pid_sensors_.push_back(entry);
-  ESP_LOGD(TAG, "PID Sensor registriert: Mode 0x%02X PID 0x%02X → %s", mode, pid, cmd);
-}
-
-void ELM327BLEHub::register_at_sensor(sensor::Sensor *sensor, const std::string &command) {
-  PIDSensorEntry entry;
-  entry.sensor = sensor;
-  entry.config.mode = 0;
-  entry.config.pid = 0;
-  entry.config.is_at_command = true;
-  entry.config.command = command;
-  this->pid_sensors_.push_back(entry);
-  ESP_LOGD(TAG, "AT Sensor registriert: %s", command.c_str());
-}
-
-void ELM327BLEHub::register_dtc_text_sensor(text_sensor::TextSensor *sensor) {
+void ELM327BLEHub::register_pid_sensor(sensor::Sensor *sensor, uint8_t mode, uint8_t pid, uint32_t update_interval,
+                                       uint8_t priority) {
+  this->add_channel_sensor(this->protocol_.add_pid(mode, pid, update_interval, priority), sensor);
+}
+
+void ELM327BLEHub::register_pid_sensor(sensor::Sensor *sensor, uint8_t mode, uint16_t pid, uint32_t update_interval,
+                                       uint8_t priority, uint8_t length, float scale, float offset) {
+  this->add_channel_sensor(
+      this->protocol_.add_pid(mode, pid, update_interval, priority, length, scale, offset), sensor);
+}
+
+void ELM327BLEHub::register_at_sensor(sensor::Sensor *sensor, const std::string &command, uint32_t update_interval,
+                                      uint8_t priority) {
+  this->add_channel_sensor(this->protocol_.add_at_command(command, update_interval, priority), sensor);
+}
+
+void ELM327BLEHub::register_can_sensor(sensor::Sensor *sensor, uint32_t can_id, uint8_t start_byte, uint8_t length,
+                                       float scale, float offset) {
+  this->add_channel_sensor(this->protocol_.add_can_signal(can_id, start_byte, length, scale, offset), sensor);
+}
+
+void ELM327BLEHub::register_dtc_text_sensor(text_sensor::TextSensor *sensor, uint32_t update_interval) {
   this->dtc_text_sensor_ = sensor;
+  this->protocol_.enable_dtc(update_interval);
 }
 
 void ELM327BLEHub::register_raw_text_sensor(text_sensor::TextSensor *sensor) {
   this->raw_text_sensor_ = sensor;
 }
 
+void ELM327BLEHub::register_vehicle_info_text_sensor(text_sensor::TextSensor *sensor, uint8_t pid) {
+  int index = this->protocol_.enable_vehicle_info(pid);
+  if (index >= (int) this->info_text_sensors_.size())
+    this->info_text_sensors_.resize(index + 1, nullptr);
+  this->info_text_sensors_[index] = sensor;
+}
+
 void ELM327BLEHub::register_connected_binary_sensor(binary_sensor::BinarySensor *sensor) {
   this->connected_binary_sensor_ = sensor;
 }
@@ -512,25 +916,74 @@ void ELM327BLEHub::register_engine_running_binary_sensor(binary_sensor::BinarySe
   this->engine_running_binary_sensor_ = sensor;
 }
 
-// ============================================================
-// Sensor Lookup
-// ============================================================
-sensor::Sensor *ELM327BLEHub::find_sensor_for_pid(uint8_t pid) {
-  for (auto &entry : this->pid_sensors_) {
-    if (!entry.config.is_at_command && entry.config.pid == pid) {
-      return entry.sensor;
-    }
+void ELM327BLEHub::register_stats_sensor(sensor::Sensor *sensor, StatType type, int pid) {
+  this->stats_sensors_.push_back({sensor, type, pid});
+}
+
+void ELM327BLEHub::set_publish_filter(sensor::Sensor *sensor, float deadband, bool percent, uint32_t heartbeat) {
+  for (auto &channel : this->channels_) {
+    if (channel.sensor != sensor)
+      continue;
+    channel.deadband = deadband;
+    channel.deadband_percent = percent;
+    channel.heartbeat = heartbeat;
   }
-  return nullptr;
 }
 
-sensor::Sensor *ELM327BLEHub::find_at_sensor(const std::string &command) {
-  for (auto &entry : this->pid_sensors_) {
-    if (entry.config.is_at_command && entry.config.command == command) {
-      return entry.sensor;
-    }
+void ELM327BLEHub::set_request_header(sensor::Sensor *sensor, const std::string &header) {
+  for (size_t i = 0; i < this->channels_.size(); i++) {
+    if (this->channels_[i].sensor == sensor)
+      this->protocol_.set_header(i, header);
+  }
+}
+
+void ELM327BLEHub::set_response_ecu(sensor::Sensor *sensor, uint32_t ecu) {
+  for (size_t i = 0; i < this->channels_.size(); i++) {
+    if (this->channels_[i].sensor == sensor)
+      this->protocol_.set_ecu(i, ecu);
   }
-  return nullptr;
+}
+
+void ELM327BLEHub::set_value_formula(sensor::Sensor *sensor, PIDValueFn formula) {
+  for (size_t i = 0; i < this->channels_.size(); i++) {
+    if (this->channels_[i].sensor == sensor)
+      this->protocol_.set_formula(i, formula);
+  }
+}
+
+void ELM327BLEHub::register_trip_sensor(sensor::Sensor *sensor, TripValue type) {
+  this->trip_sensors_.push_back({sensor, type});
+  this->protocol_.trip().set_enabled(true);
+}
+
+void ELM327BLEHub::reset_trip() {
+  ESP_LOGI(TAG, "Neue Fahrt");
+  this->protocol_.trip().reset();
+  this->trip_published_at_ = 0;  // sofort zeigen
+  this->publish_trip(millis());
+  this->save_trip();
+}
+
+void ELM327BLEHub::queue_command(const std::string &command, uint8_t priority, const std::string &header) {
+  // Abgelehnt (ungültig, nicht verbunden, Warteschlange voll): Trigger sofort ohne Erfolg
+  if (!this->protocol_.queue_command(command, priority, header))
+    this->command_callback_.call(command, "", false);
+}
+
+void ELM327BLEHub::on_command_result(const std::string &command, const ELM327Response *response) {
+  if (response == nullptr) {
+    ESP_LOGW(TAG, "Befehl %s: keine Antwort", command.c_str());
+    this->command_callback_.call(command, "", false);
+    return;
+  }
+  ESP_LOGI(TAG, "Befehl %s: %s", command.c_str(), response->raw);
+  this->command_callback_.call(command, response->raw, response->status == RESPONSE_OK);
+}
+
+void ELM327BLEHub::add_channel_sensor(int channel, sensor::Sensor *sensor) {
+  if ((int) this->channels_.size() <= channel)
+    this->channels_.resize(channel + 1);
+  this->channels_[channel].sensor = sensor;
 }
 
 }  // namespace elm327_ble
@@ -1,35 +1,87 @@
 #pragma once
 
 #include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
 #include "esphome/components/ble_client/ble_client.h"
 #include "esphome/components/esp32_ble_tracker/esp32_ble_tracker.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/text_sensor/text_sensor.h"
 #include "esphome/components/binary_sensor/binary_sensor.h"
+#include "elm327_protocol.h"
+#include "elm327_data_log_esp32.h"
+#include "elm327_trace.h"
 
+#ifdef USE_TIME
+#include "esphome/components/time/real_time_clock.h"
+#endif
+
+#include <functional>
 #include <string>
 #include <vector>
-#include <map>
-#include <functional>
 
 namespace esphome {
 namespace elm327_ble {
 
-// Vordefinierte OBD2 PID-Konfigurationen
-struct OBD2PIDConfig {
-  uint8_t mode;
-  uint8_t pid;
-  std::string command;  // z.B. "0105\r" oder "ATRV\r"
-  bool is_at_command;   // true für AT-Befehle wie ATRV
+// Im NVS gespeicherte Verbindungsdaten für den Schnellstart nach einem Reconnect
+struct ELM327SessionCache {
+  SupportedPIDs supported_pids;  // Bitmaps aus 0100, 0120, ...
+  uint16_t tx_handle;
+  uint16_t rx_handle;
+  uint16_t cccd_handle;     // Client Characteristic Configuration der RX Characteristic
+  char protocol;            // ATDPN-Protokollnummer, 0 = unbekannt
+  uint8_t flags;            // SESSION_FLAG_*
+  char adapter[24];         // Kennung aus ATI bzw. STI
+};
+
+// TX Characteristic erlaubt Write Without Response
+static const uint8_t SESSION_FLAG_WRITE_NR = 1 << 0;
+// Fähigkeiten des Adapters (AdapterInfo), ATI/STI entfallen beim Schnellstart
+static const uint8_t SESSION_FLAG_ADAPTER_KNOWN = 1 << 1;
+static const uint8_t SESSION_FLAG_RESPONSE_COUNT = 1 << 2;
+static const uint8_t SESSION_FLAG_STPX = 1 << 3;
+
+// Im NVS gespeicherter Zustand des Datenloggers
+struct DataLogState {
+  uint32_t first_sequence;  // ältere Blöcke wurden per clear_data_log() verworfen
+  uint16_t boot;            // Boot-Zähler für die Blockköpfe
 };
 
-// Ein registrierter PID-Sensor
-struct PIDSensorEntry {
-  sensor::Sensor *sensor;
-  OBD2PIDConfig config;
+// Kennzahlen für Diagnose-Sensoren (sensor.py: STAT_TYPES)
+enum StatType : uint8_t {
+  STAT_LATENCY_MIN,
+  STAT_LATENCY_AVG,
+  STAT_LATENCY_P95,
+  STAT_RESPONSE_RATE,
+  STAT_TIMEOUTS,
+  STAT_NO_DATA,
+  STAT_ERRORS,
+  STAT_WRITE_FAILURES,
+  STAT_RECONNECTS,
+  STAT_CONNECTION_INTERVAL,
+  STAT_ADAPTER_TIMEOUT,
 };
 
-class ELM327BLEHub : public Component, public ble_client::BLEClientNode {
+// Ausgabe eines Kanals an seinen Sensor. Werte einer Antwort werden gesammelt
+// und danach gemeinsam veröffentlicht, unveränderte Werte (Deadband) nur per Heartbeat.
+struct ChannelOutput {
+  sensor::Sensor *sensor{nullptr};
+  float deadband{0.0f};          // Mindeständerung, absolut oder als Anteil (deadband_percent)
+  bool deadband_percent{false};
+  uint32_t heartbeat{0};         // spätestens nach dieser Zeit erneut senden, 0 = aus
+  float value{NAN};              // zuletzt empfangen
+  bool pending{false};           // empfangen, aber noch nicht geprüft
+  float published{NAN};          // zuletzt veröffentlicht
+  uint32_t published_at{0};
+};
+
+// ESPHome-Anbindung: BLE als Transport für den ELM327Protocol-Kern,
+// dekodierte Werte gehen an die registrierten Sensoren.
+class ELM327BLEHub : public Component,
+                     public ble_client::BLEClientNode,
+                     public ELM327Transport,
+                     public ELM327Listener {
  public:
   void setup() override;
   void loop() override;
@@ -38,21 +90,122 @@ class ELM327BLEHub : public Component, public ble_client::BLEClientNode {
 
   void gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if,
                            esp_ble_gattc_cb_param_t *param) override;
+  void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) override;
 
   // Setters (aufgerufen vom Python-Codegen)
   void set_service_uuid(const std::string &uuid) { this->service_uuid_str_ = uuid; }
   void set_char_tx_uuid(const std::string &uuid) { this->char_tx_uuid_str_ = uuid; }
   void set_char_rx_uuid(const std::string &uuid) { this->char_rx_uuid_str_ = uuid; }
-  void set_request_interval(uint32_t interval_ms) { this->request_interval_ = interval_ms; }
-  void set_request_timeout(uint32_t timeout_ms) { this->request_timeout_ = timeout_ms; }
+  void set_request_interval(uint32_t interval_ms) { this->protocol_.set_request_interval(interval_ms); }
+  void set_request_timeout(uint32_t timeout_ms) { this->protocol_.set_request_timeout(timeout_ms); }
+  void set_adaptive_timing(bool adaptive) { this->protocol_.set_adaptive_timing(adaptive); }
+  void set_batch_pids(bool batch) { this->protocol_.set_batch_pids(batch); }
+  void set_max_throughput(bool enabled) { this->protocol_.set_max_throughput(enabled); }
+  void set_headers(bool enabled) { this->protocol_.set_headers(enabled); }
+  void set_fast_reconnect(bool fast_reconnect) { this->fast_reconnect_ = fast_reconnect; }
+  void set_stats_interval(uint32_t interval_ms) { this->stats_interval_ = interval_ms; }
+  void set_monitor_duration(uint32_t duration_ms) { this->protocol_.set_monitor_duration(duration_ms); }
+  void set_mtu(uint16_t mtu) { this->mtu_ = mtu; }
+  void set_write_without_response(bool enabled) { this->write_without_response_ = enabled; }
+  // Größe des Mitschnitts in Bytes, 0 = aus
+  void set_trace_size(uint32_t size) { this->trace_size_ = size; }
+  // Verbindungsintervalle in 1,25 ms, Supervision Timeout in 10 ms (Einheiten der BLE-Spezifikation)
+  void set_connection_parameters(uint16_t active_interval, uint16_t idle_interval, uint16_t idle_latency,
+                                 uint16_t timeout) {
+    this->conn_params_enabled_ = true;
+    this->active_interval_ = active_interval;
+    this->idle_interval_ = idle_interval;
+    this->idle_latency_ = idle_latency;
+    this->supervision_timeout_ = timeout;
+  }
+  void set_trip_computer(float air_fuel_ratio, float fuel_density, bool reset_on_engine_start) {
+    this->protocol_.trip().set_air_fuel_ratio(air_fuel_ratio);
+    this->protocol_.trip().set_fuel_density(fuel_density);
+    this->protocol_.trip().set_reset_on_engine_start(reset_on_engine_start);
+  }
+  void set_polling_profiles(uint32_t engine_off_delay, float running_voltage, uint32_t parked_interval,
+                            uint32_t sleep_after, uint32_t wake_interval) {
+    PowerProfileConfig config;
+    config.enabled = true;
+    config.engine_off_delay = engine_off_delay;
+    config.running_voltage = running_voltage;
+    config.parked_interval = parked_interval;
+    config.sleep_after = sleep_after;
+    config.wake_interval = wake_interval;
+    this->protocol_.set_power_profiles(config);
+  }
+
+#ifdef USE_ELM327_DATA_LOG
+  void set_data_log(uint32_t buffer_size, const std::string &partition, uint32_t min_interval,
+                    uint32_t flush_interval, uint16_t port) {
+    this->log_buffer_size_ = buffer_size;
+    this->log_partition_ = partition;
+    this->log_min_interval_ = min_interval;
+    this->log_flush_interval_ = flush_interval;
+    this->log_server_.set_port(port);
+  }
+#ifdef USE_TIME
+  void set_data_log_time(time::RealTimeClock *time) { this->log_time_ = time; }
+#endif
+  // Alle gespeicherten Werte verwerfen, z.B. nach dem Download aus einem Button-Lambda
+  void clear_data_log();
+#endif
 
   // Sensoren registrieren
-  void register_pid_sensor(sensor::Sensor *sensor, uint8_t mode, uint8_t pid);
-  void register_at_sensor(sensor::Sensor *sensor, const std::string &command);
-  void register_dtc_text_sensor(text_sensor::TextSensor *sensor);
+  void register_pid_sensor(sensor::Sensor *sensor, uint8_t mode, uint8_t pid, uint32_t update_interval = 0,
+                           uint8_t priority = 0);
+  // Mode 0x22: pid ist die 16-Bit-DID
+  void register_pid_sensor(sensor::Sensor *sensor, uint8_t mode, uint16_t pid, uint32_t update_interval,
+                           uint8_t priority, uint8_t length, float scale, float offset);
+  void register_at_sensor(sensor::Sensor *sensor, const std::string &command, uint32_t update_interval = 0,
+                          uint8_t priority = 0);
+  void register_can_sensor(sensor::Sensor *sensor, uint32_t can_id, uint8_t start_byte, uint8_t length, float scale,
+                           float offset);
+  void register_dtc_text_sensor(text_sensor::TextSensor *sensor, uint32_t update_interval = 0);
   void register_raw_text_sensor(text_sensor::TextSensor *sensor);
+  // Adapter-Kennung aus ATI/STI, z.B. "ELM327 v1.5" oder "STN2120 v5.6.5"
+  void register_adapter_text_sensor(text_sensor::TextSensor *sensor) { this->adapter_text_sensor_ = sensor; }
+  // Mode-09-Info (0x02 = VIN, 0x04 = Kalibrierungs-ID), wird einmal gelesen
+  void register_vehicle_info_text_sensor(text_sensor::TextSensor *sensor, uint8_t pid);
   void register_connected_binary_sensor(binary_sensor::BinarySensor *sensor);
   void register_engine_running_binary_sensor(binary_sensor::BinarySensor *sensor);
+  // pid = -1: alle Anfragen, sonst nur die Abfragen dieses PIDs
+  void register_stats_sensor(sensor::Sensor *sensor, StatType type, int pid = -1);
+  // Abgeleiteter Fahrtwert (Strecke, Verbrauch, ...), schaltet den Bordcomputer ein
+  void register_trip_sensor(sensor::Sensor *sensor, TripValue type);
+  // Neue Fahrt beginnen, z.B. aus einem Button-Lambda
+  void reset_trip();
+  // Mitschnitt als Hex ins Log schreiben (Aktion elm327_ble.dump_trace), auszuwerten mit
+  // host/elm327_tracedump. Der Ring zeichnet währenddessen weiter auf.
+  void dump_trace();
+  // Einmaliger Befehl vor der regulären Abfrage (Aktionen elm327_ble.send_command usw.),
+  // das Ergebnis geht an die on_command_response-Trigger
+  void queue_command(const std::string &command, uint8_t priority = 0, const std::string &header = "");
+  // command, bereinigte Antwort (leer ohne Antwort), success
+  void add_on_command_response_callback(std::function<void(std::string, std::string, bool)> &&callback) {
+    this->command_callback_.add(std::move(callback));
+  }
+  // Nach register_pid_sensor()/register_at_sensor(): nur Änderungen > deadband senden
+  void set_publish_filter(sensor::Sensor *sensor, float deadband, bool percent, uint32_t heartbeat);
+  // Nach register_pid_sensor(): Anfrage per ATSH an ein Steuergerät, Umrechnung aus dem Codegen
+  void set_request_header(sensor::Sensor *sensor, const std::string &header);
+  // Nach set_request_header(): nur Antworten dieses Steuergeräts (z.B. 0x7E9) verwenden
+  void set_response_ecu(sensor::Sensor *sensor, uint32_t ecu);
+  void set_value_formula(sensor::Sensor *sensor, PIDValueFn formula);
+
+  // ELM327Transport
+  bool write(const uint8_t *data, size_t len) override;
+
+  // ELM327Listener
+  void on_value(int channel, float value) override;
+  void on_dtc(const std::string &codes) override;
+  void on_response(const ELM327Response &response) override;
+  void on_ready() override;
+  void on_engine_running(bool running) override;
+  void on_session_info() override;
+  void on_pid_unsupported(int channel) override;
+  void on_vehicle_info(int index, const std::string &value) override;
+  void on_command_result(const std::string &command, const ELM327Response *response) override;
 
  protected:
   // BLE UUIDs
@@ -63,56 +216,128 @@ class ELM327BLEHub : public Component, public ble_client::BLEClientNode {
   // BLE Handles
   uint16_t char_tx_handle_{0};
   uint16_t char_rx_handle_{0};
+  uint16_t cccd_handle_{0};
   bool handles_resolved_{false};
+  bool cached_handles_{false};  // Handles aus dem Cache, Service Discovery steht noch aus
 
-  // ELM327 State Machine
-  enum State {
-    STATE_IDLE,
-    STATE_CONNECTED,
-    STATE_INITIALIZING,
-    STATE_READY,
-    STATE_REQUESTING,
-    STATE_WAITING_RESPONSE,
-  };
-  State state_{STATE_IDLE};
+  // BLE-Übertragung
+  uint16_t mtu_{247};                   // angefragte MTU, 23 = Standard beibehalten
+  uint16_t negotiated_mtu_{23};
+  bool write_without_response_{true};   // nutzen, wenn die TX Characteristic es erlaubt
+  bool write_no_rsp_{false};            // aktuelle Verbindung schreibt ohne Quittung
+  bool write_in_flight_{false};         // Quittung (ESP_GATTC_WRITE_CHAR_EVT) steht noch aus
+  uint32_t write_started_{0};
+  uint8_t queued_write_[ELM327Protocol::MAX_WRITE_LENGTH];  // Befehl, der auf die Quittung des vorigen wartet
+  uint8_t queued_write_len_{0};
+
+  // Verbindungsparameter: kurzes Intervall beim Abfragen, langes mit Slave Latency im Stand
+  enum ConnectionMode : uint8_t { CONNECTION_DEFAULT, CONNECTION_ACTIVE, CONNECTION_IDLE };
+  bool conn_params_enabled_{false};
+  uint16_t active_interval_{12};        // 15 ms
+  uint16_t idle_interval_{400};         // 500 ms
+  uint16_t idle_latency_{4};
+  uint16_t supervision_timeout_{600};   // 6 s
+  ConnectionMode conn_mode_{CONNECTION_DEFAULT};  // zuletzt angefragt
+  uint32_t conn_requested_at_{0};
+  bool conn_update_pending_{false};     // ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT steht noch aus
+  uint16_t conn_interval_{0};           // aktuelles Intervall in 1,25 ms, 0 = nicht verbunden
+  uint16_t conn_latency_{0};
+  static const uint32_t CONN_UPDATE_TIMEOUT_MS = 5000;
 
-  // Initialisierung
-  int init_step_{0};
-  static const int INIT_STEPS_COUNT = 7;
-  uint32_t last_init_time_{0};
+  // Schnellstart-Cache (NVS)
+  bool fast_reconnect_{true};
+  ESPPreferenceObject pref_;
+  ELM327SessionCache cache_{};
 
-  // PID-Abfragezyklus
-  std::vector<PIDSensorEntry> pid_sensors_;
-  int current_pid_index_{0};
-  uint32_t request_interval_{2000};
-  uint32_t request_timeout_{5000};
-  uint32_t last_request_time_{0};
-  bool waiting_for_response_{false};
+  // ELM327-Protokoll (Init, Scheduler, Parser)
+  ELM327Protocol protocol_;
 
-  // Antwort-Puffer
-  std::string response_buffer_;
+  // Sensor pro Protokoll-Kanal
+  std::vector<ChannelOutput> channels_;
+  bool values_pending_{false};
 
   // Text-Sensoren
   text_sensor::TextSensor *dtc_text_sensor_{nullptr};
   text_sensor::TextSensor *raw_text_sensor_{nullptr};
+  text_sensor::TextSensor *adapter_text_sensor_{nullptr};
+  std::vector<text_sensor::TextSensor *> info_text_sensors_;  // Index wie ELM327Protocol::get_vehicle_info()
 
   // Binary-Sensoren
   binary_sensor::BinarySensor *connected_binary_sensor_{nullptr};
   binary_sensor::BinarySensor *engine_running_binary_sensor_{nullptr};
 
-  // Methoden
-  void send_command(const std::string &cmd);
-  void run_init_sequence();
-  void request_next_pid();
-  void process_response(const std::string &response);
-  void parse_obd2_response(const std::string &clean);
-  void parse_dtc_response(const std::string &clean);
-  void parse_voltage_response(const std::string &clean);
-  std::string decode_dtc(const std::string &raw);
-
-  // Sensor-Lookup
-  sensor::Sensor *find_sensor_for_pid(uint8_t pid);
-  sensor::Sensor *find_at_sensor(const std::string &command);
+  // Diagnose-Sensoren, alle stats_interval_ ms veröffentlicht
+  struct StatsSensor {
+    sensor::Sensor *sensor;
+    StatType type;
+    int pid;
+  };
+  std::vector<StatsSensor> stats_sensors_;
+  uint32_t stats_interval_{60000};
+  uint32_t stats_window_start_{0};
+  uint32_t reconnects_{0};
+  bool connected_before_{false};
+
+  // Bordcomputer: höchstens einmal pro TRIP_PUBLISH_MS veröffentlicht, Summen im NVS
+  struct TripSensor {
+    sensor::Sensor *sensor;
+    TripValue type;
+  };
+  std::vector<TripSensor> trip_sensors_;
+  ESPPreferenceObject trip_pref_;
+  uint32_t trip_published_revision_{0};
+  uint32_t trip_saved_revision_{0};
+  uint32_t trip_published_at_{0};
+  bool engine_running_{false};  // letzter Zustand aus on_engine_running(), gesichert wird beim Abstellen
+  static const uint32_t TRIP_PUBLISH_MS = 1000;
+  static const uint32_t TRIP_SAVE_MS = 60000;
+
+  CallbackManager<void(std::string, std::string, bool)> command_callback_;
+
+  // Mitschnitt (TX, RX, BLE-Ereignisse), beim Dump als Kopie zeilenweise ins Log
+  ELM327Trace trace_;
+  uint32_t trace_size_{4096};
+  uint32_t trace_timeouts_{0};          // Stand von get_stats().timeouts für TRACE_EVENT_TIMEOUT
+  std::vector<uint8_t> trace_dump_;
+  size_t trace_dump_pos_{0};
+  static const size_t TRACE_DUMP_LINE = 32;   // Bytes pro Logzeile
+  static const uint32_t TRACE_DUMP_LINES = 4;  // Zeilen pro loop(), damit der Logger mitkommt
+
+#ifdef USE_ELM327_DATA_LOG
+  // Datenlogger: RAM-Ring (PSRAM), Flash-Partition und Download per TCP
+  ELM327DataLog data_log_;
+  ELM327PartitionStorage log_storage_;
+  ELM327LogServer log_server_;
+  ESPPreferenceObject log_pref_;
+  DataLogState log_state_{};
+  uint32_t log_buffer_size_{32768};
+  std::string log_partition_;
+  uint32_t log_min_interval_{1000};   // pro Kanal höchstens ein Wert in diesem Abstand
+  uint32_t log_flush_interval_{600000};
+  std::vector<uint32_t> log_times_;   // letzter geloggter Wert pro Kanal
+  uint32_t log_clock_at_{0};
+#ifdef USE_TIME
+  time::RealTimeClock *log_time_{nullptr};
+#endif
+  static const uint32_t LOG_CLOCK_MS = 60000;
+
+  void setup_data_log();
+  void loop_data_log(uint32_t now);
+  void log_value(int channel, float value);
+#endif
+
+  void add_channel_sensor(int channel, sensor::Sensor *sensor);
+  void flush_values(uint32_t now);
+  void register_notify();
+  bool send_write(const uint8_t *data, size_t len);
+  void reset_write_state();
+  void loop_connection_params(uint32_t now);
+  void save_session_cache();
+  void publish_adapter();
+  void publish_stats();
+  void publish_trip(uint32_t now);
+  void save_trip();
+  void loop_trace_dump();
 };
 
 }  // namespace elm327_ble
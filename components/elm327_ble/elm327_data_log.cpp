@@ -0,0 +1,257 @@
+#include "elm327_data_log.h"
+#include "elm327_protocol.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace elm327_ble {
+
+static void put16(uint8_t *p, uint16_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    p[i] = value >> (8 * i);
+}
+
+static uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static bool is_log_block(const uint8_t *block) {
+  return block[0] == 'O' && block[1] == 'B' && block[2] == 'L' && block[3] == LOG_FORMAT_VERSION;
+}
+
+// ============================================================
+// Dekodieren
+// ============================================================
+bool ELM327LogBlockReader::open(const uint8_t *block) {
+  this->block_ = nullptr;
+  if (!is_log_block(block))
+    return false;
+  this->header_.sequence = get32(block + 4);
+  this->header_.boot = get16(block + 8);
+  this->header_.count = get16(block + 10);
+  this->header_.start_ms = get32(block + 12);
+  this->header_.epoch = get32(block + 16);
+  this->block_ = block;
+  this->pos_ = ELM327DataLog::HEADER_SIZE;
+  this->index_ = 0;
+  this->time_ms_ = this->header_.start_ms;
+  return true;
+}
+
+bool ELM327LogBlockReader::next(LogRecord &record) {
+  if (this->block_ == nullptr || this->index_ >= this->header_.count)
+    return false;
+  uint32_t delta = 0;
+  for (int shift = 0;; shift += 7) {
+    if (this->pos_ >= ELM327DataLog::BLOCK_SIZE || shift > 28)
+      return false;
+    uint8_t byte = this->block_[this->pos_++];
+    delta |= (uint32_t) (byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      break;
+  }
+  if (this->pos_ + 7 > ELM327DataLog::BLOCK_SIZE)
+    return false;
+  const uint8_t *p = this->block_ + this->pos_;
+  this->time_ms_ += delta;
+  record.time_ms = this->time_ms_;
+  record.source = p[0];
+  record.id = get16(p + 1);
+  uint32_t bits = get32(p + 3);
+  memcpy(&record.value, &bits, sizeof(bits));
+  this->pos_ += 7;
+  this->index_++;
+  return true;
+}
+
+// ============================================================
+// Schreiben
+// ============================================================
+void ELM327DataLog::set_buffer(uint8_t *buffer, size_t size) {
+  this->ram_ = buffer;
+  this->ram_blocks_ = buffer != nullptr && size >= 2 * BLOCK_SIZE ? size / BLOCK_SIZE : 0;
+  this->ram_tail_ = 0;
+  this->ram_count_ = 0;
+  this->open_ = false;
+}
+
+void ELM327DataLog::set_storage(ELM327LogStorage *storage) {
+  this->storage_ = storage;
+  if (storage == nullptr)
+    return;
+  // Neuester Block = höchste Sequenznummer, danach geht es weiter
+  uint32_t count = storage->block_count();
+  uint8_t header[HEADER_SIZE];
+  bool found = false;
+  uint32_t newest = 0;
+  uint32_t newest_sequence = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!storage->read(i, header, sizeof(header)) || !is_log_block(header))
+      continue;
+    uint32_t sequence = get32(header + 4);
+    if (!found || (int32_t) (sequence - newest_sequence) > 0) {
+      newest = i;
+      newest_sequence = sequence;
+      found = true;
+    }
+  }
+  this->flash_head_ = found ? (newest + 1) % count : 0;
+  if (found && (int32_t) (newest_sequence + 1 - this->sequence_) > 0)
+    this->sequence_ = newest_sequence + 1;
+}
+
+void ELM327DataLog::set_clock(uint32_t epoch, uint32_t now) {
+  this->epoch_ = epoch;
+  this->epoch_ms_ = now;
+}
+
+void ELM327DataLog::set_first_sequence(uint32_t sequence) {
+  this->first_sequence_ = sequence;
+  if ((int32_t) (sequence - this->sequence_) > 0)
+    this->sequence_ = sequence;
+}
+
+void ELM327DataLog::open_block_(uint32_t now) {
+  if (this->ram_count_ == this->ram_blocks_) {
+    // Flash fehlt oder kommt nicht hinterher: ältesten Block überschreiben
+    this->ram_tail_ = (this->ram_tail_ + 1) % this->ram_blocks_;
+    this->ram_count_--;
+    this->dropped_blocks_++;
+  }
+  uint8_t *block = this->ram_block_(this->ram_tail_ + this->ram_count_);
+  this->ram_count_++;
+  memset(block, 0xFF, BLOCK_SIZE);
+  block[0] = 'O';
+  block[1] = 'B';
+  block[2] = 'L';
+  block[3] = LOG_FORMAT_VERSION;
+  put32(block + 4, this->sequence_++);
+  put16(block + 8, this->boot_);
+  put16(block + 10, 0);
+  put32(block + 12, now);
+  put32(block + 16, this->epoch_ != 0 ? this->epoch_ + (now - this->epoch_ms_) / 1000 : 0);
+  this->used_ = HEADER_SIZE;
+  this->last_ms_ = now;
+  this->open_ = true;
+}
+
+void ELM327DataLog::add(uint8_t source, uint16_t id, float value, uint32_t now) {
+  if (this->ram_blocks_ == 0)
+    return;
+  if (!this->open_)
+    this->open_block_(now);
+
+  uint8_t *block = this->ram_block_(this->ram_tail_ + this->ram_count_ - 1);
+  uint8_t *p = block + this->used_;
+  uint32_t delta = now - this->last_ms_;
+  while (delta >= 0x80) {
+    *p++ = (delta & 0x7F) | 0x80;
+    delta >>= 7;
+  }
+  *p++ = delta;
+  *p++ = source;
+  put16(p, id);
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put32(p + 2, bits);
+  p += 6;
+
+  this->used_ = p - block;
+  this->last_ms_ = now;
+  put16(block + 10, get16(block + 10) + 1);
+  this->records_++;
+  if (this->used_ + MAX_RECORD_SIZE > BLOCK_SIZE)
+    this->open_ = false;
+}
+
+void ELM327DataLog::add_value(const OBD2PIDConfig &config, float value, uint32_t now) {
+  if (config.is_can_signal) {
+    this->add(LOG_SOURCE_CAN + config.can_byte, config.can_id, value, now);
+  } else if (config.is_at_command) {
+    uint16_t id = config.command.size() >= 4 ? (config.command[2] << 8) | config.command[3] : 0;
+    this->add(LOG_SOURCE_AT, id, value, now);
+  } else {
+    this->add(config.mode, config.pid, value, now);
+  }
+}
+
+uint32_t ELM327DataLog::flush(bool force, uint32_t max_blocks) {
+  if (this->storage_ == nullptr || this->ram_count_ == 0)
+    return 0;
+  if (force) {
+    this->open_ = false;
+    this->flushing_ = true;
+  }
+  uint32_t full = this->ram_count_ - (this->open_ ? 1 : 0);
+  // Ohne force nur ganze Sektoren, damit jeder Sektor einmal pro Umlauf gelöscht wird
+  if (full == 0 || (!this->flushing_ && full < this->flush_blocks_)) {
+    this->flushing_ = false;
+    return 0;
+  }
+
+  this->flushing_ = true;
+  uint32_t written = 0;
+  uint32_t count = this->storage_->block_count();
+  while (written < full && written < max_blocks) {
+    bool ok = this->storage_->write(this->flash_head_, this->ram_block_(this->ram_tail_));
+    // Ein fehlerhaft beschriebener Block lässt sich ohne Löschen nicht erneut schreiben
+    this->flash_head_ = (this->flash_head_ + 1) % count;
+    if (!ok) {
+      this->flash_errors_++;
+      this->flushing_ = false;
+      break;
+    }
+    this->ram_tail_ = (this->ram_tail_ + 1) % this->ram_blocks_;
+    this->ram_count_--;
+    written++;
+  }
+  if (written == full)
+    this->flushing_ = false;
+  this->flash_writes_ += written;
+  return written;
+}
+
+void ELM327DataLog::clear() {
+  this->first_sequence_ = this->sequence_;
+  if (this->ram_blocks_ > 0)
+    this->ram_tail_ = (this->ram_tail_ + this->ram_count_) % this->ram_blocks_;
+  this->ram_count_ = 0;
+  this->open_ = false;
+}
+
+// ============================================================
+// Export
+// ============================================================
+bool ELM327DataLog::valid_sequence_(const uint8_t *block) const {
+  return is_log_block(block) && (int32_t) (get32(block + 4) - this->first_sequence_) >= 0;
+}
+
+uint32_t ELM327DataLog::begin_export() {
+  this->export_flash_head_ = this->flash_head_;
+  this->export_flash_count_ = this->get_flash_blocks();
+  this->export_ram_tail_ = this->ram_tail_;
+  return this->export_flash_count_ + this->ram_count_;
+}
+
+bool ELM327DataLog::export_block(uint32_t index, uint8_t *out) {
+  if (index < this->export_flash_count_) {
+    uint32_t block = (this->export_flash_head_ + index) % this->export_flash_count_;
+    if (!this->storage_->read(block, out, BLOCK_SIZE))
+      return false;
+  } else if (this->ram_blocks_ > 0) {
+    memcpy(out, this->ram_block_(this->export_ram_tail_ + index - this->export_flash_count_), BLOCK_SIZE);
+  } else {
+    return false;
+  }
+  return this->valid_sequence_(out);
+}
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace elm327_ble {
+
+struct OBD2PIDConfig;
+
+// Herkunft eines Werts im Datenlogger, bestimmt die Bedeutung der ID.
+// OBD-Abfragen verwenden ihren Mode als Quelle (0x01 = PID, 0x22 = DID, ...).
+enum LogSource : uint8_t {
+  LOG_SOURCE_AT = 0x00,   // AT-Befehl, ID = die zwei Zeichen nach "AT" (ATRV = 'R' << 8 | 'V')
+  LOG_SOURCE_CAN = 0xC0,  // CAN-Signal, 0xC0 + Startbyte, ID = untere 16 Bit der Frame-ID
+};
+
+// Blockformat (Little Endian), BLOCK_SIZE Bytes, der ungenutzte Rest bleibt 0xFF:
+//
+//   0  "OBL" + Formatversion (LOG_FORMAT_VERSION)
+//   4  uint32 Sequenznummer, fortlaufend über alle Blöcke und Neustarts
+//   8  uint16 Boot-Zähler
+//  10  uint16 Anzahl Datensätze
+//  12  uint32 Uptime in ms beim Blockbeginn
+//  16  uint32 Unix-Zeit beim Blockbeginn, 0 = unbekannt (keine time_id)
+//  20  Datensätze: Varint Abstand in ms zum vorigen Datensatz (der erste zum
+//      Blockbeginn), uint8 Quelle (LogSource), uint16 ID, float32 Wert
+//
+// Jeder Block ist für sich dekodierbar, ein verlorener Block kostet nur seine Werte.
+static const uint8_t LOG_FORMAT_VERSION = 1;
+
+struct LogBlockHeader {
+  uint32_t sequence;
+  uint16_t boot;
+  uint16_t count;
+  uint32_t start_ms;
+  uint32_t epoch;
+};
+
+struct LogRecord {
+  uint32_t time_ms;  // Uptime
+  uint8_t source;
+  uint16_t id;
+  float value;
+};
+
+// Liest die Datensätze eines Blocks, z.B. im Export-Werkzeug auf dem Host
+class ELM327LogBlockReader {
+ public:
+  // false = kein gültiger Block (gelöscht oder anderes Format)
+  bool open(const uint8_t *block);
+  bool next(LogRecord &record);
+  const LogBlockHeader &header() const { return this->header_; }
+
+ protected:
+  const uint8_t *block_{nullptr};
+  LogBlockHeader header_{};
+  size_t pos_{0};
+  uint16_t index_{0};
+  uint32_t time_ms_{0};
+};
+
+// Flash-Speicher des Loggers als Ring aus Blöcken (ESP32: eigene Datenpartition)
+class ELM327LogStorage {
+ public:
+  virtual ~ELM327LogStorage() = default;
+  virtual uint32_t block_count() const = 0;
+  // Die ersten len Bytes eines Blocks lesen
+  virtual bool read(uint32_t block, uint8_t *data, size_t len) = 0;
+  // Blöcke werden reihum geschrieben. Beginnt ein Block einen Löschsektor, löscht die
+  // Implementierung den Sektor vorher, jeder Sektor wird also einmal pro Umlauf gelöscht.
+  virtual bool write(uint32_t block, const uint8_t *data) = 0;
+};
+
+// Datenlogger: sammelt dekodierte Werte in kompakten Blöcken in einem RAM-Ring
+// (PSRAM, falls vorhanden) und schreibt volle Blöcke gebündelt in den Flash.
+// Ohne Flash-Speicher überschreibt der Ring die ältesten Blöcke.
+class ELM327DataLog {
+ public:
+  static const size_t BLOCK_SIZE = 512;
+  static const size_t HEADER_SIZE = 20;
+  static const size_t MAX_RECORD_SIZE = 5 + 1 + 2 + 4;
+
+  // RAM-Puffer, wird auf ganze Blöcke abgerundet (mindestens 2)
+  void set_buffer(uint8_t *buffer, size_t size);
+  // Flash-Ring; sucht den zuletzt geschriebenen Block und setzt dahinter fort
+  void set_storage(ELM327LogStorage *storage);
+  void set_boot(uint16_t boot) { this->boot_ = boot; }
+  // Unix-Zeit zum Zeitpunkt now, gilt für alle folgenden Blöcke
+  void set_clock(uint32_t epoch, uint32_t now);
+  // Blöcke vor dieser Sequenznummer gelten als gelöscht (clear(), im NVS gespeichert)
+  void set_first_sequence(uint32_t sequence);
+  uint32_t get_first_sequence() const { return this->first_sequence_; }
+  // Volle Blöcke erst in den Flash, wenn so viele beisammen sind (ein Löschsektor)
+  void set_flush_blocks(uint32_t blocks) { this->flush_blocks_ = blocks; }
+
+  bool is_enabled() const { return this->ram_blocks_ > 0; }
+  void add(uint8_t source, uint16_t id, float value, uint32_t now);
+  // Wert eines Protokoll-Kanals, Quelle und ID aus seiner Konfiguration
+  void add_value(const OBD2PIDConfig &config, float value, uint32_t now);
+  // Volle Blöcke in den Flash schreiben, sobald flush_blocks beisammen sind, force = auch
+  // den angefangenen Block abschließen. Ein begonnener Durchgang wird in den folgenden
+  // Aufrufen fortgesetzt, max_blocks begrenzt die Dauer eines Aufrufs.
+  // Rückgabe = geschriebene Blöcke.
+  uint32_t flush(bool force, uint32_t max_blocks = UINT32_MAX);
+  // Alle Werte verwerfen (Flash per Sequenznummer, ohne zu löschen)
+  void clear();
+
+  // Export: erst der Flash-Ring ab dem ältesten Block, dann der RAM-Ring.
+  // export_block() liefert false für leere oder gelöschte Blöcke.
+  uint32_t begin_export();
+  bool export_block(uint32_t index, uint8_t *out);
+
+  uint32_t get_records() const { return this->records_; }
+  uint32_t get_dropped_blocks() const { return this->dropped_blocks_; }
+  uint32_t get_flash_writes() const { return this->flash_writes_; }
+  uint32_t get_flash_errors() const { return this->flash_errors_; }
+  uint32_t get_flash_blocks() const { return this->storage_ != nullptr ? this->storage_->block_count() : 0; }
+  uint32_t get_ram_blocks() const { return this->ram_blocks_; }
+  // Noch nicht im Flash (inkl. angefangener Block)
+  uint32_t get_pending_blocks() const { return this->ram_count_; }
+
+ protected:
+  uint8_t *ram_block_(uint32_t index) const { return this->ram_ + (index % this->ram_blocks_) * BLOCK_SIZE; }
+  void open_block_(uint32_t now);
+  bool valid_sequence_(const uint8_t *block) const;
+
+  uint8_t *ram_{nullptr};
+  uint32_t ram_blocks_{0};
+  uint32_t ram_tail_{0};   // ältester Block im RAM
+  uint32_t ram_count_{0};  // belegte Blöcke inkl. des angefangenen
+  bool open_{false};       // letzter Block nimmt noch Datensätze auf
+  size_t used_{0};         // Bytes im angefangenen Block
+  uint32_t last_ms_{0};    // Zeit des letzten Datensatzes
+
+  ELM327LogStorage *storage_{nullptr};
+  uint32_t flash_head_{0};  // nächster zu schreibender Flash-Block
+  uint32_t flush_blocks_{8};
+  bool flushing_{false};
+
+  uint32_t sequence_{0};    // Sequenznummer des nächsten Blocks
+  uint32_t first_sequence_{0};
+  uint16_t boot_{0};
+  uint32_t epoch_{0};       // Unix-Zeit bei epoch_ms_
+  uint32_t epoch_ms_{0};
+
+  uint32_t export_flash_head_{0};
+  uint32_t export_flash_count_{0};
+  uint32_t export_ram_tail_{0};
+
+  uint32_t records_{0};
+  uint32_t dropped_blocks_{0};
+  uint32_t flash_writes_{0};
+  uint32_t flash_errors_{0};
+};
+
+}  // namespace elm327_ble
+}  // namespace esphome
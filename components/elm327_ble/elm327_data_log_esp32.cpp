@@ -0,0 +1,133 @@
+#include "elm327_data_log_esp32.h"
+
+#ifdef USE_ELM327_DATA_LOG
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace elm327_ble {
+
+static const char *TAG = "elm327_ble.log";
+
+// ============================================================
+// Flash-Partition
+// ============================================================
+bool ELM327PartitionStorage::open(const std::string &label) {
+  this->partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label.c_str());
+  return this->partition_ != nullptr && this->block_count() >= BLOCKS_PER_SECTOR;
+}
+
+uint32_t ELM327PartitionStorage::block_count() const {
+  if (this->partition_ == nullptr)
+    return 0;
+  // Nur ganze Sektoren, damit Löschen nie über das Partitionsende reicht
+  return this->partition_->size / SPI_FLASH_SEC_SIZE * BLOCKS_PER_SECTOR;
+}
+
+bool ELM327PartitionStorage::read(uint32_t block, uint8_t *data, size_t len) {
+  return esp_partition_read(this->partition_, block * ELM327DataLog::BLOCK_SIZE, data, len) == ESP_OK;
+}
+
+bool ELM327PartitionStorage::write(uint32_t block, const uint8_t *data) {
+  size_t offset = block * ELM327DataLog::BLOCK_SIZE;
+  if (block % BLOCKS_PER_SECTOR == 0) {
+    esp_err_t err = esp_partition_erase_range(this->partition_, offset, SPI_FLASH_SEC_SIZE);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "Sektor bei 0x%06X nicht geloescht: %d", (unsigned) offset, err);
+      return false;
+    }
+  }
+  esp_err_t err = esp_partition_write(this->partition_, offset, data, ELM327DataLog::BLOCK_SIZE);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Block %u nicht geschrieben: %d", (unsigned) block, err);
+    return false;
+  }
+  return true;
+}
+
+// ============================================================
+// Download-Server
+// ============================================================
+bool ELM327LogServer::start_() {
+  this->server_ = socket::socket_ip(SOCK_STREAM, 0);
+  if (this->server_ == nullptr)
+    return false;
+  int enable = 1;
+  this->server_->setsockopt(SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  this->server_->setblocking(false);
+  struct sockaddr_storage address;
+  socklen_t length = socket::set_sockaddr_any((struct sockaddr *) &address, sizeof(address), this->port_);
+  if (length == 0 || this->server_->bind((struct sockaddr *) &address, length) != 0 ||
+      this->server_->listen(1) != 0) {
+    this->server_ = nullptr;
+    return false;
+  }
+  ESP_LOGI(TAG, "Download auf Port %u bereit", this->port_);
+  return true;
+}
+
+void ELM327LogServer::finish_(const char *reason) {
+  ESP_LOGI(TAG, "Download %s: %u Bloecke (%u KiB)", reason, this->blocks_sent_,
+           this->blocks_sent_ * (unsigned) ELM327DataLog::BLOCK_SIZE / 1024);
+  this->client_->close();
+  this->client_ = nullptr;
+}
+
+void ELM327LogServer::loop() {
+  if (this->log_ == nullptr || this->failed_)
+    return;
+  // Erst nach dem Start des Netzwerks möglich, daher nicht in setup()
+  if (this->server_ == nullptr && !this->start_()) {
+    ESP_LOGE(TAG, "Download-Server auf Port %u nicht gestartet", this->port_);
+    this->failed_ = true;
+    return;
+  }
+
+  struct sockaddr_storage source;
+  socklen_t source_length = sizeof(source);
+  auto client = this->server_->accept((struct sockaddr *) &source, &source_length);
+  if (client != nullptr) {
+    if (this->client_ != nullptr) {
+      client->close();  // nur ein Download gleichzeitig
+    } else {
+      client->setblocking(false);
+      this->client_ = std::move(client);
+      this->count_ = this->log_->begin_export();
+      this->index_ = 0;
+      this->sent_ = ELM327DataLog::BLOCK_SIZE;
+      this->blocks_sent_ = 0;
+      ESP_LOGI(TAG, "Download gestartet (%u Bloecke)", this->count_);
+    }
+  }
+  if (this->client_ == nullptr)
+    return;
+
+  for (uint32_t budget = 0; budget < BLOCKS_PER_LOOP; budget++) {
+    if (this->sent_ == ELM327DataLog::BLOCK_SIZE) {
+      // Nächsten gültigen Block holen, leere Flash-Blöcke überspringen
+      if (this->index_ >= this->count_) {
+        this->finish_("abgeschlossen");
+        return;
+      }
+      if (!this->log_->export_block(this->index_++, this->block_))
+        continue;
+      this->sent_ = 0;
+    }
+    ssize_t written = this->client_->write(this->block_ + this->sent_, ELM327DataLog::BLOCK_SIZE - this->sent_);
+    if (written < 0) {
+      if (errno == EWOULDBLOCK || errno == EAGAIN)
+        return;
+      this->finish_("abgebrochen");
+      return;
+    }
+    this->sent_ += written;
+    if (this->sent_ < ELM327DataLog::BLOCK_SIZE)
+      return;  // Sendepuffer voll
+    this->blocks_sent_++;
+  }
+}
+
+}  // namespace elm327_ble
+}  // namespace esphome
+
+#endif  // USE_ELM327_DATA_LOG
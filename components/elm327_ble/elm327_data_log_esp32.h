@@ -0,0 +1,67 @@
+#pragma once
+
+#include "esphome/core/defines.h"
+
+#ifdef USE_ELM327_DATA_LOG
+
+#include "esphome/components/socket/socket.h"
+#include "elm327_data_log.h"
+
+#include <esp_partition.h>
+
+#include <memory>
+#include <string>
+
+namespace esphome {
+namespace elm327_ble {
+
+// Flash-Ring des Datenloggers in einer eigenen Datenpartition (partitions.csv)
+class ELM327PartitionStorage : public ELM327LogStorage {
+ public:
+  static const uint32_t BLOCKS_PER_SECTOR = SPI_FLASH_SEC_SIZE / ELM327DataLog::BLOCK_SIZE;
+
+  // false = keine Datenpartition mit diesem Namen
+  bool open(const std::string &label);
+  uint32_t block_count() const override;
+  bool read(uint32_t block, uint8_t *data, size_t len) override;
+  bool write(uint32_t block, const uint8_t *data) override;
+
+ protected:
+  const esp_partition_t *partition_{nullptr};
+};
+
+// Download per TCP: Jede Verbindung bekommt alle gespeicherten Blöcke (älteste
+// zuerst) und wird danach geschlossen, z.B. `nc <IP> 7327 > obd2log.bin`.
+class ELM327LogServer {
+ public:
+  void set_log(ELM327DataLog *log) { this->log_ = log; }
+  void set_port(uint16_t port) { this->port_ = port; }
+  uint16_t get_port() const { return this->port_; }
+  // Aus der Hauptschleife: Verbindungen annehmen und Blöcke senden
+  void loop();
+  // Während eines Downloads ruht das Schreiben in den Flash
+  bool is_active() const { return this->client_ != nullptr; }
+
+  // Höchstens so viele Blöcke pro loop() lesen bzw. senden
+  static const uint32_t BLOCKS_PER_LOOP = 8;
+
+ protected:
+  bool start_();
+  void finish_(const char *reason);
+
+  ELM327DataLog *log_{nullptr};
+  uint16_t port_{7327};
+  bool failed_{false};
+  std::unique_ptr<socket::Socket> server_;
+  std::unique_ptr<socket::Socket> client_;
+  uint32_t index_{0};  // nächster Block laut begin_export()
+  uint32_t count_{0};
+  uint8_t block_[ELM327DataLog::BLOCK_SIZE];
+  size_t sent_{ELM327DataLog::BLOCK_SIZE};  // gesendete Bytes von block_, BLOCK_SIZE = leer
+  uint32_t blocks_sent_{0};
+};
+
+}  // namespace elm327_ble
+}  // namespace esphome
+
+#endif  // USE_ELM327_DATA_LOG
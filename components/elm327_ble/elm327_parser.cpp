@@ -0,0 +1,365 @@
+#include "elm327_parser.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace elm327_ble {
+
+static int hex_value(uint8_t c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+static bool text_contains(const char *text, size_t len, const char *needle) {
+  size_t n = strlen(needle);
+  for (size_t i = 0; i + n <= len; i++) {
+    if (memcmp(text + i, needle, n) == 0)
+      return true;
+  }
+  return false;
+}
+
+void ELM327ResponseParser::reset() {
+  this->input_.clear();
+  this->complete_ = true;
+  this->begin_response_();
+}
+
+bool ELM327ResponseParser::poll() {
+  if (this->complete_)
+    this->begin_response_();
+
+  uint8_t c;
+  while (this->input_.pop(c)) {
+    this->feed_(c);
+    if (this->complete_)
+      return true;
+  }
+  return false;
+}
+
+void ELM327ResponseParser::begin_response_() {
+  auto &r = this->response_;
+  r.data_len = 0;
+  r.message_count = 0;
+  r.text[0] = '\0';
+  r.text_len = 0;
+  r.raw[0] = '\0';
+  r.raw_len = 0;
+  r.status = RESPONSE_OK;
+  r.overflow = false;
+  r.incomplete = false;
+  r.prompt = false;
+
+  this->complete_ = false;
+  this->message_open_ = false;
+  this->message_framed_ = false;
+  this->expected_len_ = -1;
+  for (auto &assembly : this->assembly_)
+    assembly.used = false;
+  this->reset_line_();
+}
+
+void ELM327ResponseParser::reset_line_() {
+  this->line_len_ = 0;
+  this->line_data_start_ = this->response_.data_len;
+  this->pending_nibble_ = -1;
+  this->line_is_hex_ = true;
+  this->line_framed_ = false;
+}
+
+void ELM327ResponseParser::feed_(uint8_t c) {
+  auto &r = this->response_;
+
+  if (c == '>') {
+    this->end_line_();
+    this->finish_message_(r.data_len);
+    for (auto &assembly : this->assembly_) {
+      // Multiframe-Antwort ohne alle Consecutive Frames
+      r.incomplete |= assembly.used;
+      assembly.used = false;
+    }
+    if (this->headers_) {
+      // Steuergeräte senden gleichzeitig, die Reihenfolge der Zeilen ist zufällig.
+      // Nach CAN-ID sortiert kommt das Motorsteuergerät (7E8) immer zuerst.
+      for (size_t i = 1; i < r.message_count; i++) {
+        for (size_t j = i; j > 0 && r.message_sender[j - 1] > r.message_sender[j]; j--) {
+          std::swap(r.message_sender[j - 1], r.message_sender[j]);
+          std::swap(r.message_start[j - 1], r.message_start[j]);
+          std::swap(r.message_len[j - 1], r.message_len[j]);
+        }
+      }
+    }
+    r.raw[r.raw_len] = '\0';
+    r.prompt = true;
+    this->complete_ = true;
+    return;
+  }
+  if (c == '\r' || c == '\n') {
+    bool empty = this->line_len_ == 0;
+    this->end_line_();
+    if (this->line_mode_ && !empty) {
+      this->finish_message_(r.data_len);
+      r.raw[r.raw_len] = '\0';
+      this->complete_ = true;
+    }
+    return;
+  }
+  if (c == ' ' || c == '\0')
+    return;
+
+  if (r.raw_len < ELM327Response::MAX_RAW) {
+    r.raw[r.raw_len++] = (char) c;
+  } else {
+    r.overflow = true;
+  }
+  if (this->line_len_ < MAX_LINE)
+    this->line_[this->line_len_++] = (char) c;
+
+  if (!this->line_is_hex_)
+    return;
+
+  if (this->headers_) {
+    // Frame wird erst am Zeilenende ausgewertet (Länge der CAN-ID hängt an der Zeilenlänge)
+    if (hex_value(c) < 0)
+      this->line_is_hex_ = false;
+    return;
+  }
+
+  if (c == ':') {
+    // Frame-Index einer CAN-Multiframe-Antwort, z.B. "1:"
+    if (this->line_len_ == 2 && this->pending_nibble_ >= 0) {
+      this->line_index_ = this->pending_nibble_;
+      this->pending_nibble_ = -1;
+      this->line_framed_ = true;
+    } else {
+      this->line_is_hex_ = false;
+      this->rollback_line_();
+    }
+    return;
+  }
+
+  int value = hex_value(c);
+  if (value < 0) {
+    // Textzeile ("OK", "12.4V", "NO DATA", ...) → bereits dekodierte Bytes verwerfen
+    this->line_is_hex_ = false;
+    this->rollback_line_();
+    return;
+  }
+
+  if (this->pending_nibble_ < 0) {
+    this->pending_nibble_ = value;
+    return;
+  }
+  uint8_t byte = (this->pending_nibble_ << 4) | value;
+  this->pending_nibble_ = -1;
+  if (r.data_len < ELM327Response::MAX_DATA) {
+    r.data[r.data_len++] = byte;
+  } else {
+    r.overflow = true;
+  }
+}
+
+void ELM327ResponseParser::end_line_() {
+  auto &r = this->response_;
+  if (this->line_len_ == 0)
+    return;
+
+  if (!this->line_is_hex_) {
+    const char *line = this->line_;
+    size_t len = this->line_len_;
+    if (!text_contains(line, len, "SEARCHING")) {
+      size_t n = len < ELM327Response::MAX_TEXT ? len : ELM327Response::MAX_TEXT;
+      memcpy(r.text, line, n);
+      r.text[n] = '\0';
+      r.text_len = n;
+    }
+    if (text_contains(line, len, "NODATA")) {
+      if (r.status == RESPONSE_OK)
+        r.status = RESPONSE_NO_DATA;
+    } else if (text_contains(line, len, "ERROR") || text_contains(line, len, "UNABLE") ||
+               text_contains(line, len, "STOPPED") || text_contains(line, len, "BUFFERFULL") ||
+               (len == 1 && line[0] == '?')) {
+      r.status = RESPONSE_ERROR;
+    }
+  } else if (this->headers_) {
+    this->end_frame_();
+  } else if (this->line_framed_) {
+    // Folge-Frame gehört zur offenen Multiframe-Nachricht. Ein unerwartetes "0:"
+    // ist der Anfang der Antwort eines weiteren Steuergeräts.
+    bool continues = this->message_open_ && this->message_framed_ &&
+                     (this->line_index_ != 0 || this->next_index_ == 0);
+    if (!continues) {
+      this->finish_message_(this->line_data_start_);
+      this->begin_message_(this->line_data_start_, true);
+    }
+    if (this->line_index_ != this->next_index_)
+      this->message_broken_ = true;
+    this->next_index_ = (this->line_index_ + 1) & 0x0F;
+  } else if (this->line_len_ == 3 && this->pending_nibble_ >= 0) {
+    // Längenangabe vor einer Multiframe-Antwort, z.B. "00C" = 12 Bytes
+    int length = (hex_value(this->line_[0]) << 8) | (hex_value(this->line_[1]) << 4) | hex_value(this->line_[2]);
+    this->rollback_line_();
+    this->finish_message_(r.data_len);
+    this->begin_message_(r.data_len, true);
+    this->expected_len_ = length;
+  } else {
+    // Einzelzeile = eigene Nachricht (ein überzähliges Nibble wird verworfen)
+    this->finish_message_(this->line_data_start_);
+    this->begin_message_(this->line_data_start_, false);
+    this->finish_message_(r.data_len);
+  }
+
+  this->reset_line_();
+}
+
+// ISO-TP-Frame mit CAN-ID: 11 Bit = 3 Ziffern, 29 Bit = 8 Ziffern, danach ganze Bytes.
+// Die Zeilenlänge ist daher bei 11 Bit ungerade und bei 29 Bit gerade.
+void ELM327ResponseParser::end_frame_() {
+  auto &r = this->response_;
+  size_t len = this->line_len_;
+  size_t id_digits = len % 2 != 0 ? 3 : 8;
+  if (len >= MAX_LINE || len < id_digits + 2)
+    return;  // zu lang für einen CAN-Frame bzw. keine Daten
+  uint32_t sender = 0;
+  for (size_t i = 0; i < id_digits; i++)
+    sender = (sender << 4) | hex_value(this->line_[i]);
+  uint8_t frame[8];
+  size_t count = 0;
+  for (size_t i = id_digits; i + 1 < len && count < sizeof(frame); i += 2)
+    frame[count++] = (hex_value(this->line_[i]) << 4) | hex_value(this->line_[i + 1]);
+
+  Assembly *assembly = nullptr;
+  for (auto &slot : this->assembly_) {
+    if (slot.used && slot.sender == sender)
+      assembly = &slot;
+  }
+  uint8_t pci = frame[0];
+  switch (pci >> 4) {
+    case 0: {
+      // Single Frame: Länge im unteren Nibble, Füllbytes abschneiden
+      size_t length = pci & 0x0F;
+      if (length == 0 || length > count - 1) {
+        r.incomplete = true;
+        return;
+      }
+      this->add_message_(sender, frame + 1, length);
+      return;
+    }
+    case 1: {
+      // First Frame: 12-Bit-Länge, danach 6 Datenbytes
+      if (assembly == nullptr) {
+        for (auto &slot : this->assembly_) {
+          if (!slot.used)
+            assembly = &slot;
+        }
+      }
+      if (assembly == nullptr || count < 2) {
+        r.incomplete = true;
+        return;
+      }
+      if (assembly->used)
+        r.incomplete = true;  // vorige Antwort desselben Steuergeräts unvollständig
+      assembly->used = true;
+      assembly->sender = sender;
+      assembly->expected = ((pci & 0x0F) << 8) | frame[1];
+      assembly->len = 0;
+      assembly->next_index = 1;
+      for (size_t i = 2; i < count && assembly->len < ELM327Response::MAX_DATA; i++)
+        assembly->data[assembly->len++] = frame[i];
+      break;
+    }
+    case 2:
+      // Consecutive Frame: Index 1, 2, ... F, 0, ...
+      if (assembly == nullptr)
+        return;
+      if ((pci & 0x0F) != assembly->next_index) {
+        assembly->used = false;
+        r.incomplete = true;
+        return;
+      }
+      assembly->next_index = (assembly->next_index + 1) & 0x0F;
+      for (size_t i = 1; i < count && assembly->len < ELM327Response::MAX_DATA; i++)
+        assembly->data[assembly->len++] = frame[i];
+      break;
+    default:
+      return;  // Flow Control u.ä.
+  }
+  if (assembly->len >= assembly->expected || assembly->len >= ELM327Response::MAX_DATA) {
+    if (assembly->expected > ELM327Response::MAX_DATA)
+      r.overflow = true;
+    this->add_message_(sender, assembly->data, std::min<size_t>(assembly->expected, assembly->len));
+    assembly->used = false;
+  }
+}
+
+void ELM327ResponseParser::add_message_(uint32_t sender, const uint8_t *data, size_t len) {
+  auto &r = this->response_;
+  if (len == 0)
+    return;
+  if (r.message_count >= ELM327Response::MAX_MESSAGES || r.data_len + len > ELM327Response::MAX_DATA) {
+    r.overflow = true;
+    return;
+  }
+  memcpy(r.data + r.data_len, data, len);
+  r.message_start[r.message_count] = r.data_len;
+  r.message_len[r.message_count] = len;
+  r.message_sender[r.message_count] = sender;
+  r.message_count++;
+  r.data_len += len;
+}
+
+void ELM327ResponseParser::begin_message_(uint8_t start, bool framed) {
+  this->message_open_ = true;
+  this->message_framed_ = framed;
+  this->message_start_ = start;
+  this->expected_len_ = -1;
+  this->next_index_ = 0;
+  this->message_broken_ = false;
+}
+
+void ELM327ResponseParser::finish_message_(uint8_t end) {
+  auto &r = this->response_;
+  if (!this->message_open_)
+    return;
+  this->message_open_ = false;
+
+  size_t len = end - this->message_start_;
+  if (this->message_framed_ && this->expected_len_ >= 0) {
+    // Füllbytes des letzten CAN-Frames abschneiden, fehlende Frames → unbrauchbar
+    if (len > (size_t) this->expected_len_) {
+      len = this->expected_len_;
+    } else if (len < (size_t) this->expected_len_) {
+      this->message_broken_ = true;
+    }
+  }
+  if (this->message_broken_) {
+    // Bytes bleiben in `data`, gehören aber zu keiner Nachricht
+    r.incomplete = true;
+    return;
+  }
+  if (len == 0)
+    return;
+  if (r.message_count >= ELM327Response::MAX_MESSAGES) {
+    r.overflow = true;
+    return;
+  }
+  r.message_start[r.message_count] = this->message_start_;
+  r.message_len[r.message_count] = len;
+  r.message_sender[r.message_count] = 0;
+  r.message_count++;
+}
+
+void ELM327ResponseParser::rollback_line_() {
+  this->response_.data_len = this->line_data_start_;
+  this->pending_nibble_ = -1;
+}
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace elm327_ble {
+
+// Ringpuffer fester Größe für eingehende Notify-Bytes (keine Heap-Allokation).
+// Ein Chunk kann das Ende einer Antwort und den Anfang der nächsten enthalten,
+// der Rest bleibt dann bis zum nächsten poll() im Puffer.
+template<size_t N> class RingBuffer {
+ public:
+  // Gibt die Anzahl der übernommenen Bytes zurück (bei Überlauf weniger als len)
+  size_t push(const uint8_t *data, size_t len) {
+    size_t stored = 0;
+    while (stored < len && this->count_ < N) {
+      this->buffer_[this->head_] = data[stored++];
+      this->head_ = (this->head_ + 1) % N;
+      this->count_++;
+    }
+    return stored;
+  }
+
+  bool pop(uint8_t &byte) {
+    if (this->count_ == 0)
+      return false;
+    byte = this->buffer_[this->tail_];
+    this->tail_ = (this->tail_ + 1) % N;
+    this->count_--;
+    return true;
+  }
+
+  void clear() { this->head_ = this->tail_ = this->count_ = 0; }
+  size_t size() const { return this->count_; }
+  bool empty() const { return this->count_ == 0; }
+  static constexpr size_t capacity() { return N; }
+
+ protected:
+  uint8_t buffer_[N];
+  size_t head_{0};
+  size_t tail_{0};
+  size_t count_{0};
+};
+
+enum ResponseStatus : uint8_t {
+  RESPONSE_OK,
+  RESPONSE_NO_DATA,  // "NO DATA"
+  RESPONSE_ERROR,    // "ERROR", "?", "UNABLE TO CONNECT", "STOPPED", "BUFFER FULL", ...
+};
+
+// Eine vollständige, bis zum '>' empfangene Antwort in dekodierter Form.
+// Jede Hex-Zeile (bzw. jede zusammengesetzte CAN-Multiframe-Antwort) ist eine
+// eigene Nachricht in `data`, z.B. "410C1AF8" → {0x41, 0x0C, 0x1A, 0xF8}.
+struct ELM327Response {
+  static const size_t MAX_DATA = 128;
+  static const size_t MAX_MESSAGES = 8;
+  static const size_t MAX_TEXT = 32;
+  static const size_t MAX_RAW = 128;
+
+  uint8_t data[MAX_DATA];
+  uint8_t data_len;
+  uint8_t message_count;
+  uint8_t message_start[MAX_MESSAGES];
+  uint8_t message_len[MAX_MESSAGES];
+  uint32_t message_sender[MAX_MESSAGES];  // CAN-ID des Absenders mit ATH1 (z.B. 0x7E8), sonst 0
+
+  // Letzte Textzeile ohne Leerzeichen, z.B. "12.4V", "OK", "ELM327v1.5"
+  char text[MAX_TEXT + 1];
+  uint8_t text_len;
+
+  // Bereinigte Rohantwort (ohne Leerzeichen/Zeilenumbrüche) für Debug-Ausgaben
+  char raw[MAX_RAW + 1];
+  uint8_t raw_len;
+
+  ResponseStatus status;
+  bool overflow;  // Antwort war länger als die Puffer, Rest verworfen
+  bool incomplete;  // Multiframe-Nachricht mit fehlenden Frames verworfen
+  bool prompt;    // mit '>' abgeschlossen (im Zeilenmodus: Ende des Datenstroms)
+
+  const uint8_t *message(size_t index) const { return this->data + this->message_start[index]; }
+  size_t message_length(size_t index) const { return this->message_len[index]; }
+  uint32_t sender(size_t index) const { return this->message_sender[index]; }
+};
+
+// Inkrementeller Tokenizer: dekodiert Hex-Paare Byte für Byte, während die
+// Chunks ankommen, und übergibt beim '>' eine fertige ELM327Response.
+// Erkennt CAN-Multiframe-Antworten ("00C", "0:410C...", "1:...") und setzt
+// sie zu einer Nachricht zusammen. Antworten mehrerer Steuergeräte werden an
+// der Längenangabe bzw. einem neuen "0:" getrennt, Nachrichten mit Lücken in
+// der Frame-Folge oder zu wenigen Bytes verworfen.
+//
+// Mit Headern (ATH1, nur CAN) ist jede Zeile ein roher ISO-TP-Frame mit CAN-ID,
+// z.B. "7E8 06 41 0C 1A F8" oder "18DAF110 10 14 49 02 ...". Die Frames werden pro
+// Absender zusammengesetzt, auch wenn sich die Antworten zweier Steuergeräte abwechseln.
+class ELM327ResponseParser {
+ public:
+  ELM327ResponseParser() { this->reset(); }
+
+  // Neue Bytes aus einem Notify-Chunk übernehmen
+  size_t push(const uint8_t *data, size_t len) { return this->input_.push(data, len); }
+
+  // Verarbeitet gepufferte Bytes; true = eine Antwort ist komplett (siehe response()).
+  // Danach erneut aufrufen, falls noch Bytes der nächsten Antwort im Puffer liegen.
+  bool poll();
+
+  const ELM327Response &response() const { return this->response_; }
+
+  // Verwirft die angefangene Antwort und alle gepufferten Bytes
+  void reset();
+
+  // Zeilenmodus für Datenströme ohne Prompt (ATMA): jede Zeile ist eine eigene Antwort
+  void set_line_mode(bool line_mode) { this->line_mode_ = line_mode; }
+  bool is_line_mode() const { return this->line_mode_; }
+  // Header-Modus (ATH1): CAN-ID und ISO-TP-PCI pro Zeile auswerten
+  void set_headers(bool headers) { this->headers_ = headers; }
+  bool has_headers() const { return this->headers_; }
+
+  // Gleichzeitig zusammengesetzte Multiframe-Antworten (Steuergeräte) im Header-Modus
+  static const size_t MAX_SENDERS = 4;
+
+ protected:
+  void begin_response_();
+  void reset_line_();
+  void feed_(uint8_t c);
+  void end_line_();
+  void begin_message_(uint8_t start, bool framed);
+  void finish_message_(uint8_t end);
+  void rollback_line_();
+  void end_frame_();
+  void add_message_(uint32_t sender, const uint8_t *data, size_t len);
+
+  RingBuffer<256> input_;
+  ELM327Response response_;
+  bool complete_{false};
+  bool line_mode_{false};
+  bool headers_{false};
+
+  // Zustand der aktuellen Zeile
+  static const size_t MAX_LINE = 64;
+  char line_[MAX_LINE];
+  uint8_t line_len_{0};
+  uint8_t line_data_start_{0};  // data_len beim Zeilenanfang
+  int8_t pending_nibble_{-1};
+  bool line_is_hex_{true};
+  bool line_framed_{false};     // Zeile mit Frame-Index "N:"
+  uint8_t line_index_{0};
+
+  // Zustand der aktuellen Nachricht
+  bool message_open_{false};
+  bool message_framed_{false};
+  uint8_t message_start_{0};
+  int16_t expected_len_{-1};    // Längenangabe einer Multiframe-Antwort
+  uint8_t next_index_{0};       // erwarteter Frame-Index (0-F, läuft über)
+  bool message_broken_{false};  // Frame fehlt oder kam doppelt
+
+  // Header-Modus: offene Multiframe-Antworten pro Absender
+  struct Assembly {
+    uint32_t sender;
+    uint16_t expected;  // Länge laut First Frame
+    uint8_t len;
+    uint8_t next_index;
+    bool used;
+    uint8_t data[ELM327Response::MAX_DATA];
+  };
+  Assembly assembly_[MAX_SENDERS];
+};
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -0,0 +1,1793 @@
+#include "elm327_protocol.h"
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace elm327_ble {
+
+static const char *TAG = "elm327_ble.protocol";
+
+// Gewichtete Dringlichkeit: überfällige Zeit × (Priorität + 1), -1 = noch nicht fällig
+static int64_t poll_score(const PollSchedule &schedule, uint32_t now) {
+  if (schedule.disabled)
+    return -1;
+  int32_t overdue = (int32_t) (now - schedule.next_due);
+  if (overdue < 0)
+    return -1;
+  return ((int64_t) overdue + 1) * (schedule.priority + 1);
+}
+
+// ============================================================
+// Verbindung
+// ============================================================
+void ELM327Protocol::start(uint32_t now) {
+  if (this->profiles_.enabled && this->voltage_channel_ < 0) {
+    // Ladespannung zeigt auch bei abgeschaltetem Steuergerät, ob der Motor läuft. Ohne
+    // Drehzahl ist sie die einzige Aktivität: mehrmals pro engine_off_delay abfragen, sonst
+    // fällt der laufende Motor zwischen zwei Messungen in den Stand. Dort gilt parked_interval.
+    ESP_LOGD(TAG, "Abfrageprofile: Batteriespannung wird intern abgefragt");
+    this->add_at_command("ATRV\r", this->profiles_.engine_off_delay / 3, 0);
+  }
+  this->state_ = STATE_INITIALIZING;
+  this->init_step_ = 0;
+  this->init_sent_ = false;
+  this->init_retries_ = 0;
+  this->fast_init_ = this->known_protocol_ != 0;
+  this->last_init_time_ = now;
+  if (!this->command_.empty())
+    this->finish_command(nullptr, now);  // Antwort geht in der Init-Sequenz unter
+  this->pending_.kind = REQUEST_NONE;
+  this->current_header_.clear();  // ATZ setzt den Header zurück
+  this->adaptive_mode_ = 1;       // ebenso ATAT und ATST
+  this->adapter_timeout_ = ATST_DEFAULT;
+  this->timing_rejected_ = false;
+  this->timing_hold_ = 0;
+  this->timing_floor_ = 0;
+  this->monitor_phase_ = MONITOR_OFF;
+  this->parser_.set_line_mode(false);
+  this->parser_.set_headers(false);  // bis zum ATH1 am Ende der Init
+  this->parser_.reset();
+}
+
+void ELM327Protocol::stop() {
+  this->state_ = STATE_IDLE;
+  this->init_step_ = 0;
+  this->abort_commands();
+  this->pending_.kind = REQUEST_NONE;
+  this->monitor_phase_ = MONITOR_OFF;
+  this->parser_.set_line_mode(false);
+  this->parser_.reset();
+}
+
+void ELM327Protocol::receive(const uint8_t *data, size_t len, uint32_t now) {
+  if (this->parser_.push(data, len) < len)
+    ESP_LOGW(TAG, "Empfangspuffer voll, Daten verworfen");
+
+  // Antwort komplett, sobald der ELM327 '>' als Prompt sendet
+  bool prompt = false;
+  while (this->parser_.poll()) {
+    prompt |= this->parser_.response().prompt;
+    if (this->state_ == STATE_INITIALIZING) {
+      this->handle_init_response(this->parser_.response(), now);
+    } else if (this->monitor_phase_ == MONITOR_RUNNING || this->monitor_phase_ == MONITOR_STOPPING) {
+      this->handle_monitor_line(this->parser_.response(), now);
+    } else {
+      this->process_response(this->parser_.response(), now);
+    }
+  }
+
+  // Max. Durchsatz: Adapter ist wieder frei → Init-Schritt bzw. nächste Anfrage sofort senden
+  if (prompt && this->max_throughput_)
+    this->loop(now);
+}
+
+void ELM327Protocol::loop(uint32_t now) {
+  switch (this->state_) {
+    case STATE_INITIALIZING:
+      this->run_init_sequence(now);
+      break;
+
+    case STATE_READY:
+      // Adapter schläft oder wird gerade schlafen gelegt/geweckt
+      if (this->power_loop(now))
+        break;
+      // CAN-Monitor aktiv oder wird gerade ein-/ausgeschaltet
+      if (this->monitor_loop(now))
+        break;
+      // Einmalige Befehle vor der nächsten PID-Abfrage, ohne request_interval abzuwarten
+      if (!this->is_waiting() && this->has_command()) {
+        this->send_queued_command(now);
+      } else if (!this->is_waiting() && (now - this->last_request_time_ >= this->request_interval_)) {
+        this->request_next(now);
+      }
+      // Timeout prüfen
+      if (this->is_waiting() && (now - this->last_request_time_ >= this->pending_timeout())) {
+        ESP_LOGW(TAG, "Antwort-Timeout nach %u ms, mache weiter...", (unsigned) (now - this->last_request_time_));
+        this->record_stats(nullptr, now);
+        if (!this->command_.empty()) {
+          this->finish_command(nullptr, now);
+        } else {
+          this->finish_pending(now);
+        }
+        this->parser_.reset();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+// ============================================================
+// ELM327 Initialisierung
+// ============================================================
+enum InitExpect {
+  INIT_EXPECT_ANY,   // beliebige Antwort ohne Fehler (ATZ meldet die Version)
+  INIT_EXPECT_OK,    // "OK"
+  INIT_EXPECT_DATA,  // OBD-Antwort (0x41 ...), Protokoll gefunden
+  INIT_EXPECT_PROBE,  // jede Antwort, auch "?" (Befehl nur bei manchen Adaptern vorhanden)
+};
+
+struct InitCmd {
+  const char *cmd;
+  uint32_t timeout;
+  InitExpect expect;
+  const char *description;
+};
+
+static const InitCmd INIT_CMDS[] = {
+  {"ATZ\r",   2000, INIT_EXPECT_ANY,  "Reset"},
+  {"ATE0\r",   500, INIT_EXPECT_OK,   "Echo aus"},
+  {"ATL0\r",   500, INIT_EXPECT_OK,   "Linefeed aus"},
+  {"ATS0\r",   500, INIT_EXPECT_OK,   "Spaces aus"},
+  {"ATH0\r",   500, INIT_EXPECT_OK,   "Headers aus"},
+  {"ATI\r",    500, INIT_EXPECT_ANY,  "Adapter-Version"},
+  {"STI\r",    500, INIT_EXPECT_PROBE, "STN-Erkennung"},
+  {"ATSP0\r", 1000, INIT_EXPECT_OK,   "Auto-Protokoll"},
+  {"0100\r",  5000, INIT_EXPECT_DATA, "Protokoll-Erkennung"},
+  {"ATDPN\r",  500, INIT_EXPECT_ANY,  "Protokoll abfragen"},
+  {"0120\r",  1000, INIT_EXPECT_DATA, "Unterstuetzte PIDs"},
+  {"ATH1\r",   500, INIT_EXPECT_OK,   "Headers an"},
+};
+
+// Schritte mit Sonderbehandlung
+static const int INIT_STEP_IDENTIFY = 5;  // ATI, übersprungen wenn der Adapter bekannt ist
+static const int INIT_STEP_STN = 6;       // STI, "?" = kein STN-Chip
+static const int INIT_STEP_PROTOCOL = 7;  // ATSP0 bzw. ATSPn beim Schnellstart
+static const int INIT_STEP_PROBE = 8;     // 0100
+static const int INIT_STEP_DPN = 9;       // ATDPN, beim Schnellstart übersprungen
+static const int INIT_STEP_SUPPORT = 10;  // 0120, 0140, ... solange das Steuergerät weitere meldet
+static const int INIT_STEP_HEADERS = 11;  // ATH1, nur mit set_headers() und CAN-Protokoll
+
+void ELM327Protocol::run_init_sequence(uint32_t now) {
+  if (this->init_step_ == INIT_STEP_IDENTIFY && this->adapter_.known && !this->init_sent_)
+    this->init_step_ = INIT_STEP_PROTOCOL;  // Fähigkeiten aus dem Cache bzw. der letzten Verbindung
+  if (this->init_step_ == INIT_STEP_DPN && this->fast_init_ && !this->init_sent_)
+    this->init_step_++;  // Protokoll ist bereits bekannt
+  if (this->init_step_ == INIT_STEP_SUPPORT && !this->init_sent_) {
+    // Nur fehlende Bitmaps abfragen (0100 kam schon bei der Protokoll-Erkennung)
+    this->support_index_ = this->supported_.next_missing();
+    if (this->support_index_ < 0)
+      this->init_step_++;
+  }
+  // Ältere Protokolle haben andere Header (3 Bytes + Prüfsumme), dort bleibt es bei ATH0
+  if (this->init_step_ == INIT_STEP_HEADERS && !this->init_sent_ && !(this->headers_ && this->is_can_protocol()))
+    this->init_step_++;
+
+  if (this->init_step_ >= INIT_STEPS_COUNT) {
+    // Initialisierung abgeschlossen
+    ESP_LOGI(TAG, "ELM327 initialisiert - bereit fuer Abfragen");
+    this->state_ = STATE_READY;
+    this->pending_.kind = REQUEST_NONE;
+    // Alle Einträge sofort fällig; "now - 1", damit ein gerade gesendeter
+    // Eintrag mit Intervall 0 nicht mit noch nie gesendeten gleichauf liegt
+    for (auto &entry : this->entries_)
+      entry.schedule.next_due = now - 1;
+    this->dtc_schedule_.next_due = now - 1;
+    for (auto &info : this->info_)
+      info.schedule.next_due = now - 1;  // bereits gelesene sind abgeschaltet
+    this->poll_round_start_ = now;
+    this->header_since_ = now;
+    this->apply_supported_pids();
+    // Nach der Weckprobe im Stand weiter, sonst wird ein laufender Motor angenommen
+    this->profile_ = PROFILE_RUNNING;
+    this->profile_since_ = now;
+    this->engine_activity_ = now;
+    if (this->waking_) {
+      this->set_profile(PROFILE_PARKED, now);
+      this->wake_check_ = true;
+    }
+    this->waking_ = false;
+    if (this->listener_ != nullptr)
+      this->listener_->on_ready();
+    return;
+  }
+
+  const InitCmd &step = INIT_CMDS[this->init_step_];
+  if (!this->init_sent_) {
+    ESP_LOGD(TAG, "Init [%d/%d]: %s", this->init_step_ + 1, INIT_STEPS_COUNT, step.description);
+    this->parser_.reset();
+    if (this->init_step_ == INIT_STEP_PROTOCOL && this->fast_init_) {
+      char cmd[8];
+      snprintf(cmd, sizeof(cmd), "ATSP%c\r", this->known_protocol_);
+      ESP_LOGD(TAG, "Schnellstart mit gespeichertem Protokoll %c", this->known_protocol_);
+      this->send_command(cmd);
+    } else if (this->init_step_ == INIT_STEP_SUPPORT) {
+      char cmd[8];
+      snprintf(cmd, sizeof(cmd), "01%02X\r", this->support_index_ * 0x20);
+      this->send_command(cmd);
+    } else {
+      this->send_command(step.cmd);
+    }
+    this->init_sent_ = true;
+    this->last_init_time_ = now;
+    return;
+  }
+
+  // Kein Prompt innerhalb des Timeouts → Befehl wiederholen
+  if (now - this->last_init_time_ >= step.timeout) {
+    this->retry_init_step("Timeout");
+    this->run_init_sequence(now);
+  }
+}
+
+// Antwort auf den aktuellen Init-Befehl: bei erwarteter Antwort sofort weiter
+void ELM327Protocol::handle_init_response(const ELM327Response &response, uint32_t now) {
+  if (!this->init_sent_ || this->init_step_ >= INIT_STEPS_COUNT)
+    return;
+
+  if (this->listener_ != nullptr)
+    this->listener_->on_response(response);
+
+  const InitCmd &step = INIT_CMDS[this->init_step_];
+  bool ok = response.status == RESPONSE_OK;
+  switch (step.expect) {
+    case INIT_EXPECT_OK:
+      ok = ok && strcmp(response.text, "OK") == 0;
+      break;
+    case INIT_EXPECT_DATA:
+      ok = ok && response.message_count > 0 && response.message(0)[0] == 0x41;
+      break;
+    case INIT_EXPECT_PROBE:
+      ok = true;
+      break;
+    default:
+      break;
+  }
+
+  if (ok) {
+    ESP_LOGD(TAG, "Init [%d/%d] OK nach %u ms", this->init_step_ + 1, INIT_STEPS_COUNT,
+             (unsigned) (now - this->last_init_time_));
+    // Bei weiteren Bitmaps bleibt der Schritt stehen und fragt die nächste ab
+    if (!this->parse_init_reply(response))
+      this->init_step_++;
+    this->init_sent_ = false;
+    this->init_retries_ = 0;
+  } else {
+    ESP_LOGW(TAG, "Init [%d/%d] unerwartete Antwort: %s", this->init_step_ + 1, INIT_STEPS_COUNT, response.raw);
+    this->retry_init_step("Fehler");
+  }
+  // Nächsten Befehl direkt senden, nicht erst im nächsten loop()
+  this->run_init_sequence(now);
+}
+
+void ELM327Protocol::retry_init_step(const char *reason) {
+  const InitCmd &step = INIT_CMDS[this->init_step_];
+  this->init_sent_ = false;
+  if (this->fast_init_ && this->init_step_ == INIT_STEP_PROBE && this->waking_) {
+    // Nach der Weckprobe antwortet das Steuergerät bei ausgeschalteter Zündung nicht,
+    // das gespeicherte Protokoll bleibt trotzdem gültig
+    ESP_LOGD(TAG, "Keine Antwort auf 0100 nach dem Aufwachen (%s), Zuendung aus", reason);
+    this->init_step_++;
+    this->init_retries_ = 0;
+    return;
+  }
+  if (this->fast_init_ && this->init_step_ == INIT_STEP_PROBE) {
+    // Gespeichertes Protokoll passt nicht (mehr) → volle Protokollerkennung
+    ESP_LOGW(TAG, "Schnellstart fehlgeschlagen (%s), starte automatische Protokollerkennung", reason);
+    this->fast_init_ = false;
+    this->init_step_ = INIT_STEP_PROTOCOL;
+    this->init_retries_ = 0;
+    return;
+  }
+  if (this->init_retries_ < MAX_INIT_RETRIES) {
+    this->init_retries_++;
+    ESP_LOGW(TAG, "Init %s (%s), Versuch %d/%d", step.description, reason, this->init_retries_ + 1,
+             MAX_INIT_RETRIES + 1);
+    return;
+  }
+  // Wie bisher trotzdem weitermachen, z.B. 0100 bei ausgeschalteter Zündung
+  ESP_LOGW(TAG, "Init %s (%s) nach %d Versuchen uebersprungen", step.description, reason, MAX_INIT_RETRIES + 1);
+  this->init_step_++;
+  this->init_retries_ = 0;
+}
+
+// Fahrzeug-Informationen aus den Init-Antworten übernehmen.
+// Rückgabe true = Schritt wiederholen (weitere PID-Bitmap abfragen).
+bool ELM327Protocol::parse_init_reply(const ELM327Response &response) {
+  bool changed = false;
+  bool again = false;
+  if (this->init_step_ == INIT_STEP_PROBE || this->init_step_ == INIT_STEP_SUPPORT) {
+    // 41 XX AA BB CC DD: Bitmap der unterstützten PIDs XX+1 bis XX+0x20
+    int index = this->init_step_ == INIT_STEP_PROBE ? 0 : this->support_index_;
+    const uint8_t *data = response.message(0);
+    if (response.message_length(0) >= 6 && data[1] == index * 0x20) {
+      uint32_t bitmap = ((uint32_t) data[2] << 24) | ((uint32_t) data[3] << 16) | ((uint32_t) data[4] << 8) | data[5];
+      if (index == 0 && (!this->supported_.is_known(0) || this->supported_.bitmap[0] != bitmap)) {
+        // Anderes Fahrzeug oder neues Steuergerät → alle Bitmaps und Fahrzeug-Infos neu abfragen
+        this->supported_ = {};
+        for (auto &entry : this->entries_) {
+          entry.responders = 0;
+          entry.timing = ResponseTime();
+        }
+        for (auto &info : this->info_) {
+          info.value.clear();
+          info.schedule.disabled = false;
+        }
+      }
+      changed |= !this->supported_.is_known(index) || this->supported_.bitmap[index] != bitmap;
+      this->supported_.bitmap[index] = bitmap;
+      this->supported_.known |= 1 << index;
+      again = index > 0 && this->supported_.next_missing() > 0;
+      if (again)
+        this->support_index_ = this->supported_.next_missing();
+    }
+  } else if (this->init_step_ == INIT_STEP_IDENTIFY || this->init_step_ == INIT_STEP_STN) {
+    changed |= this->parse_adapter_id(response);
+  } else if (this->init_step_ == INIT_STEP_HEADERS) {
+    this->parser_.set_headers(true);
+  } else if (this->init_step_ == INIT_STEP_DPN) {
+    // "A6" = automatisch gefunden, Protokoll 6; "6" = fest eingestellt.
+    // Sieht für den Tokenizer wie Hex aus, daher aus der Rohantwort lesen.
+    char protocol = response.raw_len > 0 ? response.raw[response.raw_len - 1] : 0;
+    bool valid = (protocol >= '1' && protocol <= '9') || (protocol >= 'A' && protocol <= 'C');
+    if (valid) {
+      ESP_LOGI(TAG, "Erkanntes OBD-Protokoll: %c", protocol);
+      changed |= protocol != this->known_protocol_;
+      this->known_protocol_ = protocol;
+    }
+  }
+  if (changed && this->listener_ != nullptr)
+    this->listener_->on_session_info();
+  return again;
+}
+
+// "ELM327v1.5" (ATI) bzw. "STN2120v5.6.5" (STI, nur OBDLink und andere STN-Adapter),
+// der Parser entfernt die Leerzeichen. Rückgabe true = Fähigkeiten geändert.
+bool ELM327Protocol::parse_adapter_id(const ELM327Response &response) {
+  if (response.status != RESPONSE_OK || response.text_len == 0)
+    return false;  // "?" auf STI: ELM327 oder Klon
+  std::string id = response.text;
+  size_t version = id.find_last_of('v');
+  if (version != std::string::npos && version > 0 && version + 1 < id.size() && isdigit((unsigned char) id[version + 1]))
+    id.insert(version, " ");
+  else
+    version = std::string::npos;
+
+  AdapterInfo info = this->adapter_;
+  if (this->init_step_ == INIT_STEP_STN) {
+    if (id.compare(0, 3, "STN") != 0)
+      return false;
+    info.stpx = true;
+    info.response_count = true;
+    info.id = id;
+  } else {
+    // Antwortanzahl gibt es ab v1.3. Klone melden oft eine höhere Version, als sie
+    // können, ein "?" auf die erste Anfrage schaltet sie wieder ab.
+    int major = 0;
+    int minor = 0;
+    if (version != std::string::npos)
+      sscanf(id.c_str() + version + 2, "%d.%d", &major, &minor);
+    info = AdapterInfo{};
+    info.response_count = major > 1 || (major == 1 && minor >= 3);
+    info.id = id;
+  }
+  info.known = true;
+  ESP_LOGI(TAG, "Adapter: %s (Antwortanzahl %s, STPX %s)", info.id.c_str(), info.response_count ? "ja" : "nein",
+           info.stpx ? "ja" : "nein");
+  bool changed = info.id != this->adapter_.id || info.response_count != this->adapter_.response_count ||
+                 info.stpx != this->adapter_.stpx || !this->adapter_.known;
+  this->adapter_ = info;
+  return changed;
+}
+
+// Nicht unterstützte PIDs aus der Abfrage nehmen und melden
+void ELM327Protocol::apply_supported_pids() {
+  if (!this->supported_.is_known(0)) {
+    ESP_LOGW(TAG, "Unterstuetzte PIDs unbekannt, alle PIDs werden abgefragt");
+    return;
+  }
+
+  int disabled = 0;
+  for (int i = 0; i < (int) this->entries_.size(); i++) {
+    auto &entry = this->entries_[i];
+    if (entry.config.is_can_signal)
+      continue;
+    entry.schedule.failures = 0;
+    entry.schedule.disabled = false;
+    // Die Bitmaps gelten für die funktionale Anfrage, nicht für einzelne Steuergeräte
+    if (entry.config.is_at_command || entry.config.mode != 0x01 || !entry.config.header.empty() ||
+        this->supported_.is_supported(entry.config.pid))
+      continue;
+    entry.schedule.disabled = true;
+    disabled++;
+    ESP_LOGW(TAG, "PID 0x%02X wird vom Fahrzeug nicht unterstuetzt und nicht abgefragt", entry.config.pid);
+    if (this->listener_ != nullptr)
+      this->listener_->on_pid_unsupported(i);
+  }
+  ESP_LOGI(TAG, "Unterstuetzte PIDs: %d von %d Eintraegen aktiv", (int) this->entries_.size() - disabled,
+           (int) this->entries_.size());
+}
+
+void ELM327Protocol::send_command(const char *cmd) {
+  if (this->transport_ == nullptr || !this->transport_->write((const uint8_t *) cmd, strlen(cmd))) {
+    this->write_failures_++;
+    ESP_LOGW(TAG, "Befehl nicht gesendet: %.*s", (int) strcspn(cmd, "\r"), cmd);
+  }
+}
+
+// ============================================================
+// PID-Abfrage-Zyklus
+// ============================================================
+void ELM327Protocol::request_next(uint32_t now) {
+  int total = this->schedule_count();
+  if (total == 0)
+    return;
+  if (this->update_adapter_timing(now))
+    return;  // Anfrage folgt auf das "OK"
+
+  uint32_t due = this->poll_time(now);
+  int idx = this->select_next_entry(due, SELECT_ANY);
+  if (idx < 0)
+    return;  // nichts fällig
+
+  // Anderes Steuergerät: erst die schon fälligen Einträge für das aktuelle abfragen,
+  // dann ATSH senden, die eigentliche Anfrage folgt direkt auf dessen "OK".
+  // STN-Adapter bekommen den Header per STPX mit jeder Anfrage.
+  if (!this->adapter_.stpx && this->header_of(idx) != this->current_header_) {
+    int same = this->select_same_header(due);
+    if (same < 0) {
+      this->send_header(this->header_of(idx), idx, now);
+      return;
+    }
+    idx = same;
+  }
+
+  // Wird pro Anfrage (mit max_throughput pro Antwort) gebaut, daher ohne Heap
+  char cmd[MAX_WRITE_LENGTH + 1];
+  PendingRequest &request = this->pending_;
+  request.count = 0;
+  request.syntax = SYNTAX_PLAIN;
+  if (idx < (int) this->entries_.size()) {
+    request.answered[0] = false;
+    request.replies[0] = 0;
+    request.channels[request.count++] = idx;
+    if (this->batch_pids_)
+      this->collect_pid_batch(due);
+
+    const auto &config = this->entries_[idx].config;
+    request.kind = config.is_at_command ? REQUEST_AT : REQUEST_PID;
+    request.mode = config.mode;
+    // Antworten alle bekannten Steuergeräte, sendet der Adapter '>' sofort, statt noch
+    // auf weitere zu warten. Noch nicht gelernte Einträge gehen ohne Anzahl raus.
+    uint8_t responses = 0;
+    for (uint8_t i = 0; i < request.count; i++) {
+      uint8_t responders = this->entries_[request.channels[i]].responders;
+      if (responders == 0 || request.kind != REQUEST_PID) {
+        responses = 0;
+        break;
+      }
+      responses = std::max(responses, responders);
+    }
+    for (uint8_t i = 0; i < request.count; i++) {
+      auto &schedule = this->entries_[request.channels[i]].schedule;
+      schedule.next_due = now + this->poll_interval(schedule);
+    }
+
+    if (config.is_at_command) {
+      snprintf(cmd, sizeof(cmd), "%s", config.command.c_str());
+    } else if (request.count > 1) {
+      char data[3 + 2 * MAX_PIDS_PER_REQUEST] = "01";
+      for (uint8_t i = 0; i < request.count; i++)
+        snprintf(data + 2 + 2 * i, 3, "%02X", (uint8_t) this->entries_[request.channels[i]].config.pid);
+      this->format_request(cmd, data, strlen(data), config.header, responses);
+    } else {
+      this->format_request(cmd, config.command.c_str(), strcspn(config.command.c_str(), "\r"), config.header,
+                           responses);
+    }
+    ESP_LOGD(TAG, "PID[%d/%d] gesendet: %s", idx + 1, total, cmd);
+  } else if (this->info_slot(idx) >= 0) {
+    // Fahrzeug-Info, bei Erfolg abgeschaltet, sonst neuer Versuch nach VEHICLE_INFO_RETRY_MS
+    VehicleInfo &info = this->info_[this->info_slot(idx)];
+    snprintf(cmd, sizeof(cmd), "09%02X\r", info.pid);
+    request.kind = REQUEST_INFO;
+    request.mode = 0x09;
+    request.channels[request.count++] = this->info_slot(idx);
+    info.schedule.next_due = now + VEHICLE_INFO_RETRY_MS;
+    ESP_LOGD(TAG, "Fahrzeug-Info [%d/%d] gesendet: 09%02X", idx + 1, total, info.pid);
+  } else {
+    // DTC-Abfrage, Anzahl der Antworten offen (jedes Steuergerät mit Fehlerspeicher)
+    snprintf(cmd, sizeof(cmd), "03\r");
+    request.kind = REQUEST_DTC;
+    request.mode = 0x03;
+    this->dtc_schedule_.next_due = now + this->dtc_schedule_.update_interval;
+    ESP_LOGD(TAG, "DTC Abfrage [%d/%d] gesendet", idx + 1, total);
+  }
+
+  this->parser_.reset();
+  this->last_request_time_ = now;
+  this->send_command(cmd);
+}
+
+// Index des dringendsten fälligen Eintrags (entries_, danach DTC), -1 = nichts fällig
+int ELM327Protocol::select_next_entry(uint32_t now, SelectFilter filter) {
+  int total = filter == SELECT_BATCH ? (int) this->entries_.size() : this->schedule_count();
+  int best = -1;
+  int64_t best_score = -1;
+  for (int i = 0; i < total; i++) {
+    if (!this->in_profile(i))
+      continue;
+    if (filter == SELECT_SAME_HEADER && this->header_of(i) != this->current_header_)
+      continue;
+    if (filter == SELECT_BATCH && !this->is_batch_candidate(i))
+      continue;
+    int64_t score = poll_score(this->schedule_for(i), now);
+    if (score > best_score) {
+      best = i;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+// Dringendster Eintrag für das aktuelle Steuergerät, der schon beim letzten Header-Wechsel
+// fällig war. Danach neu fällig gewordene warten bis zur nächsten Runde, damit sich
+// zwei Steuergeräte abwechseln statt eines zu blockieren.
+int ELM327Protocol::select_same_header(uint32_t now) {
+  uint32_t since = (int32_t) (this->header_since_ - now) < 0 ? this->header_since_ : now;
+  return this->select_next_entry(since, SELECT_SAME_HEADER);
+}
+
+// Header eines Schedule-Eintrags, DTC- und Info-Abfragen gehen funktional an alle,
+// AT-Befehle (ATRV) sind unabhängig davon
+const std::string &ELM327Protocol::header_of(int index) const {
+  static const std::string FUNCTIONAL;
+  if (index >= (int) this->entries_.size())
+    return FUNCTIONAL;
+  const auto &config = this->entries_[index].config;
+  return config.is_at_command ? this->current_header_ : config.header;
+}
+
+// index = Schedule-Eintrag, für den umgeschaltet wird, -1 = einmaliger Befehl (command_)
+void ELM327Protocol::send_header(const std::string &header, int index, uint32_t now) {
+  // Zurück zur funktionalen Adresse: 7DF (11 Bit) bzw. DB33F1 (29 Bit, Protokoll 7/9)
+  const char *target = header.empty() ? (this->known_protocol_ == '7' || this->known_protocol_ == '9' ? "DB33F1" : "7DF")
+                                      : header.c_str();
+  char cmd[5 + MAX_HEADER_LENGTH + 1];
+  snprintf(cmd, sizeof(cmd), "ATSH%s\r", target);
+  this->header_target_ = header;
+  this->pending_.kind = REQUEST_HEADER;
+  this->pending_.count = 0;
+  this->pending_.channels[0] = index;
+  this->parser_.reset();
+  this->last_request_time_ = now;
+  ESP_LOGD(TAG, "Header-Wechsel: ATSH%s", target);
+  this->send_command(cmd);
+}
+
+void ELM327Protocol::handle_header_reply(const ELM327Response &response, uint32_t now) {
+  int index = this->pending_.channels[0];
+  this->pending_.kind = REQUEST_NONE;
+  if (response.status != RESPONSE_OK || strcmp(response.text, "OK") != 0) {
+    // Nicht endlos wiederholen: Eintrag wie bei fehlenden Antworten zurückstellen
+    ESP_LOGW(TAG, "ATSH%s abgelehnt: %s", this->header_target_.c_str(), response.raw);
+    if (index < 0) {
+      this->finish_command(nullptr, now);
+      return;
+    }
+    PollSchedule &schedule = this->schedule_for(index);
+    schedule.next_due = now + std::max(schedule.update_interval, BACKOFF_MAX_MS);
+    return;
+  }
+  this->current_header_ = this->header_target_;
+  this->header_since_ = now;
+  this->header_switches_++;
+  // Anfrage, für die umgeschaltet wurde, sofort senden (request_interval gilt nicht für ATSH)
+  if (index < 0) {
+    this->send_queued_command(now);
+  } else {
+    this->request_next(now);
+  }
+}
+
+// Ist irgendein Eintrag fällig? (ohne Allokation, wird im Monitor-Betrieb laufend geprüft)
+bool ELM327Protocol::has_due_entry(uint32_t now) {
+  int total = this->schedule_count();
+  for (int i = 0; i < total; i++) {
+    if (this->in_profile(i) && poll_score(this->schedule_for(i), now) >= 0)
+      return true;
+  }
+  return false;
+}
+
+// Zeitpunkt für die Fälligkeit. Mit CAN-Monitor wird jede Abfragerunde begrenzt:
+// nur was bei ihrem Beginn fällig war, danach geht es zurück zum Monitor.
+uint32_t ELM327Protocol::poll_time(uint32_t now) const {
+  return this->monitor_enabled_ ? this->poll_round_start_ - 1 : now;
+}
+
+// Reihenfolge der geplanten Einträge: entries_, DTC-Abfrage (falls aktiv), Fahrzeug-Infos
+PollSchedule &ELM327Protocol::schedule_for(int index) {
+  if (index < (int) this->entries_.size())
+    return this->entries_[index].schedule;
+  int info = this->info_slot(index);
+  return info >= 0 ? this->info_[info].schedule : this->dtc_schedule_;
+}
+
+int ELM327Protocol::schedule_count() const {
+  return this->entries_.size() + (this->dtc_enabled_ ? 1 : 0) + this->info_.size();
+}
+
+// Index in info_, -1 = kein Info-Eintrag
+int ELM327Protocol::info_slot(int index) const {
+  int info = index - (int) this->entries_.size() - (this->dtc_enabled_ ? 1 : 0);
+  return info >= 0 && info < (int) this->info_.size() ? info : -1;
+}
+
+// ISO 15765-4 (CAN) = ATDPN 6-C; unbekannt gilt als CAN
+bool ELM327Protocol::is_can_protocol() const {
+  return this->known_protocol_ == 0 || this->known_protocol_ >= '6';
+}
+
+// Ergänzt die Anfrage in pending_ (enthält bereits den ausgewählten Eintrag) um weitere
+// fällige Mode-01-PIDs in der Reihenfolge ihrer Dringlichkeit.
+void ELM327Protocol::collect_pid_batch(uint32_t now) {
+  PendingRequest &request = this->pending_;
+  if (!this->is_batchable(request.channels[0]))
+    return;
+  while (request.count < MAX_PIDS_PER_REQUEST) {
+    int next = this->select_next_entry(now, SELECT_BATCH);
+    if (next < 0)
+      break;
+    request.answered[request.count] = false;
+    request.replies[request.count] = 0;
+    request.channels[request.count++] = next;
+  }
+}
+
+// Mode-01-PID mit bekannter Länge für dasselbe Steuergerät wie der erste Eintrag in pending_
+bool ELM327Protocol::is_batchable(int index) const {
+  const auto &config = this->entries_[index].config;
+  return !config.is_at_command && config.mode == 0x01 &&
+         config.header == this->entries_[this->pending_.channels[0]].config.header &&
+         this->entries_[index].descriptor.length != 0;
+}
+
+bool ELM327Protocol::is_batch_candidate(int index) const {
+  const PendingRequest &request = this->pending_;
+  for (uint8_t i = 0; i < request.count; i++) {
+    if (request.channels[i] == index)
+      return false;
+  }
+  return this->is_batchable(index);
+}
+
+// ============================================================
+// Gelernte Antwortzeiten
+// ============================================================
+// Timeout der offenen Anfrage aus den gelernten Antwortzeiten ihrer Kanäle. Ohne genug
+// Messungen (und für DTC, Fahrzeug-Info, Befehle) gilt request_timeout, es ist auch die
+// Obergrenze. Eine PID-Anfrage wird nie vor dem "NO DATA" des Adapters (ATST) abgebrochen.
+uint32_t ELM327Protocol::pending_timeout() const {
+  const PendingRequest &request = this->pending_;
+  if (!this->adaptive_timing_ || (request.kind != REQUEST_PID && request.kind != REQUEST_AT) || request.count == 0)
+    return this->request_timeout_;
+  uint32_t timeout = 0;
+  for (uint8_t i = 0; i < request.count; i++) {
+    const ResponseTime &timing = this->entries_[request.channels[i]].timing;
+    if (!timing.is_known())
+      return this->request_timeout_;
+    timeout = std::max(timeout, timing.upper());
+  }
+  if (request.kind == REQUEST_PID)
+    timeout = std::max(timeout, this->get_adapter_timeout());
+  return std::min(timeout + TIMING_MARGIN_MS, this->request_timeout_);
+}
+
+// Wartezeit des Adapters an die gemessenen Antwortzeiten anpassen: ATST knapp über der
+// langsamsten (spart bei NO DATA die 200 ms nach ATZ), ATAT2 statt ATAT1 solange alle
+// gleichmäßig antworten. Rückgabe true = ATAT/ATST gesendet.
+bool ELM327Protocol::update_adapter_timing(uint32_t now) {
+  if (!this->adaptive_timing_ || this->timing_rejected_)
+    return false;
+  uint32_t slowest = 0;
+  bool steady = true;
+  for (const auto &entry : this->entries_) {
+    if (entry.config.is_at_command || entry.config.is_can_signal || entry.schedule.disabled)
+      continue;
+    // Selten abgefragte PIDs zählen erst mit genug Messungen, sonst bläht die geschätzte
+    // Abweichung der ersten Antworten den Timeout auf
+    const ResponseTime &timing = entry.timing;
+    if (!timing.is_known())
+      continue;
+    slowest = std::max(slowest, timing.upper());
+    // Hysterese, damit ATAT bei Abweichungen um die Grenze nicht ständig wechselt
+    float limit = this->adaptive_mode_ == 2 ? 2.0f : 4.0f;
+    steady &= timing.deviation * limit <= timing.mean;
+  }
+  if (slowest == 0 && this->timing_hold_ == 0)
+    return false;
+
+  // Gemessen wird die Rundreise inkl. BLE, sie ist länger als die Antwortzeit des Steuergeräts
+  uint32_t wanted = (slowest * 3 / 2 + ADAPTER_TIMEOUT_UNIT_MS - 1) / ADAPTER_TIMEOUT_UNIT_MS;
+  uint8_t timeout = std::max<uint32_t>(std::min<uint32_t>(wanted, 0xFF), ATST_MIN);
+  uint8_t mode = steady ? 2 : 1;
+  bool hold = this->timing_hold_ > 0;
+  if (hold) {
+    // Nach ausgebliebenen Antworten nur verlängern, ATAT2 erst wieder mit stabiler Schätzung
+    mode = 1;
+    timeout = std::max(timeout, this->timing_floor_);
+  }
+  char cmd[8];
+  PendingRequest &request = this->pending_;
+  if (mode != this->adaptive_mode_) {
+    snprintf(cmd, sizeof(cmd), "ATAT%u\r", mode);
+    request.channels[0] = mode;
+    request.channels[1] = 0;
+  } else if (hold ? timeout > this->adapter_timeout_
+                  : abs((int) timeout - (int) this->adapter_timeout_) * 4 > this->adapter_timeout_) {
+    // Erst ab 25 % Unterschied, kleine Schwankungen lösen keinen Befehl aus
+    snprintf(cmd, sizeof(cmd), "ATST%02X\r", timeout);
+    request.channels[0] = timeout;
+    request.channels[1] = 1;
+  } else {
+    return false;
+  }
+  request.kind = REQUEST_TIMING;
+  request.count = 0;
+  this->parser_.reset();
+  this->last_request_time_ = now;
+  ESP_LOGD(TAG, "Adapter-Timing: %.*s (langsamste Antwort %u ms)", (int) strlen(cmd) - 1, cmd, (unsigned) slowest);
+  this->send_command(cmd);
+  return true;
+}
+
+// Ein PID, der schon geantwortet hat, bleibt stumm: ATST war zu knapp (NO DATA) oder die
+// Antwort ging verloren. ATST verdoppeln (höchstens auf den Wert nach ATZ) und ATAT1, bis
+// TIMING_HOLD_RESPONSES PID-Antworten in Folge kamen. Im Stand antworten die Steuergeräte
+// ohnehin nicht, das sagt nichts über ihre Antwortzeit.
+void ELM327Protocol::back_off_adapter_timing() {
+  if (!this->adaptive_timing_ || this->timing_rejected_ || this->profile_ != PROFILE_RUNNING)
+    return;
+  uint32_t floor = std::max<uint32_t>(this->adapter_timeout_ * 2u, this->timing_floor_);
+  this->timing_floor_ = std::min<uint32_t>(floor, ATST_DEFAULT);
+  if (this->timing_hold_ == 0)
+    ESP_LOGD(TAG, "Adapter-Timing: Antwort ausgeblieben, ATST mindestens %02X, ATAT1", this->timing_floor_);
+  this->timing_hold_ = TIMING_HOLD_RESPONSES;
+}
+
+void ELM327Protocol::handle_timing_reply(const ELM327Response &response, uint32_t now) {
+  PendingRequest &request = this->pending_;
+  request.kind = REQUEST_NONE;
+  if (response.status != RESPONSE_OK || strcmp(response.text, "OK") != 0) {
+    ESP_LOGW(TAG, "ATAT/ATST abgelehnt (%s), Wartezeit des Adapters bleibt unveraendert", response.raw);
+    this->timing_rejected_ = true;
+    return;
+  }
+  if (request.channels[1]) {
+    this->adapter_timeout_ = request.channels[0];
+    ESP_LOGI(TAG, "Adapter wartet hoechstens %u ms auf das Steuergeraet (ATST%02X)",
+             (unsigned) this->get_adapter_timeout(), this->adapter_timeout_);
+  } else {
+    this->adaptive_mode_ = request.channels[0];
+    ESP_LOGI(TAG, "Adaptives Timing ATAT%u", this->adaptive_mode_);
+  }
+  // Wie nach ATSH geht die eigentliche Anfrage sofort raus
+  this->request_next(now);
+}
+
+// Anfrage in der schnellsten Syntax, die der Adapter kann. STN: Header per STPX statt
+// ATSH-Umschaltung; sonst die Anzahl erwarteter Antworten als letzte Ziffer ("010C1"),
+// damit der Adapter nicht bis zu seinem Timeout auf weitere Steuergeräte wartet.
+// responses = 0: unbekannt, ohne Anzahl senden.
+void ELM327Protocol::format_request(char (&out)[MAX_WRITE_LENGTH + 1], const char *data, size_t len,
+                                    const std::string &header, uint8_t responses) {
+  responses = std::min<uint8_t>(responses, 15);
+  char count[8] = "";
+  if (this->adapter_.stpx && !header.empty()) {
+    if (responses > 0)
+      snprintf(count, sizeof(count), ", R:%u", responses);
+    this->pending_.syntax = SYNTAX_STPX;
+    snprintf(out, sizeof(out), "STPX H:%s, D:%.*s%s\r", header.c_str(), (int) len, data, count);
+    return;
+  }
+  if (responses > 0 && this->adapter_.response_count) {
+    snprintf(count, sizeof(count), "%X", responses);
+    this->pending_.syntax = SYNTAX_COUNT;
+  }
+  snprintf(out, sizeof(out), "%.*s%s\r", (int) len, data, count);
+}
+
+// Klone melden oft eine höhere Version, als sie können: "?" auf die schnelle Syntax
+// schaltet sie ab, die Anfrage wird sofort in der einfachen Form wiederholt
+void ELM327Protocol::reject_syntax(uint32_t now) {
+  if (this->pending_.syntax == SYNTAX_STPX) {
+    ESP_LOGW(TAG, "STPX abgelehnt, Steuergeraete werden per ATSH umgeschaltet");
+    this->adapter_.stpx = false;
+  } else {
+    ESP_LOGW(TAG, "Anzahl erwarteter Antworten abgelehnt, Anfragen ohne Anzahl");
+    this->adapter_.response_count = false;
+  }
+  for (uint8_t i = 0; this->pending_.kind == REQUEST_PID && i < this->pending_.count; i++)
+    this->entries_[this->pending_.channels[i]].schedule.next_due = now - 1;
+  // Ein Befehl aus der Warteschlange bleibt in command_ und wird im nächsten loop() erneut gesendet
+  this->pending_.kind = REQUEST_NONE;
+  if (this->listener_ != nullptr)
+    this->listener_->on_session_info();
+}
+
+// ============================================================
+// Einmalige Befehle (Aktionen)
+// ============================================================
+// Befehle an den Adapter selbst, unabhängig vom Header
+static bool is_adapter_command(const std::string &command) {
+  return command.compare(0, 2, "AT") == 0 || command.compare(0, 2, "ST") == 0;
+}
+
+// Nur Abfragen zulassen: OBD-Anfragen als Hex und AT-Befehle, die nichts am Adapter
+// verstellen. ATZ, ATH1, ATSH usw. würden den Zustand ändern, von dem der Kern ausgeht.
+// Dieselbe Liste steht in __init__.py (Prüfung beim Konfigurieren), make -C host vergleicht beide.
+static const char *const READ_ONLY_COMMANDS[] = {"ATRV", "ATI", "AT@1", "ATDP", "ATDPN", "ATIGN", "STI", "STDI"};
+
+static bool is_allowed_command(const std::string &command) {
+  if (command.empty() || command.size() > ELM327Protocol::MAX_COMMAND_LENGTH)
+    return false;
+  if (is_adapter_command(command)) {
+    for (const char *allowed : READ_ONLY_COMMANDS) {
+      if (command == allowed)
+        return true;
+    }
+    return false;
+  }
+  if (command.size() % 2 != 0)
+    return false;
+  return std::all_of(command.begin(), command.end(), [](char c) { return isxdigit((unsigned char) c) != 0; });
+}
+
+bool ELM327Protocol::queue_command(const std::string &command, uint8_t priority, const std::string &header) {
+  std::string cmd;
+  for (char c : command) {
+    if (c != ' ' && c != '\r' && c != '\n')
+      cmd += (char) toupper((unsigned char) c);
+  }
+  if (!is_allowed_command(cmd)) {
+    ESP_LOGW(TAG, "Befehl '%s' abgelehnt (nur OBD-Abfragen und lesende AT-Befehle)", cmd.c_str());
+    return false;
+  }
+  if (header.size() > MAX_HEADER_LENGTH) {
+    ESP_LOGW(TAG, "Befehl %s abgelehnt, Header '%s' zu lang", cmd.c_str(), header.c_str());
+    return false;
+  }
+  if (this->state_ == STATE_IDLE) {
+    ESP_LOGW(TAG, "Befehl %s verworfen, Adapter nicht verbunden", cmd.c_str());
+    return false;
+  }
+  if (this->commands_.size() >= MAX_QUEUED_COMMANDS) {
+    ESP_LOGW(TAG, "Befehl %s verworfen, Warteschlange voll", cmd.c_str());
+    return false;
+  }
+  std::string target;
+  for (char c : header)
+    target += (char) toupper((unsigned char) c);
+  auto pos = std::find_if(this->commands_.begin(), this->commands_.end(),
+                          [priority](const QueuedCommand &queued) { return queued.priority < priority; });
+  this->commands_.insert(pos, QueuedCommand{cmd, target, priority});
+  ESP_LOGD(TAG, "Befehl %s eingereiht (Prioritaet %u, %u wartend)", cmd.c_str(), priority,
+           (unsigned) this->commands_.size());
+  return true;
+}
+
+// Nächsten Befehl aus der Warteschlange senden, ggf. erst den Header umschalten
+void ELM327Protocol::send_queued_command(uint32_t now) {
+  if (this->command_.empty()) {
+    this->command_ = std::move(this->commands_.front().command);
+    this->command_header_ = std::move(this->commands_.front().header);
+    this->commands_.erase(this->commands_.begin());
+  }
+  bool adapter = is_adapter_command(this->command_);
+  bool stpx = !adapter && this->adapter_.stpx && !this->command_header_.empty();
+  if (!adapter && !stpx && this->command_header_ != this->current_header_) {
+    this->send_header(this->command_header_, -1, now);  // Befehl folgt auf das "OK"
+    return;
+  }
+  this->pending_.kind = REQUEST_COMMAND;
+  this->pending_.syntax = SYNTAX_PLAIN;
+  this->pending_.count = 0;
+  this->pending_.mode = adapter ? 0 : (uint8_t) strtoul(this->command_.substr(0, 2).c_str(), nullptr, 16);
+  this->parser_.reset();
+  this->last_request_time_ = now;
+  ESP_LOGD(TAG, "Befehl gesendet: %s", this->command_.c_str());
+  char cmd[MAX_WRITE_LENGTH + 1];
+  if (stpx) {
+    this->format_request(cmd, this->command_.c_str(), this->command_.size(), this->command_header_, 0);
+  } else {
+    snprintf(cmd, sizeof(cmd), "%s\r", this->command_.c_str());
+  }
+  this->send_command(cmd);
+}
+
+// Ergebnis an den Listener, response = nullptr ohne Antwort
+void ELM327Protocol::finish_command(const ELM327Response *response, uint32_t now) {
+  this->pending_.kind = REQUEST_NONE;
+  std::string command;
+  command.swap(this->command_);
+  bool ok = response != nullptr && response->status == RESPONSE_OK;
+  if (ok && this->pending_.mode == 0x04) {
+    // Nach dem Löschen den DTC-Sensor sofort aktualisieren
+    ESP_LOGI(TAG, "Fehlerspeicher geloescht");
+    this->dtc_schedule_.next_due = now - 1;
+  } else if (ok && this->pending_.mode == 0x03 && command.size() == 2 && this->current_header_.empty()) {
+    // Funktional gelesen = vollständige Liste, ersetzt die nächste reguläre Abfrage
+    this->parse_dtc_response(*response);
+    this->dtc_schedule_.next_due = now + this->dtc_schedule_.update_interval;
+  }
+  if (this->listener_ != nullptr)
+    this->listener_->on_command_result(command, response);
+}
+
+// Verbindung getrennt: offene und wartende Befehle ohne Ergebnis beenden
+void ELM327Protocol::abort_commands() {
+  if (!this->command_.empty())
+    this->finish_command(nullptr, 0);
+  std::vector<QueuedCommand> queued;
+  queued.swap(this->commands_);
+  for (const auto &entry : queued) {
+    if (this->listener_ != nullptr)
+      this->listener_->on_command_result(entry.command, nullptr);
+  }
+}
+
+// ============================================================
+// Antwort-Verarbeitung
+// ============================================================
+void ELM327Protocol::process_response(const ELM327Response &response, uint32_t now) {
+  ESP_LOGD(TAG, "Antwort: %s", response.raw);
+  this->response_time_ = now;
+  if (response.overflow)
+    ESP_LOGW(TAG, "Antwort zu lang, wurde gekuerzt");
+  if (response.incomplete)
+    ESP_LOGW(TAG, "Multiframe-Antwort unvollstaendig, verworfen");
+
+  if (this->listener_ != nullptr)
+    this->listener_->on_response(response);
+
+  // Verspätete Antwort nach Timeout o.ä.: keinem Sensor zuordenbar
+  if (!this->is_waiting()) {
+    ESP_LOGW(TAG, "Antwort ohne offene Anfrage verworfen: %s", response.raw);
+    return;
+  }
+  if (this->pending_.kind == REQUEST_MONITOR) {
+    this->handle_monitor_reply(response, now);
+    return;
+  }
+  if (this->pending_.kind == REQUEST_HEADER) {
+    this->handle_header_reply(response, now);
+    return;
+  }
+  if (this->pending_.kind == REQUEST_POWER) {
+    this->handle_power_reply(&response, now);
+    return;
+  }
+  if (this->pending_.kind == REQUEST_TIMING) {
+    this->handle_timing_reply(response, now);
+    return;
+  }
+  if (this->pending_.syntax != SYNTAX_PLAIN && response.status == RESPONSE_ERROR && strcmp(response.text, "?") == 0) {
+    this->reject_syntax(now);
+    return;
+  }
+  this->record_stats(&response, now);
+  if (this->pending_.kind == REQUEST_COMMAND) {
+    this->finish_command(&response, now);
+    return;
+  }
+
+  // Fehler ignorieren, angefragte PIDs zählen als unbeantwortet
+  if (response.status != RESPONSE_OK) {
+    ESP_LOGW(TAG, "Fehler/Keine Daten: %s", response.raw);
+    this->finish_pending(now);
+    return;
+  }
+
+  // Die offene Anfrage bestimmt den Decoder, nicht der Inhalt der Antwort
+  switch (this->pending_.kind) {
+    case REQUEST_AT:
+      this->parse_at_response(response);
+      break;
+    case REQUEST_DTC:
+      this->parse_dtc_response(response);
+      break;
+    case REQUEST_INFO:
+      this->parse_info_response(response);
+      break;
+    case REQUEST_PID:
+      // ggf. eine Nachricht pro Steuergerät bzw. Zeile
+      for (size_t i = 0; i < response.message_count; i++)
+        this->parse_pid_message(response.message(i), response.message_length(i), response.sender(i));
+      break;
+    default:
+      break;
+  }
+  if (this->engine_seen_) {
+    this->engine_seen_ = false;
+    this->engine_activity_ = now;
+    if (this->profile_ == PROFILE_PARKED)
+      this->set_profile(PROFILE_RUNNING, now);
+  }
+  this->finish_pending(now);
+}
+
+// Ergebnis der offenen Anfrage in die Gesamt- und Kanal-Statistik, response = nullptr bei Timeout
+void ELM327Protocol::record_stats(const ELM327Response *response, uint32_t now) {
+  uint32_t latency = now - this->last_request_time_;
+  auto record = [response, latency](RequestStats &stats) {
+    if (response == nullptr) {
+      stats.timeouts++;
+      return;
+    }
+    stats.latency.add(latency);
+    stats.responses++;
+    if (response->status == RESPONSE_NO_DATA) {
+      stats.no_data++;
+    } else if (response->status == RESPONSE_ERROR) {
+      stats.errors++;
+    }
+  };
+  record(this->stats_);
+  // DTC- und Info-Abfragen haben keinen Kanal
+  bool channels = this->pending_.kind == REQUEST_PID || this->pending_.kind == REQUEST_AT;
+  bool ok = response != nullptr && response->status == RESPONSE_OK;
+  bool silent = false;
+  for (uint8_t i = 0; channels && i < this->pending_.count; i++) {
+    PIDEntry &entry = this->entries_[this->pending_.channels[i]];
+    record(entry.stats);
+    if (ok) {
+      entry.timing.add(latency);
+    } else if (this->pending_.kind == REQUEST_PID && entry.timing.is_known() &&
+               (response == nullptr || response->status == RESPONSE_NO_DATA)) {
+      // Hat schon geantwortet, jetzt NO DATA bzw. gar nichts: Antwortzeit über der Wartezeit
+      // des Adapters. Nicht in die Schätzung, die Latenz endet ja an ATST und würde es
+      // immer weiter hochtreiben, stattdessen back_off_adapter_timing().
+      silent = true;
+    }
+  }
+  if (silent) {
+    this->back_off_adapter_timing();
+  } else if (ok && this->pending_.kind == REQUEST_PID && this->timing_hold_ > 0 && --this->timing_hold_ == 0) {
+    this->timing_floor_ = 0;
+    ESP_LOGD(TAG, "Adapter-Timing: Antworten wieder stabil");
+  }
+}
+
+void ELM327Protocol::reset_stats_window() {
+  this->stats_.reset_window();
+  for (auto &entry : this->entries_)
+    entry.stats.reset_window();
+}
+
+// Angefragte PIDs ohne Wert in der Antwort: nach mehreren Fehlversuchen in
+// Folge exponentiell seltener abfragen, statt jede Runde auf NO DATA zu warten
+void ELM327Protocol::finish_pending(uint32_t now) {
+  PendingRequest &request = this->pending_;
+  for (uint8_t i = 0; request.kind == REQUEST_PID && i < request.count; i++) {
+    const PIDEntry &entry = this->entries_[request.channels[i]];
+    PollSchedule &schedule = this->entries_[request.channels[i]].schedule;
+    if (request.answered[i]) {
+      if (request.replies[i] > entry.responders) {
+        ESP_LOGD(TAG, "PID 0x%02X: %u antwortende Steuergeraete", entry.config.pid, request.replies[i]);
+        this->entries_[request.channels[i]].responders = request.replies[i];
+      }
+      if (schedule.failures >= BACKOFF_AFTER_FAILURES)
+        ESP_LOGI(TAG, "PID 0x%02X antwortet wieder", entry.config.pid);
+      schedule.failures = 0;
+      continue;
+    }
+    if (schedule.failures < 255)
+      schedule.failures++;
+    if (schedule.failures < BACKOFF_AFTER_FAILURES)
+      continue;
+    uint8_t shift = std::min<uint8_t>(schedule.failures - BACKOFF_AFTER_FAILURES, 6);
+    uint32_t backoff = std::min<uint32_t>(BACKOFF_MIN_MS << shift, BACKOFF_MAX_MS);
+    schedule.next_due = now + std::max(schedule.update_interval, backoff);
+    ESP_LOGW(TAG, "PID 0x%02X antwortet nicht (%u Fehlversuche), naechster Versuch in %u ms", entry.config.pid,
+             schedule.failures, (unsigned) std::max(schedule.update_interval, backoff));
+  }
+  request.kind = REQUEST_NONE;
+}
+
+// ============================================================
+// OBD2 PID Parsing
+// ============================================================
+// Eine Nachricht auf eine PID-Anfrage: "4x PID A [B...] PID A [B...] ...".
+// Es werden nur angefragte PIDs veröffentlicht, die Länge kommt aus deren Deskriptor.
+// sender = CAN-ID des antwortenden Steuergeräts mit ATH1, sonst 0
+void ELM327Protocol::parse_pid_message(const uint8_t *data, size_t len, uint32_t sender) {
+  PendingRequest &request = this->pending_;
+  uint8_t header = 0x40 + request.mode;
+  if (len >= 3 && data[0] == 0x7F) {
+    // Negative Antwort, z.B. 7F 22 31 = DID nicht vorhanden (0x78 = Antwort folgt noch)
+    if (data[2] != 0x78)
+      ESP_LOGW(TAG, "Negative Antwort auf Mode 0x%02X: NRC 0x%02X", data[1], data[2]);
+    return;
+  }
+  if (len < 2 || data[0] != header) {
+    ESP_LOGW(TAG, "Unerwartete Antwort 0x%02X statt 0x%02X, verworfen", len > 0 ? data[0] : 0, header);
+    return;
+  }
+
+  // Mode 22: 16-Bit-DID, sonst 1 Byte PID
+  size_t id_len = request.mode == 0x22 ? 2 : 1;
+  size_t off = 1;
+  while (off + id_len < len) {
+    uint16_t pid = id_len == 2 ? (data[off] << 8) | data[off + 1] : data[off];
+    size_t remaining = len - off - id_len;
+    size_t count = 0;
+    bool requested = false;
+    for (uint8_t i = 0; i < request.count; i++) {
+      const PIDEntry &entry = this->entries_[request.channels[i]];
+      if (entry.config.pid != pid)
+        continue;
+      // Unbekannte Länge: nur als einzelner PID auswertbar
+      count = entry.descriptor.length != 0 ? entry.descriptor.length : (request.count == 1 ? remaining : 0);
+      requested = true;
+      break;
+    }
+    if (!requested) {
+      ESP_LOGW(TAG, "PID 0x%02X nicht angefragt, Rest der Antwort verworfen", pid);
+      return;
+    }
+    if (count == 0 || count > remaining) {
+      ESP_LOGW(TAG, "PID 0x%02X: Antwort zu kurz", pid);
+      return;
+    }
+
+    // Alle Kanäle mit diesem PID bedienen (mehrere Sensoren auf denselben PID)
+    for (uint8_t i = 0; i < request.count; i++) {
+      if (this->entries_[request.channels[i]].config.pid != pid)
+        continue;
+      request.replies[i]++;
+      if (request.answered[i] || !this->accept_sender(request.channels[i], sender))
+        continue;
+      request.answered[i] = true;
+      this->publish_pid_value(request.channels[i], data + off + id_len);
+    }
+    off += id_len + count;
+  }
+}
+
+// Antworten mehrere Steuergeräte auf dieselbe Anfrage, zählt nur das konfigurierte bzw.
+// das zuerst gesehene (der Parser sortiert nach CAN-ID, also meist das Motorsteuergerät).
+// Ohne Header (sender = 0) ist keine Unterscheidung möglich.
+bool ELM327Protocol::accept_sender(int channel, uint32_t sender) {
+  PIDEntry &entry = this->entries_[channel];
+  if (sender == 0)
+    return true;
+  if (entry.config.ecu != 0)
+    return sender == entry.config.ecu;
+  if (entry.sender == 0) {
+    entry.sender = sender;
+    ESP_LOGD(TAG, "PID 0x%02X: Werte von Steuergeraet %X", entry.config.pid, (unsigned) sender);
+  }
+  return sender == entry.sender;
+}
+
+void ELM327Protocol::publish_pid_value(int channel, const uint8_t *data) {
+  const PIDEntry &entry = this->entries_[channel];
+  uint16_t pid = entry.config.pid;
+  float value;
+  if (entry.formula != nullptr) {
+    value = entry.formula(data);
+  } else {
+    value = decode_pid_value(entry.descriptor, data);
+    if (entry.descriptor.formula == FORMULA_RAW || entry.descriptor.formula == FORMULA_BITMAP)
+      ESP_LOGD(TAG, "PID 0x%02X: generisch A=%d", pid, data[0]);
+  }
+
+  ESP_LOGD(TAG, "PID 0x%02X = %.2f", pid, value);
+  if (entry.config.mode == 0x01)
+    this->trip_.add_sample(pid, value, this->response_time_);
+  if (this->listener_ == nullptr)
+    return;
+  this->listener_->on_value(channel, value);
+
+  // Motor-Lauf-Status aktualisieren (basierend auf RPM)
+  if (pid == 0x0C && entry.config.mode == 0x01) {
+    this->listener_->on_engine_running(value > 0);
+    this->engine_seen_ |= value > 0;
+  }
+}
+
+// ============================================================
+// DTC Parsing
+// ============================================================
+void ELM327Protocol::parse_dtc_response(const ELM327Response &response) {
+  if (!this->dtc_enabled_) return;
+
+  std::string dtc_list;
+  int dtc_count = 0;
+  bool can = this->is_can_protocol();
+
+  // Eine Nachricht pro Steuergerät (bzw. pro Zeile bei älteren Protokollen)
+  for (size_t m = 0; m < response.message_count; m++) {
+    const uint8_t *data = response.message(m);
+    size_t len = response.message_length(m);
+    if (data[0] != 0x43) {
+      ESP_LOGW(TAG, "Unerwartete Antwort 0x%02X auf DTC-Abfrage, verworfen", data[0]);
+      continue;
+    }
+
+    // CAN: "43 NN" + NN DTCs à 2 Bytes. Ältere Protokolle: 3 DTCs pro Zeile, mit 0000 aufgefüllt.
+    size_t start = 1;
+    size_t end = len;
+    if (can && len >= 2) {
+      start = 2;
+      end = std::min(len, start + 2 * (size_t) data[1]);
+    }
+    for (size_t i = start; i + 1 < end; i += 2) {
+      if (data[i] == 0 && data[i + 1] == 0) continue;
+
+      char dtc_code[6];
+      decode_dtc(data[i], data[i + 1], dtc_code);
+      // Von mehreren Steuergeräten gemeldete Codes nur einmal aufführen
+      if (dtc_list.find(dtc_code) != std::string::npos) continue;
+      if (!dtc_list.empty()) dtc_list += ", ";
+      dtc_list += dtc_code;
+      dtc_count++;
+    }
+  }
+
+  ESP_LOGD(TAG, "DTCs (%d): %s", dtc_count, dtc_list.c_str());
+  if (this->listener_ != nullptr)
+    this->listener_->on_dtc(dtc_count == 0 ? "Keine Fehler" : dtc_list);
+}
+
+// ============================================================
+// Fahrzeug-Informationen (Mode 09)
+// ============================================================
+void ELM327Protocol::parse_info_response(const ELM327Response &response) {
+  VehicleInfo &info = this->info_[this->pending_.channels[0]];
+
+  // Nutzdaten sammeln. CAN: "49 PID NN Daten..." als eine Nachricht pro Steuergerät.
+  // Ältere Protokolle: je Zeile "49 PID Nr. AA BB CC DD", die Zeilen werden aneinandergehängt.
+  uint8_t payload[ELM327Response::MAX_DATA];
+  size_t payload_len = 0;
+  std::string value;
+  // VIN: 17 Zeichen. Sonst mehrere Einträge fester Länge (Kalibrierungs-IDs à 16, Name 20 Bytes).
+  size_t item_len = info.pid == 0x02 ? 0 : info.pid == 0x0A ? 20 : 16;
+  auto append_items = [&value, item_len](const uint8_t *data, size_t len) {
+    size_t step = item_len != 0 ? item_len : len;
+    for (size_t pos = 0; pos < len; pos += step) {
+      std::string item;
+      for (size_t i = pos; i < pos + step && i < len; i++) {
+        if (data[i] > 0x20 && data[i] < 0x7F)
+          item += (char) data[i];  // Füllbytes (0x00) und Leerzeichen auslassen
+      }
+      if (item.empty() || value.find(item) != std::string::npos)
+        continue;
+      if (!value.empty())
+        value += ", ";
+      value += item;
+    }
+  };
+
+  bool can = this->is_can_protocol();
+  for (size_t m = 0; m < response.message_count; m++) {
+    const uint8_t *data = response.message(m);
+    size_t len = response.message_length(m);
+    if (len < 4 || data[0] != 0x49 || data[1] != info.pid) {
+      ESP_LOGW(TAG, "Unerwartete Antwort auf 09%02X, verworfen", info.pid);
+      continue;
+    }
+    if (can) {
+      append_items(data + 3, len - 3);
+    } else {
+      size_t n = std::min(len - 3, sizeof(payload) - payload_len);
+      memcpy(payload + payload_len, data + 3, n);
+      payload_len += n;
+    }
+  }
+  if (payload_len > 0)
+    append_items(payload, payload_len);
+
+  if (info.pid == 0x02) {
+    // Erste gültige VIN (mehrere Steuergeräte melden dieselbe)
+    value = value.substr(0, value.find(','));
+    if (value.size() > 17)
+      value = value.substr(value.size() - 17);
+    if (value.size() != 17) {
+      ESP_LOGW(TAG, "Ungueltige VIN: %s", value.c_str());
+      return;
+    }
+  }
+  if (value.empty())
+    return;
+
+  ESP_LOGI(TAG, "Fahrzeug-Info 09%02X: %s", info.pid, value.c_str());
+  info.value = value;
+  info.schedule.disabled = true;
+  if (this->listener_ != nullptr)
+    this->listener_->on_vehicle_info(this->pending_.channels[0], value);
+}
+
+// Zwei DTC-Bytes → Code, z.B. 0x01 0x23 → "P0123"
+void ELM327Protocol::decode_dtc(uint8_t a, uint8_t b, char *out) {
+  static const char PREFIX[] = {'P', 'C', 'B', 'U'};
+  snprintf(out, 6, "%c%X%X%02X", PREFIX[a >> 6], (a >> 4) & 0x03, a & 0x0F, b);
+}
+
+// ============================================================
+// AT-Befehle mit Zahlenwert (ATRV → "12.4V")
+// ============================================================
+void ELM327Protocol::parse_at_response(const ELM327Response &response) {
+  int channel = this->pending_.channels[0];
+  char *end = nullptr;
+  float value = strtof(response.text, &end);
+  if (end == response.text) {
+    ESP_LOGW(TAG, "%s: keine Zahl in der Antwort: %s", this->entries_[channel].config.command.c_str(), response.raw);
+    return;
+  }
+  // Batteriespannung plausibilisieren
+  if (channel == this->voltage_channel_) {
+    if (!(value > 0 && value < 20))
+      return;
+    ESP_LOGD(TAG, "Batterie: %.1f V", value);
+    this->engine_seen_ |= this->profiles_.enabled && value >= this->profiles_.running_voltage;
+  }
+  this->pending_.answered[0] = true;
+  if (this->listener_ != nullptr)
+    this->listener_->on_value(channel, value);
+}
+
+// ============================================================
+// Abfrageprofile (Motor läuft / Stand / Adapter schläft)
+// ============================================================
+// Im Stand antworten die Steuergeräte meist nicht mehr, abgefragt werden nur noch
+// Befehle an den Adapter selbst (ATRV) und die Drehzahl als Startprobe
+bool ELM327Protocol::in_profile(int index) const {
+  if (!this->profiles_.enabled || this->profile_ == PROFILE_RUNNING)
+    return true;
+  if (this->profile_ == PROFILE_SLEEP || index >= (int) this->entries_.size())
+    return false;
+  const auto &config = this->entries_[index].config;
+  return config.is_at_command || (config.mode == 0x01 && config.pid == 0x0C && config.header.empty());
+}
+
+uint32_t ELM327Protocol::poll_interval(const PollSchedule &schedule) const {
+  if (this->profiles_.enabled && this->profile_ == PROFILE_PARKED)
+    return std::max(schedule.update_interval, this->profiles_.parked_interval);
+  return schedule.update_interval;
+}
+
+// true = der Adapter schläft bzw. ATLP oder die Weckprobe ist unterwegs
+bool ELM327Protocol::power_loop(uint32_t now) {
+  if (!this->profiles_.enabled)
+    return false;
+  if (this->pending_.kind == REQUEST_POWER) {
+    if (now - this->last_request_time_ >= this->request_timeout_)
+      this->handle_power_reply(nullptr, now);
+    return true;
+  }
+
+  switch (this->profile_) {
+    case PROFILE_RUNNING:
+      if (now - this->engine_activity_ >= this->profiles_.engine_off_delay)
+        this->set_profile(PROFILE_PARKED, now);
+      return false;
+
+    case PROFILE_PARKED:
+      if (this->profiles_.sleep_after == 0 || !this->sleep_supported_ || this->is_waiting() ||
+          this->has_command() || this->monitor_phase_ != MONITOR_OFF)
+        return false;
+      if (this->wake_check_) {
+        // Nach der Weckprobe nur Drehzahl und Spannung einmal abfragen, ohne Aktivität
+        // (sonst wäre das Profil schon "Motor laeuft") sofort wieder schlafen
+        if (this->has_due_entry(now))
+          return false;
+        ESP_LOGD(TAG, "Nach dem Aufwachen keine Motoraktivitaet, Adapter schlaeft wieder (ATLP)");
+        break;
+      }
+      if (now - this->profile_since_ < this->profiles_.sleep_after)
+        return false;
+      ESP_LOGI(TAG, "Motor seit %u s aus, Adapter geht in den Schlafmodus (ATLP)",
+               (unsigned) ((now - this->engine_activity_) / 1000));
+      break;
+
+    case PROFILE_SLEEP:
+      // Ein wartender Befehl weckt den Adapter sofort, er wird nach der Init gesendet
+      if (now - this->profile_since_ < this->profiles_.wake_interval && !this->has_command())
+        return true;
+      // Jedes Zeichen weckt den ELM327, er meldet sich danach wie nach ATZ
+      ESP_LOGD(TAG, "Weckprobe");
+      break;
+  }
+  this->pending_.kind = REQUEST_POWER;
+  this->pending_.count = 0;
+  this->parser_.reset();
+  this->last_request_time_ = now;
+  this->send_command(this->profile_ == PROFILE_SLEEP ? "\r" : "ATLP\r");
+  return true;
+}
+
+void ELM327Protocol::set_profile(PowerProfile profile, uint32_t now) {
+  if (profile == this->profile_)
+    return;
+  static const char *const NAMES[] = {"Motor laeuft", "Stand", "Schlafmodus"};
+  ESP_LOGI(TAG, "Abfrageprofil: %s", NAMES[profile]);
+  this->profile_ = profile;
+  this->profile_since_ = now;
+  this->wake_check_ = false;
+  if (profile == PROFILE_RUNNING) {
+    // Alles sofort abfragen, Fehlversuche aus dem Stand zählen nicht
+    for (auto &entry : this->entries_) {
+      entry.schedule.failures = 0;
+      entry.schedule.next_due = now - 1;
+    }
+    this->dtc_schedule_.next_due = now - 1;
+  }
+  if (profile != PROFILE_SLEEP && this->listener_ != nullptr)
+    this->listener_->on_engine_running(profile == PROFILE_RUNNING);
+}
+
+void ELM327Protocol::handle_power_reply(const ELM327Response *response, uint32_t now) {
+  this->pending_.kind = REQUEST_NONE;
+  if (this->profile_ == PROFILE_SLEEP) {
+    // Adapter ist nach dem Aufwachen zurückgesetzt → Init wiederholen (Schnellstart)
+    ESP_LOGD(TAG, "Adapter aufgeweckt, initialisiere neu");
+    this->waking_ = true;
+    this->start(now);
+    return;
+  }
+  if (response == nullptr || response->status != RESPONSE_OK || strcmp(response->text, "OK") != 0) {
+    ESP_LOGW(TAG, "ATLP nicht unterstuetzt, Adapter bleibt wach");
+    this->sleep_supported_ = false;
+    return;
+  }
+  this->sleep_count_++;
+  this->set_profile(PROFILE_SLEEP, now);
+}
+
+// ============================================================
+// CAN-Monitor (ATMA)
+// ============================================================
+// Zurücksetzen nach dem Monitor: automatische Empfangsfilter, CAN-Formatierung, Header aus
+static const char *const MONITOR_RESTORE_CMDS[] = {"ATAR\r", "ATCAF1\r", "ATH0\r"};
+static const uint8_t MONITOR_RESTORE_COUNT = sizeof(MONITOR_RESTORE_CMDS) / sizeof(MONITOR_RESTORE_CMDS[0]);
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+// true = der Monitor belegt den Adapter, keine PID-Abfragen senden
+bool ELM327Protocol::monitor_loop(uint32_t now) {
+  switch (this->monitor_phase_) {
+    case MONITOR_OFF:
+      // Abfragerunde beendet → Datenstrom starten
+      if (!this->monitor_enabled_ || this->is_waiting() || this->profile_ != PROFILE_RUNNING ||
+          this->has_command() || this->has_due_entry(this->poll_time(now)))
+        return false;
+      if (this->monitor_setup_.empty())
+        this->build_monitor_setup();
+      ESP_LOGD(TAG, "Starte CAN-Monitor");
+      this->monitor_phase_ = MONITOR_SETUP;
+      this->monitor_step_ = 0;
+      this->send_monitor_step(now);
+      return true;
+
+    case MONITOR_SETUP:
+    case MONITOR_RESTORE:
+      if (this->is_waiting() && now - this->last_request_time_ >= this->request_timeout_) {
+        ESP_LOGW(TAG, "CAN-Monitor: keine Antwort auf Schritt %u, mache weiter", this->monitor_step_ + 1);
+        this->pending_.kind = REQUEST_NONE;
+        this->monitor_step_++;
+        this->send_monitor_step(now);
+      }
+      return true;
+
+    case MONITOR_RUNNING:
+      // Nach der Mindestdauer für fällige PIDs/DTCs unterbrechen, für einmalige Befehle
+      // sofort (jedes Zeichen beendet ATMA)
+      if (this->has_command() || (now - this->monitor_since_ >= this->monitor_duration_ && this->has_due_entry(now))) {
+        ESP_LOGD(TAG, "CAN-Monitor: %u Frames, unterbreche fuer Abfragen", (unsigned) this->monitor_session_frames_);
+        this->monitor_phase_ = MONITOR_STOPPING;
+        this->monitor_since_ = now;
+        this->send_command("\r");
+      }
+      return true;
+
+    case MONITOR_STOPPING:
+      if (now - this->monitor_since_ >= this->request_timeout_) {
+        ESP_LOGW(TAG, "CAN-Monitor: kein Prompt nach dem Abbruch");
+        this->finish_monitor_stream(now);
+      }
+      return true;
+  }
+  return false;
+}
+
+// Setup-Befehle: Header an, CAN-Formatierung aus (alle 8 Datenbytes), Filter auf die
+// konfigurierten IDs, damit der Puffer des ELM327 nicht mit fremden Frames vollläuft
+void ELM327Protocol::build_monitor_setup() {
+  bool extended = false;
+  bool first_found = false;
+  uint32_t first = 0;
+  uint32_t differ = 0;
+  for (const auto &entry : this->entries_) {
+    if (!entry.config.is_can_signal)
+      continue;
+    if (!first_found) {
+      first = entry.config.can_id;
+      first_found = true;
+    }
+    differ |= first ^ entry.config.can_id;
+    extended |= entry.config.can_id > 0x7FF;
+  }
+
+  char cmd[20];
+  this->monitor_setup_ = {"ATH1\r", "ATCAF0\r"};
+  if (differ == 0) {
+    // Eine ID: exakter Filter
+    snprintf(cmd, sizeof(cmd), extended ? "ATCRA%08X\r" : "ATCRA%03X\r", (unsigned) first);
+    this->monitor_setup_.push_back(cmd);
+  } else {
+    // Mehrere IDs: Maske über alle gemeinsamen Bits, der Rest wird beim Parsen aussortiert
+    uint32_t mask = (extended ? 0x1FFFFFFF : 0x7FF) & ~differ;
+    snprintf(cmd, sizeof(cmd), extended ? "ATCF%08X\r" : "ATCF%03X\r", (unsigned) (first & mask));
+    this->monitor_setup_.push_back(cmd);
+    snprintf(cmd, sizeof(cmd), extended ? "ATCM%08X\r" : "ATCM%03X\r", (unsigned) mask);
+    this->monitor_setup_.push_back(cmd);
+  }
+  this->monitor_setup_.push_back("ATMA\r");
+  for (const auto &step : this->monitor_setup_)
+    ESP_LOGD(TAG, "CAN-Monitor Setup: %s", step.substr(0, step.find('\r')).c_str());
+}
+
+// Befehl des aktuellen Schritts senden, die Antwort löst den nächsten aus
+void ELM327Protocol::send_monitor_step(uint32_t now) {
+  this->parser_.reset();
+  this->last_request_time_ = now;
+  this->pending_.count = 0;
+
+  if (this->monitor_phase_ == MONITOR_RESTORE) {
+    if (this->monitor_step_ >= MONITOR_RESTORE_COUNT) {
+      // Abfragerunde: alles, was während des Monitors fällig wurde
+      this->monitor_phase_ = MONITOR_OFF;
+      this->poll_round_start_ = now;
+      return;
+    }
+    this->pending_.kind = REQUEST_MONITOR;
+    // Mit Header-Modus bleibt ATH1 nach dem Monitor an
+    bool headers = this->monitor_step_ == MONITOR_RESTORE_COUNT - 1 && this->parser_.has_headers();
+    this->send_command(headers ? "ATH1\r" : MONITOR_RESTORE_CMDS[this->monitor_step_]);
+    return;
+  }
+
+  if (this->monitor_step_ + 1u < this->monitor_setup_.size()) {
+    this->pending_.kind = REQUEST_MONITOR;
+    this->send_command(this->monitor_setup_[this->monitor_step_].c_str());
+    return;
+  }
+  // ATMA: ab jetzt ein Frame pro Zeile, der Prompt kommt erst beim Beenden
+  this->monitor_phase_ = MONITOR_RUNNING;
+  this->monitor_since_ = now;
+  this->monitor_session_frames_ = 0;
+  this->monitor_overflow_ = false;
+  this->pending_.kind = REQUEST_NONE;
+  this->parser_.set_line_mode(true);
+  this->send_command(this->monitor_setup_.back().c_str());
+}
+
+void ELM327Protocol::handle_monitor_reply(const ELM327Response &response, uint32_t now) {
+  if (response.status != RESPONSE_OK)
+    ESP_LOGW(TAG, "CAN-Monitor: Schritt %u fehlgeschlagen: %s", this->monitor_step_ + 1, response.raw);
+  this->pending_.kind = REQUEST_NONE;
+  this->monitor_step_++;
+  // Nächsten Befehl direkt senden, nicht erst im nächsten loop()
+  this->send_monitor_step(now);
+}
+
+// Eine Zeile des Datenstroms bzw. der abschließende Prompt
+void ELM327Protocol::handle_monitor_line(const ELM327Response &response, uint32_t now) {
+  if (response.text_len == 0 && response.raw_len > 0) {
+    this->parse_can_frame(response.raw, response.raw_len);
+  } else if (strcmp(response.text, "BUFFERFULL") == 0) {
+    this->monitor_overflow_ = true;
+  } else if (response.text_len > 0) {
+    ESP_LOGV(TAG, "CAN-Monitor: %s", response.raw);
+  }
+  if (response.prompt)
+    this->finish_monitor_stream(now);
+}
+
+// Datenstrom beendet: planmäßig (Abbruch gesendet) oder vom Adapter (BUFFER FULL, ?)
+void ELM327Protocol::finish_monitor_stream(uint32_t now) {
+  this->parser_.set_line_mode(false);
+  if (this->monitor_phase_ == MONITOR_RUNNING) {
+    if (this->monitor_overflow_) {
+      // BLE kommt mit dem Bus nicht mit: Filter bleiben gesetzt, ATMA sofort neu starten
+      this->buffer_full_count_++;
+      ESP_LOGW(TAG, "CAN-Monitor: BUFFER FULL nach %u Frames, starte neu", (unsigned) this->monitor_session_frames_);
+      uint32_t since = this->monitor_since_;
+      this->monitor_phase_ = MONITOR_SETUP;
+      this->monitor_step_ = this->monitor_setup_.size() - 1;
+      this->send_monitor_step(now);
+      this->monitor_since_ = since;  // Mindestdauer zählt ab dem ersten Start
+      return;
+    }
+    if (this->monitor_session_frames_ == 0) {
+      ESP_LOGE(TAG, "CAN-Monitor vom Adapter nicht unterstuetzt, nur noch Abfragen");
+      this->monitor_enabled_ = false;
+    } else {
+      ESP_LOGW(TAG, "CAN-Monitor unerwartet beendet");
+    }
+  }
+  this->monitor_phase_ = MONITOR_RESTORE;
+  this->monitor_step_ = 0;
+  this->send_monitor_step(now);
+}
+
+// Frame-Zeile (ATH1, ATS0): CAN-ID mit 3 (11 Bit) oder 8 (29 Bit) Hex-Ziffern, dann die Datenbytes.
+// 3 Ziffern + Bytepaare ergeben eine ungerade Länge, 8 Ziffern eine gerade.
+void ELM327Protocol::parse_can_frame(const char *line, size_t len) {
+  size_t id_len = len % 2 == 1 ? 3 : 8;
+  if (len < id_len)
+    return;
+  uint32_t id = 0;
+  for (size_t i = 0; i < id_len; i++) {
+    int digit = hex_digit(line[i]);
+    if (digit < 0)
+      return;
+    id = (id << 4) | digit;
+  }
+  uint8_t data[8];
+  size_t count = 0;
+  for (size_t i = id_len; i + 1 < len && count < sizeof(data); i += 2) {
+    int high = hex_digit(line[i]);
+    int low = hex_digit(line[i + 1]);
+    if (high < 0 || low < 0)
+      return;
+    data[count++] = (high << 4) | low;
+  }
+  this->monitor_frames_++;
+  this->monitor_session_frames_++;
+
+  for (int channel = 0; channel < (int) this->entries_.size(); channel++) {
+    const PIDEntry &entry = this->entries_[channel];
+    if (!entry.config.is_can_signal || entry.config.can_id != id ||
+        entry.config.can_byte + entry.descriptor.length > count)
+      continue;
+    uint32_t raw = 0;
+    for (uint8_t i = 0; i < entry.descriptor.length; i++)
+      raw = (raw << 8) | data[entry.config.can_byte + i];
+    float value = raw * entry.descriptor.scale + entry.descriptor.offset;
+    ESP_LOGV(TAG, "CAN 0x%03X = %.2f", (unsigned) id, value);
+    if (this->listener_ != nullptr)
+      this->listener_->on_value(channel, value);
+  }
+}
+
+// ============================================================
+// Registrierung
+// ============================================================
+int ELM327Protocol::add_pid(uint8_t mode, uint8_t pid, uint32_t update_interval, uint8_t priority) {
+  const PIDDescriptor *known = (mode == 0x01) ? lookup_pid(pid) : nullptr;
+  int channel;
+  if (known != nullptr) {
+    channel = this->add_pid(mode, pid, update_interval, priority, known->length, known->scale, known->offset);
+    this->entries_[channel].descriptor.formula = known->formula;
+  } else {
+    // Unbekannter PID: Länge aus der Antwort, Rohwert A
+    channel = this->add_pid(mode, pid, update_interval, priority, 0, 1.0f, 0.0f);
+    this->entries_[channel].descriptor.formula = FORMULA_RAW;
+  }
+  return channel;
+}
+
+int ELM327Protocol::add_pid(uint8_t mode, uint16_t pid, uint32_t update_interval, uint8_t priority, uint8_t length,
+                            float scale, float offset) {
+  PIDEntry entry;
+  entry.descriptor = {(uint8_t) pid, length, length >= 2 ? FORMULA_AB : FORMULA_A, scale, offset};
+  entry.schedule.update_interval = update_interval;
+  entry.schedule.priority = priority;
+  entry.config.mode = mode;
+  entry.config.pid = pid;
+  entry.config.is_at_command = false;
+  // Befehl generieren: z.B. mode=0x01 pid=0x05 → "0105\r", mode=0x22 did=0xF40D → "22F40D\r"
+  char cmd[10];
+  snprintf(cmd, sizeof(cmd), mode == 0x22 ? "%02X%04X\r" : "%02X%02X\r", mode, pid);
+  entry.config.command = cmd;
+  int channel = this->entries_.size();
+  this->entries_.push_back(entry);
+  ESP_LOGD(TAG, "PID registriert: Mode 0x%02X PID 0x%02X → %s", mode, pid, cmd);
+  return channel;
+}
+
+void ELM327Protocol::set_ecu(int channel, uint32_t ecu) {
+  auto &config = this->entries_[channel].config;
+  config.ecu = ecu;
+  if (!config.header.empty())
+    return;
+  // Antwort-ID → Anfrage-ID: 11 Bit 7E8 → 7E0, 29 Bit 18DAF1xx → DAxxF1
+  char header[8];
+  if (ecu <= 0x7FF) {
+    snprintf(header, sizeof(header), "%03X", (unsigned) (ecu - 8));
+  } else {
+    snprintf(header, sizeof(header), "DA%02XF1", (unsigned) (ecu & 0xFF));
+  }
+  config.header = header;
+}
+
+int ELM327Protocol::add_at_command(const std::string &command, uint32_t update_interval, uint8_t priority) {
+  PIDEntry entry;
+  entry.schedule.update_interval = update_interval;
+  entry.schedule.priority = priority;
+  entry.config.mode = 0;
+  entry.config.pid = 0;
+  entry.config.is_at_command = true;
+  entry.config.command = command;
+  entry.descriptor = {0, 0, FORMULA_RAW, 1.0f, 0.0f};
+  int channel = this->entries_.size();
+  if (command == "ATRV\r")
+    this->voltage_channel_ = channel;
+  this->entries_.push_back(entry);
+  ESP_LOGD(TAG, "AT-Befehl registriert: %s", command.c_str());
+  return channel;
+}
+
+int ELM327Protocol::add_can_signal(uint32_t can_id, uint8_t start_byte, uint8_t length, float scale,
+                                   float offset) {
+  PIDEntry entry;
+  entry.descriptor = {0, length, length >= 2 ? FORMULA_AB : FORMULA_A, scale, offset};
+  entry.schedule.disabled = true;  // kommt ohne Anfrage aus dem Datenstrom
+  entry.config.mode = 0;
+  entry.config.pid = 0;
+  entry.config.is_at_command = false;
+  entry.config.is_can_signal = true;
+  entry.config.can_id = can_id;
+  entry.config.can_byte = start_byte;
+  int channel = this->entries_.size();
+  this->entries_.push_back(entry);
+  this->monitor_enabled_ = true;
+  this->monitor_setup_.clear();
+  ESP_LOGD(TAG, "CAN-Signal registriert: ID 0x%03X, Byte %u, %u Bytes", (unsigned) can_id, start_byte, length);
+  return channel;
+}
+
+void ELM327Protocol::enable_dtc(uint32_t update_interval) {
+  this->dtc_enabled_ = true;
+  this->dtc_schedule_.update_interval = update_interval;
+}
+
+int ELM327Protocol::enable_vehicle_info(uint8_t pid) {
+  for (int i = 0; i < (int) this->info_.size(); i++) {
+    if (this->info_[i].pid == pid)
+      return i;
+  }
+  VehicleInfo info;
+  info.pid = pid;
+  this->info_.push_back(info);
+  return this->info_.size() - 1;
+}
+
+}  // namespace elm327_ble
+}  // namespace esphome
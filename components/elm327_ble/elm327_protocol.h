@@ -0,0 +1,466 @@
+#pragma once
+
+#include "elm327_parser.h"
+#include "elm327_stats.h"
+#include "elm327_trip.h"
+#include "obd2_pids.h"
+
+#include <string>
+#include <vector>
+
+namespace esphome {
+namespace elm327_ble {
+
+// Vordefinierte OBD2 PID-Konfigurationen
+struct OBD2PIDConfig {
+  uint8_t mode;
+  uint16_t pid;         // Mode 22: 16-Bit-DID
+  std::string command;  // z.B. "0105\r", "22F40D\r" oder "ATRV\r"
+  bool is_at_command;   // true für AT-Befehle wie ATRV
+  std::string header;   // Ziel-Steuergerät per ATSH (z.B. "7E0"), leer = funktional an alle
+  bool is_can_signal{false};  // Wert aus CAN-Broadcast (ATMA), wird nicht abgefragt
+  uint32_t can_id{0};
+  uint8_t can_byte{0};        // erstes Datenbyte des Werts im Frame
+  uint32_t ecu{0};            // Wert nur aus der Antwort dieses Steuergeräts (CAN-ID, z.B. 0x7E8), 0 = jedes
+};
+
+// Abfrageplanung eines Eintrags (PID-Sensor oder DTC-Abfrage)
+struct PollSchedule {
+  uint32_t update_interval{0};  // 0 = so oft wie möglich
+  uint8_t priority{0};          // höher = wird bei Überfälligkeit bevorzugt
+  uint32_t next_due{0};
+  bool disabled{false};         // vom Steuergerät nicht unterstützt
+  uint8_t failures{0};          // Anfragen ohne Antwort in Folge (Backoff)
+};
+
+// Unterstützte Mode-01-PIDs laut 0100, 0120, ..., 01E0 (je 32 PIDs pro Bitmap)
+struct SupportedPIDs {
+  uint32_t bitmap[8];
+  uint8_t known;  // Bit i = bitmap[i] wurde abgefragt
+
+  bool is_known(int index) const { return (this->known >> index) & 1; }
+  // Nächste Bitmap, die laut der vorherigen existiert, aber noch fehlt; -1 = vollständig
+  int next_missing() const {
+    for (int i = 1; i < 8; i++) {
+      if (this->is_known(i - 1) && (this->bitmap[i - 1] & 1) && !this->is_known(i))
+        return i;
+    }
+    return -1;
+  }
+  // Unbekannte Bereiche gelten als unterstützt, damit ohne Bitmap nichts abgeschaltet wird
+  bool is_supported(uint8_t pid) const {
+    if (pid == 0)
+      return true;
+    int index = (pid - 1) / 32;
+    if (this->is_known(index))
+      return (this->bitmap[index] >> (31 - (pid - 1) % 32)) & 1;
+    // Vorherige Bitmap meldet keine weiteren PIDs
+    return !(index > 0 && this->is_known(index - 1) && !(this->bitmap[index - 1] & 1));
+  }
+};
+
+// Im Codegen aus der YAML-Formel erzeugte Umrechnung, data = Bytes A, B, C, D
+using PIDValueFn = float (*)(const uint8_t *data);
+
+// Ein registrierter Abfrage-Eintrag, der Index in entries() ist der Kanal
+struct PIDEntry {
+  OBD2PIDConfig config;
+  PIDDescriptor descriptor;  // Datenlänge und Formel (aus OBD2_PID_TABLE oder YAML)
+  PIDValueFn formula{nullptr};  // ersetzt descriptor.formula/scale/offset
+  PollSchedule schedule;
+  RequestStats stats;
+  ResponseTime timing;  // gelernte Antwortzeit (nur beantwortete Anfragen)
+  uint32_t sender{0};  // mit ATH1: Steuergerät, dessen Werte verwendet werden (erste Antwort)
+  uint8_t responders{0};  // höchste Zahl antwortender Steuergeräte, 0 = noch nicht bekannt
+};
+
+// Fähigkeiten des Adapters laut ATI/STI, bestimmen die Syntax jeder Anfrage
+struct AdapterInfo {
+  bool known{false};           // ATI beantwortet (oder aus dem Schnellstart-Cache)
+  bool response_count{false};  // Anzahl erwarteter Antworten anhängen ("010C1"), ab ELM327 v1.3
+  bool stpx{false};            // STN11xx/STN21xx (OBDLink): STPX mit Header statt ATSH-Umschaltung
+  std::string id;              // z.B. "ELM327 v1.5" oder "STN2120 v5.6.5"
+};
+
+// Fahrzeug-Information aus Mode 09 (VIN, Kalibrierungs-IDs, ...), wird pro Fahrzeug
+// einmal gelesen. Ohne Antwort erneuter Versuch nach VEHICLE_INFO_RETRY_MS.
+struct VehicleInfo {
+  uint8_t pid;           // 0x02 = VIN, 0x04 = Kalibrierungs-ID, 0x0A = Steuergerätename
+  PollSchedule schedule;
+  std::string value;     // leer = noch nicht gelesen
+};
+
+// Abfrageprofile nach Motorzustand. Der Motor gilt als laufend, solange Drehzahl > 0
+// oder Ladespannung gemeldet wird, sonst wird nach engine_off_delay nur noch die
+// Spannung (und die Drehzahl als Startprobe) selten abgefragt und der Adapter
+// schließlich per ATLP schlafen gelegt.
+struct PowerProfileConfig {
+  bool enabled{false};
+  uint32_t engine_off_delay{30000};
+  float running_voltage{13.2f};     // ab dieser Spannung lädt die Lichtmaschine
+  uint32_t parked_interval{60000};  // Abfrageintervall im Stand
+  uint32_t sleep_after{600000};     // im Stand bis ATLP, 0 = Adapter nie schlafen legen
+  uint32_t wake_interval{300000};   // Weckprobe im Schlafmodus
+};
+
+enum PowerProfile : uint8_t {
+  PROFILE_RUNNING,  // alle Einträge
+  PROFILE_PARKED,   // nur AT-Befehle (ATRV) und Drehzahl, höchstens alle parked_interval
+  PROFILE_SLEEP,    // Adapter schläft (ATLP), nur die Weckprobe
+};
+
+// Schreibzugriff auf den Adapter (BLE im Hub, Emulator auf dem Host)
+class ELM327Transport {
+ public:
+  virtual ~ELM327Transport() = default;
+  // false = Befehl konnte nicht gesendet werden
+  virtual bool write(const uint8_t *data, size_t len) = 0;
+};
+
+// Empfänger der dekodierten Werte
+class ELM327Listener {
+ public:
+  virtual ~ELM327Listener() = default;
+  virtual void on_value(int channel, float value) {}
+  virtual void on_dtc(const std::string &codes) {}
+  virtual void on_response(const ELM327Response &response) {}
+  virtual void on_ready() {}
+  virtual void on_engine_running(bool running) {}
+  // Erkanntes Protokoll oder PID-Bitmap geändert (z.B. zum Speichern)
+  virtual void on_session_info() {}
+  // Kanal wird nicht abgefragt, weil das Steuergerät den PID nicht unterstützt
+  virtual void on_pid_unsupported(int channel) {}
+  // Fahrzeug-Information gelesen, index = Rückgabe von enable_vehicle_info()
+  virtual void on_vehicle_info(int index, const std::string &value) {}
+  // Ergebnis eines Befehls aus queue_command(), response = nullptr ohne Antwort
+  // (Timeout, ATSH abgelehnt oder Verbindung getrennt)
+  virtual void on_command_result(const std::string &command, const ELM327Response *response) {}
+};
+
+// Transportunabhängiger ELM327-Protokollkern: Init-Sequenz, Abfrageplanung,
+// Antwort-Parser und PID-Dekodierung. Kennt weder BLE noch ESPHome-Sensoren,
+// die Zeit wird als `now` (ms) übergeben.
+class ELM327Protocol {
+ public:
+  void set_transport(ELM327Transport *transport) { this->transport_ = transport; }
+  void set_listener(ELM327Listener *listener) { this->listener_ = listener; }
+  void set_request_interval(uint32_t interval_ms) { this->request_interval_ = interval_ms; }
+  void set_request_timeout(uint32_t timeout_ms) { this->request_timeout_ = timeout_ms; }
+  // Timeout pro Anfrage aus den gemessenen Antwortzeiten (request_timeout ist dann nur
+  // noch die Obergrenze) und Wartezeit des Adapters per ATST/ATAT daran anpassen
+  void set_adaptive_timing(bool adaptive) { this->adaptive_timing_ = adaptive; }
+  void set_batch_pids(bool batch) { this->batch_pids_ = batch; }
+  // Nächsten Befehl direkt nach dem Prompt aus receive() senden statt im nächsten loop(),
+  // request_interval ist dann nur noch der Mindestabstand
+  void set_max_throughput(bool enabled) { this->max_throughput_ = enabled; }
+  // Gespeichertes Protokoll (ATDPN-Nummer '1'..'C'), 0 = automatisch suchen.
+  // Ist es gesetzt, startet die Init-Sequenz mit ATSPn statt ATSP0.
+  void set_known_protocol(char protocol) { this->known_protocol_ = protocol; }
+  // Gespeicherte Bitmaps der unterstützten PIDs (0100, 0120, ...)
+  void set_supported_pids(const SupportedPIDs &supported) { this->supported_ = supported; }
+  // ATH1 am Ende der Init (nur CAN): jede Antwort trägt die CAN-ID des Steuergeräts,
+  // Werte mehrerer antwortender Steuergeräte werden getrennt statt vermischt
+  void set_headers(bool headers) { this->headers_ = headers; }
+  // Gespeicherte Fähigkeiten des Adapters, ATI und STI werden dann nicht erneut gesendet
+  void set_adapter_info(const AdapterInfo &info) { this->adapter_ = info; }
+
+  // Einträge registrieren, Rückgabe = Kanal für ELM327Listener::on_value()
+  int add_pid(uint8_t mode, uint8_t pid, uint32_t update_interval = 0, uint8_t priority = 0);
+  int add_pid(uint8_t mode, uint16_t pid, uint32_t update_interval, uint8_t priority, uint8_t length, float scale,
+              float offset);
+  // Mode 22 (UDS ReadDataByIdentifier) mit 16-Bit-DID, Antwort "62 DID Daten..."
+  int add_did(uint16_t did, uint32_t update_interval, uint8_t priority, uint8_t length, float scale, float offset) {
+    return this->add_pid(0x22, did, update_interval, priority, length, scale, offset);
+  }
+  // Anfrage nur an ein Steuergerät (ATSH, z.B. "7E0" oder 29 Bit "DA10F1")
+  void set_header(int channel, const std::string &header) { this->entries_[channel].config.header = header; }
+  void set_formula(int channel, PIDValueFn formula) { this->entries_[channel].formula = formula; }
+  // Nur Werte dieses Steuergeräts (Antwort-ID 7E8 bzw. 18DAF110) verwenden. Ohne eigenen
+  // Header wird es physikalisch adressiert (ATSH7E0 bzw. ATSHDA10F1), die übrigen schweigen.
+  void set_ecu(int channel, uint32_t ecu);
+  int add_at_command(const std::string &command, uint32_t update_interval = 0, uint8_t priority = 0);
+  void enable_dtc(uint32_t update_interval);
+  // Mode-09-Info einmal lesen (nach dem Init bzw. einem Fahrzeugwechsel), Rückgabe = Index
+  int enable_vehicle_info(uint8_t pid);
+  // Wert aus CAN-Broadcast-Frames (Big Endian): raw * scale + offset.
+  // Schaltet den Monitor-Modus (ATMA) zwischen den Abfragerunden ein.
+  int add_can_signal(uint32_t can_id, uint8_t start_byte, uint8_t length, float scale, float offset);
+  // Mindestdauer einer Monitor-Phase, danach werden fällige PIDs/DTCs abgefragt
+  void set_monitor_duration(uint32_t duration_ms) { this->monitor_duration_ = duration_ms; }
+  // Profile nach Motorzustand; ohne ATRV-Sensor wird die Spannung intern abgefragt
+  void set_power_profiles(const PowerProfileConfig &config) { this->profiles_ = config; }
+
+  // Einmaliger Befehl (z.B. "03", "04", "020C00" oder "ATRV") aus einer Aktion. Wird vor der
+  // regulären Abfrage gesendet, sobald der Adapter frei ist (unterbricht auch den CAN-Monitor
+  // bzw. weckt den Adapter), höhere Priorität zuerst. header = Ziel-Steuergerät wie bei
+  // set_header(). false = ungültiger Befehl, Warteschlange voll oder keine Verbindung.
+  bool queue_command(const std::string &command, uint8_t priority = 0, const std::string &header = "");
+  size_t get_queued_commands() const { return this->commands_.size(); }
+
+  // Adapter erreichbar (Notify aktiv) → Init-Sequenz starten
+  void start(uint32_t now);
+  // Verbindung getrennt
+  void stop();
+  // Transport meldet nachträglich, dass ein bereits angenommener Befehl nicht angekommen ist
+  void on_write_failed() { this->write_failures_++; }
+  // Empfangene Bytes (Notify-Chunk)
+  void receive(const uint8_t *data, size_t len, uint32_t now);
+  void loop(uint32_t now);
+
+  bool is_ready() const { return this->state_ == STATE_READY; }
+  bool is_active() const { return this->state_ != STATE_IDLE; }
+  char get_protocol() const { return this->known_protocol_; }
+  const SupportedPIDs &get_supported_pids() const { return this->supported_; }
+  const AdapterInfo &get_adapter_info() const { return this->adapter_; }
+  const std::vector<PIDEntry> &entries() const { return this->entries_; }
+  uint32_t get_request_interval() const { return this->request_interval_; }
+  uint32_t get_request_timeout() const { return this->request_timeout_; }
+  bool get_adaptive_timing() const { return this->adaptive_timing_; }
+  // Wartezeit des Adapters bis "NO DATA" (ATST) in ms
+  uint32_t get_adapter_timeout() const { return this->adapter_timeout_ * ADAPTER_TIMEOUT_UNIT_MS; }
+  bool get_batch_pids() const { return this->batch_pids_; }
+  bool get_max_throughput() const { return this->max_throughput_; }
+  bool get_headers() const { return this->headers_; }
+  // ATH1 aktiv (nach der Init, nur bei CAN)
+  bool has_headers() const { return this->parser_.has_headers(); }
+  bool has_dtc() const { return this->dtc_enabled_; }
+  bool has_monitor() const { return this->monitor_enabled_; }
+  bool is_monitoring() const { return this->monitor_phase_ != MONITOR_OFF; }
+  uint32_t get_monitor_duration() const { return this->monitor_duration_; }
+  uint32_t get_monitor_frames() const { return this->monitor_frames_; }
+  uint32_t get_buffer_full_count() const { return this->buffer_full_count_; }
+  uint32_t get_header_switches() const { return this->header_switches_; }
+  const PowerProfileConfig &get_power_profiles() const { return this->profiles_; }
+  PowerProfile get_profile() const { return this->profile_; }
+  uint32_t get_sleep_count() const { return this->sleep_count_; }
+  const PollSchedule &get_dtc_schedule() const { return this->dtc_schedule_; }
+  const std::vector<VehicleInfo> &get_vehicle_info() const { return this->info_; }
+  // Bordcomputer, wird mit allen dekodierten Mode-01-Werten gefüttert
+  ELM327TripComputer &trip() { return this->trip_; }
+  const ELM327TripComputer &trip() const { return this->trip_; }
+
+  // Statistik aller Anfragen (pro Kanal: entries()[channel].stats)
+  const RequestStats &get_stats() const { return this->stats_; }
+  uint32_t get_write_failures() const { return this->write_failures_; }
+  // Latenz und Antworten/s beginnen ein neues Zeitfenster, Zähler bleiben
+  void reset_stats_window();
+
+  static const int MAX_PIDS_PER_REQUEST = 6;
+  // Backoff: ab 3 Fehlversuchen in Folge 1 s, 2 s, 4 s, ... bis 60 s Pause
+  static constexpr uint8_t BACKOFF_AFTER_FAILURES = 3;
+  static constexpr uint32_t BACKOFF_MIN_MS = 1000;
+  static constexpr uint32_t BACKOFF_MAX_MS = 60000;
+  static constexpr uint32_t VEHICLE_INFO_RETRY_MS = 60000;
+  static const size_t MAX_QUEUED_COMMANDS = 8;
+  static const size_t MAX_COMMAND_LENGTH = 20;  // ohne '\r', passt in einen BLE-Write
+  static const size_t MAX_HEADER_LENGTH = 6;    // ATSH: 3 bzw. 6 Hex-Ziffern
+  // Längster Write an den Adapter: "STPX H:<Header>, D:<Befehl>, R:<Anzahl>\r"
+  static const size_t MAX_WRITE_LENGTH = 7 + MAX_HEADER_LENGTH + 4 + MAX_COMMAND_LENGTH + 6 + 1;
+  // ATST in Schritten von 4 ms, nach ATZ 0x32 (200 ms). Unter ATST_MIN verwerfen manche
+  // Adapter auch pünktliche Antworten.
+  static const uint32_t ADAPTER_TIMEOUT_UNIT_MS = 4;
+  static const uint8_t ATST_DEFAULT = 0x32;
+  static const uint8_t ATST_MIN = 0x0C;
+  // Zuschlag auf die gelernte Antwortzeit (BLE-Übertragung, Hauptschleife)
+  static const uint32_t TIMING_MARGIN_MS = 100;
+  // Nach NO DATA bzw. Timeout eines schon antwortenden PIDs so viele Antworten in Folge
+  // mit ATAT1 und ohne kürzeres ATST
+  static const uint8_t TIMING_HOLD_RESPONSES = 20;
+
+ protected:
+  enum State {
+    STATE_IDLE,
+    STATE_INITIALIZING,
+    STATE_READY,
+  };
+  State state_{STATE_IDLE};
+
+  // Offene Anfrage: was gesendet wurde und an welche Kanäle die Antwort geht
+  enum RequestKind : uint8_t {
+    REQUEST_NONE,
+    REQUEST_PID,  // Antwort "4x PID A [B...]" pro angefragtem PID
+    REQUEST_AT,   // Textantwort, z.B. "12.4V"
+    REQUEST_DTC,  // Mode 03, "43 ..."
+    REQUEST_INFO,  // Mode 09, "49 PID ...", channels[0] = Index in info_
+    REQUEST_MONITOR,  // Befehl zum Ein-/Ausschalten des CAN-Monitors
+    REQUEST_HEADER,   // ATSH vor einer Anfrage an ein anderes Steuergerät, channels[0] = Schedule-Index
+    REQUEST_POWER,    // ATLP bzw. Weckprobe im Schlafmodus
+    REQUEST_COMMAND,  // einmaliger Befehl aus queue_command(), Antwort geht unverändert an den Listener
+    REQUEST_TIMING,   // ATAT bzw. ATST, channels[0] = neuer Wert, channels[1] = 1 bei ATST
+  };
+  // Syntax der gesendeten Anfrage, lehnt der Adapter sie mit "?" ab, wird sie abgeschaltet
+  enum RequestSyntax : uint8_t {
+    SYNTAX_PLAIN,
+    SYNTAX_COUNT,  // Anzahl erwarteter Antworten als letzte Ziffer
+    SYNTAX_STPX,   // STPX H:<Header>, D:<Daten>[, R:<Anzahl>]
+  };
+  struct PendingRequest {
+    RequestKind kind{REQUEST_NONE};
+    RequestSyntax syntax{SYNTAX_PLAIN};
+    uint8_t mode{0};  // erwarteter Header = 0x40 + mode
+    uint8_t count{0};
+    int channels[MAX_PIDS_PER_REQUEST];
+    bool answered[MAX_PIDS_PER_REQUEST];
+    uint8_t replies[MAX_PIDS_PER_REQUEST];  // Nachrichten mit diesem PID (eine pro Steuergerät)
+  };
+
+  ELM327Transport *transport_{nullptr};
+  ELM327Listener *listener_{nullptr};
+
+  // Initialisierung: jeder Schritt wartet auf den Prompt, die Zeiten sind nur Timeouts
+  int init_step_{0};
+  static const int INIT_STEPS_COUNT = 12;
+  static const uint8_t MAX_INIT_RETRIES = 3;
+  bool init_sent_{false};
+  bool fast_init_{false};  // ATSPn mit gespeichertem Protokoll statt ATSP0
+  uint8_t init_retries_{0};
+  uint32_t last_init_time_{0};
+
+  // PID-Abfragezyklus (Scheduler: der am stärksten überfällige Eintrag wird zuerst gesendet)
+  std::vector<PIDEntry> entries_;
+  bool dtc_enabled_{false};
+  PollSchedule dtc_schedule_;
+  std::vector<VehicleInfo> info_;
+  int voltage_channel_{-1};
+
+  // Fahrzeug-Informationen aus der Init-Sequenz
+  char known_protocol_{0};
+  SupportedPIDs supported_{};
+  int support_index_{0};  // gerade abgefragte Bitmap, PID = 0x20 × Index
+  AdapterInfo adapter_;
+
+  uint32_t request_interval_{2000};
+  uint32_t request_timeout_{5000};
+  bool adaptive_timing_{false};
+  bool timing_rejected_{false};          // ATAT/ATST mit Fehler beantwortet, nicht erneut senden
+  uint8_t adaptive_mode_{1};             // ATAT0/1/2, nach ATZ 1
+  uint8_t adapter_timeout_{ATST_DEFAULT};
+  uint8_t timing_hold_{0};               // > 0: nach ausgebliebenen Antworten, siehe back_off_adapter_timing()
+  uint8_t timing_floor_{0};              // ATST mindestens so lange, solange timing_hold_ läuft
+  uint32_t last_request_time_{0};
+  bool batch_pids_{false};
+  bool max_throughput_{false};
+  bool headers_{false};
+  PendingRequest pending_;
+
+  // Einmalige Befehle, nach Priorität sortiert (gleiche Priorität in Eingangsreihenfolge)
+  struct QueuedCommand {
+    std::string command;  // ohne '\r'
+    std::string header;
+    uint8_t priority;
+  };
+  std::vector<QueuedCommand> commands_;
+  std::string command_;  // aus der Warteschlange genommen, wartet auf ATSH oder die Antwort
+  std::string command_header_;
+
+  // CAN-Monitor: ATMA-Phasen wechseln sich mit Abfragerunden ab
+  enum MonitorPhase : uint8_t {
+    MONITOR_OFF,       // Abfragerunde (PIDs, DTCs)
+    MONITOR_SETUP,     // ATH1, ATCAF0, Filter, ATMA
+    MONITOR_RUNNING,   // Datenstrom, eine Zeile pro Frame
+    MONITOR_STOPPING,  // Abbruch gesendet, warte auf '>'
+    MONITOR_RESTORE,   // ATAR, ATCAF1, ATH0
+  };
+  bool monitor_enabled_{false};
+  MonitorPhase monitor_phase_{MONITOR_OFF};
+  uint32_t monitor_duration_{10000};
+  uint8_t monitor_step_{0};
+  uint32_t monitor_since_{0};      // Beginn der aktuellen Monitor-Phase
+  uint32_t monitor_session_frames_{0};
+  bool monitor_overflow_{false};   // "BUFFER FULL" im aktuellen Datenstrom
+  uint32_t poll_round_start_{0};   // Abfragerunde: fällig ist, was vor diesem Zeitpunkt fällig war
+  uint32_t monitor_frames_{0};
+  uint32_t buffer_full_count_{0};
+  std::vector<std::string> monitor_setup_;
+
+  // Ziel-Steuergerät (ATSH): Einträge mit demselben Header werden gebündelt abgefragt
+  std::string current_header_;     // leer = Standard (funktional, 7DF bzw. DB33F1)
+  std::string header_target_;      // per REQUEST_HEADER angefragt
+  uint32_t header_since_{0};       // letzter Wechsel
+  uint32_t header_switches_{0};
+
+  // Abfrageprofile nach Motorzustand
+  PowerProfileConfig profiles_;
+  PowerProfile profile_{PROFILE_RUNNING};
+  uint32_t profile_since_{0};
+  uint32_t engine_activity_{0};  // letzte Drehzahl > 0 bzw. Ladespannung
+  bool engine_seen_{false};      // in der aktuellen Antwort, wird in process_response() übernommen
+  bool waking_{false};           // Init nach der Weckprobe, danach weiter im Stand
+  bool wake_check_{false};       // Stand nach der Weckprobe: nur eine Runde, dann wieder ATLP
+  bool sleep_supported_{true};   // false nach abgelehntem ATLP
+  uint32_t sleep_count_{0};
+
+  // Abgeleitete Fahrtwerte, Zeitstempel = Empfang der Antwort
+  ELM327TripComputer trip_;
+  uint32_t response_time_{0};
+
+  // Statistik (Latenz = Senden bis Prompt)
+  RequestStats stats_;
+  uint32_t write_failures_{0};
+
+  // Antwort-Parser (Ringpuffer + Tokenizer, keine Heap-Allokation pro Antwort)
+  ELM327ResponseParser parser_;
+
+  void send_command(const char *cmd);
+  void run_init_sequence(uint32_t now);
+  void handle_init_response(const ELM327Response &response, uint32_t now);
+  void retry_init_step(const char *reason);
+  bool parse_init_reply(const ELM327Response &response);
+  bool parse_adapter_id(const ELM327Response &response);
+  void apply_supported_pids();
+  void record_stats(const ELM327Response *response, uint32_t now);
+  void finish_pending(uint32_t now);
+  void request_next(uint32_t now);
+  // Auswahl in request_next(): alle Einträge, nur das aktuelle Steuergerät oder nur
+  // PIDs, die zur Anfrage in pending_ gebündelt werden können
+  enum SelectFilter : uint8_t { SELECT_ANY, SELECT_SAME_HEADER, SELECT_BATCH };
+  int select_next_entry(uint32_t now, SelectFilter filter);
+  int select_same_header(uint32_t now);
+  const std::string &header_of(int index) const;
+  void send_header(const std::string &header, int index, uint32_t now);
+  void handle_header_reply(const ELM327Response &response, uint32_t now);
+  PollSchedule &schedule_for(int index);
+  int schedule_count() const;
+  int info_slot(int index) const;
+  bool is_can_protocol() const;
+  void collect_pid_batch(uint32_t now);
+  bool is_batchable(int index) const;
+  bool is_batch_candidate(int index) const;
+  uint32_t pending_timeout() const;
+  bool update_adapter_timing(uint32_t now);
+  void back_off_adapter_timing();
+  void handle_timing_reply(const ELM327Response &response, uint32_t now);
+  void format_request(char (&out)[MAX_WRITE_LENGTH + 1], const char *data, size_t len, const std::string &header,
+                      uint8_t responses);
+  void reject_syntax(uint32_t now);
+  void send_queued_command(uint32_t now);
+  void finish_command(const ELM327Response *response, uint32_t now);
+  void abort_commands();
+  bool has_command() const { return !this->commands_.empty() || !this->command_.empty(); }
+  bool is_waiting() const { return this->pending_.kind != REQUEST_NONE; }
+  bool has_due_entry(uint32_t now);
+  uint32_t poll_time(uint32_t now) const;
+  bool in_profile(int index) const;
+  uint32_t poll_interval(const PollSchedule &schedule) const;
+  bool power_loop(uint32_t now);
+  void set_profile(PowerProfile profile, uint32_t now);
+  void handle_power_reply(const ELM327Response *response, uint32_t now);
+  bool monitor_loop(uint32_t now);
+  void build_monitor_setup();
+  void send_monitor_step(uint32_t now);
+  void handle_monitor_reply(const ELM327Response &response, uint32_t now);
+  void handle_monitor_line(const ELM327Response &response, uint32_t now);
+  void finish_monitor_stream(uint32_t now);
+  void parse_can_frame(const char *line, size_t len);
+  void process_response(const ELM327Response &response, uint32_t now);
+  void parse_pid_message(const uint8_t *data, size_t len, uint32_t sender);
+  bool accept_sender(int channel, uint32_t sender);
+  void publish_pid_value(int channel, const uint8_t *data);
+  void parse_dtc_response(const ELM327Response &response);
+  void parse_info_response(const ELM327Response &response);
+  void parse_at_response(const ELM327Response &response);
+  static void decode_dtc(uint8_t a, uint8_t b, char *out);
+};
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace esphome {
+namespace elm327_ble {
+
+// Obergrenzen der Latenzklassen in ms, die letzte Klasse nimmt alles darüber auf
+static const uint16_t LATENCY_BUCKET_LIMITS[] = {10,  20,  30,  40,  50,  60,  70,  80,   90,   100,
+                                                 125, 150, 200, 250, 300, 400, 500, 750, 1000, 2000};
+static const uint8_t LATENCY_BUCKETS = sizeof(LATENCY_BUCKET_LIMITS) / sizeof(LATENCY_BUCKET_LIMITS[0]) + 1;
+
+// Round-Trip-Latenz eines Zeitfensters. Perzentile kommen aus dem Histogramm,
+// einzelne Messwerte werden nicht gespeichert.
+struct LatencyStats {
+  uint32_t count{0};
+  uint32_t sum{0};
+  uint32_t min{0};
+  uint32_t max{0};
+  uint16_t histogram[LATENCY_BUCKETS]{};
+
+  void add(uint32_t ms) {
+    if (this->count == 0 || ms < this->min)
+      this->min = ms;
+    if (ms > this->max)
+      this->max = ms;
+    this->count++;
+    this->sum += ms;
+    uint8_t bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && ms > LATENCY_BUCKET_LIMITS[bucket])
+      bucket++;
+    if (this->histogram[bucket] < UINT16_MAX)
+      this->histogram[bucket]++;
+  }
+
+  void reset() { *this = LatencyStats(); }
+
+  float average() const { return this->count == 0 ? NAN : (float) this->sum / this->count; }
+
+  // Obergrenze der Klasse, in der das Perzentil liegt (höchstens das Maximum)
+  float percentile(uint8_t percent) const {
+    if (this->count == 0)
+      return NAN;
+    uint32_t target = (this->count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++) {
+      seen += this->histogram[bucket];
+      if (seen >= target)
+        return LATENCY_BUCKET_LIMITS[bucket] < this->max ? LATENCY_BUCKET_LIMITS[bucket] : this->max;
+    }
+    return this->max;
+  }
+};
+
+// Gelernte Antwortzeit einer Anfrage: gleitender Mittelwert und mittlere Abweichung
+// wie beim TCP-Retransmission-Timer (RFC 6298), bleibt anders als LatencyStats über
+// alle Zeitfenster erhalten
+struct ResponseTime {
+  static const uint8_t MIN_SAMPLES = 5;  // vorher gilt der feste Timeout
+
+  uint16_t samples{0};
+  float mean{0};
+  float deviation{0};
+
+  void add(uint32_t ms) {
+    if (this->samples == 0) {
+      this->mean = ms;
+      this->deviation = ms / 2.0f;
+    } else {
+      this->deviation += (fabsf(this->mean - ms) - this->deviation) / 4;
+      this->mean += (ms - this->mean) / 8;
+    }
+    if (this->samples < UINT16_MAX)
+      this->samples++;
+  }
+
+  bool is_known() const { return this->samples >= MIN_SAMPLES; }
+  // Obergrenze fast aller Antworten: Mittelwert + 4 × Abweichung
+  uint32_t upper() const { return (uint32_t) ceilf(this->mean + 4 * this->deviation); }
+};
+
+// Statistik einer Abfrage (pro Kanal und gesamt)
+struct RequestStats {
+  LatencyStats latency;      // Zeitfenster, wird nach jeder Ausgabe zurückgesetzt
+  uint32_t responses{0};     // beantwortete Anfragen im Zeitfenster
+  uint32_t timeouts{0};      // seit Start
+  uint32_t no_data{0};       // seit Start
+  uint32_t errors{0};        // seit Start (CAN ERROR, BUS ERROR, ?, ...)
+
+  void reset_window() {
+    this->latency.reset();
+    this->responses = 0;
+  }
+};
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -0,0 +1,142 @@
+#include "elm327_trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace elm327_ble {
+
+static void put32(uint8_t *p, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    p[i] = value >> (8 * i);
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// ============================================================
+// Dekodieren
+// ============================================================
+bool ELM327TraceReader::open(const uint8_t *data, size_t len) {
+  this->data_ = nullptr;
+  if (len < ELM327Trace::HEADER_SIZE || data[0] != 'O' || data[1] != 'B' || data[2] != 'T' ||
+      data[3] != TRACE_FORMAT_VERSION)
+    return false;
+  this->header_.exported_ms = get32(data + 4);
+  this->header_.count = get32(data + 8);
+  this->header_.dropped = get32(data + 12);
+  this->data_ = data;
+  this->len_ = len;
+  this->pos_ = ELM327Trace::HEADER_SIZE;
+  return true;
+}
+
+bool ELM327TraceReader::next(TraceRecord &record) {
+  if (this->data_ == nullptr || this->pos_ + ELM327Trace::RECORD_HEADER_SIZE > this->len_)
+    return false;
+  const uint8_t *p = this->data_ + this->pos_;
+  if (this->pos_ + ELM327Trace::RECORD_HEADER_SIZE + p[1] > this->len_)
+    return false;  // abgeschnittener Export
+  record.type = p[0];
+  record.len = p[1];
+  record.time_ms = get32(p + 2);
+  record.data = p + ELM327Trace::RECORD_HEADER_SIZE;
+  this->pos_ += ELM327Trace::RECORD_HEADER_SIZE + record.len;
+  return true;
+}
+
+bool ELM327TraceReader::decode_event(const TraceRecord &record, TraceEvent &event, uint32_t &value) {
+  if (record.type != TRACE_EVENT || record.len < 5)
+    return false;
+  event = (TraceEvent) record.data[0];
+  value = get32(record.data + 1);
+  return true;
+}
+
+// ============================================================
+// Aufzeichnen
+// ============================================================
+void ELM327Trace::set_buffer(uint8_t *buffer, size_t size) {
+  this->buffer_ = buffer;
+  // Mindestens ein Eintrag voller Länge muss hineinpassen
+  this->size_ = buffer != nullptr && size >= RECORD_HEADER_SIZE + MAX_PAYLOAD ? size : 0;
+  this->clear();
+}
+
+void ELM327Trace::clear() {
+  this->start_ = 0;
+  this->used_ = 0;
+  this->count_ = 0;
+}
+
+void ELM327Trace::copy_in_(size_t pos, const uint8_t *data, size_t len) {
+  pos %= this->size_;
+  size_t first = std::min(len, this->size_ - pos);
+  memcpy(this->buffer_ + pos, data, first);
+  memcpy(this->buffer_, data + first, len - first);
+}
+
+void ELM327Trace::copy_out_(size_t pos, uint8_t *out, size_t len) const {
+  pos %= this->size_;
+  size_t first = std::min(len, this->size_ - pos);
+  memcpy(out, this->buffer_ + pos, first);
+  memcpy(out + first, this->buffer_, len - first);
+}
+
+void ELM327Trace::add(TraceType type, const uint8_t *data, size_t len, uint32_t now) {
+  if (this->size_ == 0)
+    return;
+  do {
+    size_t n = len > MAX_PAYLOAD ? MAX_PAYLOAD : len;
+    this->add_record_(type, data, n, now);
+    data += n;
+    len -= n;
+  } while (len > 0);
+}
+
+void ELM327Trace::add_event(TraceEvent event, uint32_t value, uint32_t now) {
+  uint8_t payload[5];
+  payload[0] = event;
+  put32(payload + 1, value);
+  this->add(TRACE_EVENT, payload, sizeof(payload), now);
+}
+
+void ELM327Trace::add_record_(TraceType type, const uint8_t *data, size_t len, uint32_t now) {
+  size_t needed = RECORD_HEADER_SIZE + len;
+  // Älteste Einträge verwerfen, bis der neue Platz hat
+  while (this->size_ - this->used_ < needed) {
+    size_t dropped = RECORD_HEADER_SIZE + this->buffer_[(this->start_ + 1) % this->size_];
+    this->start_ = (this->start_ + dropped) % this->size_;
+    this->used_ -= dropped;
+    this->count_--;
+    this->dropped_++;
+  }
+  uint8_t header[RECORD_HEADER_SIZE];
+  header[0] = type;
+  header[1] = len;
+  put32(header + 2, now);
+  size_t pos = this->start_ + this->used_;
+  this->copy_in_(pos, header, sizeof(header));
+  this->copy_in_(pos + sizeof(header), data, len);
+  this->used_ += needed;
+  this->count_++;
+}
+
+// ============================================================
+// Export
+// ============================================================
+void ELM327Trace::export_to(uint8_t *out, uint32_t now) const {
+  out[0] = 'O';
+  out[1] = 'B';
+  out[2] = 'T';
+  out[3] = TRACE_FORMAT_VERSION;
+  put32(out + 4, now);
+  put32(out + 8, this->count_);
+  put32(out + 12, this->dropped_);
+  if (this->used_ > 0)
+    this->copy_out_(this->start_, out + HEADER_SIZE, this->used_);
+}
+
+}  // namespace elm327_ble
+}  // namespace esphome
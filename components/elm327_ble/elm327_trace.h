@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace elm327_ble {
+
+enum TraceType : uint8_t {
+  TRACE_TX = 1,     // an den Adapter geschriebene Bytes (Befehl inkl. '\r')
+  TRACE_RX = 2,     // Notify-Chunk, unverändert wie vom Adapter empfangen
+  TRACE_EVENT = 3,  // BLE- bzw. Protokollereignis, Nutzdaten: uint8 TraceEvent, uint32 Wert
+};
+
+enum TraceEvent : uint8_t {
+  TRACE_EVENT_CONNECT = 1,  // Wert = Verbindungsintervall in 1,25 ms
+  TRACE_EVENT_OPEN,         // Wert = GATT-Status
+  TRACE_EVENT_DISCONNECT,   // Wert = Grund laut BLE-Stack
+  TRACE_EVENT_SERVICES,     // Wert = TX-Handle << 16 | RX-Handle
+  TRACE_EVENT_NOTIFY,       // Notify registriert, Initialisierung beginnt
+  TRACE_EVENT_MTU,          // Wert = ausgehandelte MTU
+  TRACE_EVENT_WRITE_ACK,    // Wert = GATT-Status der Write-Quittung
+  TRACE_EVENT_WRITE_ERROR,  // Wert = Fehlercode von esp_ble_gattc_write_char
+  TRACE_EVENT_CONN_PARAMS,  // Wert = Intervall << 16 | Slave Latency
+  TRACE_EVENT_TIMEOUT,      // Anfrage ohne Antwort, Wert = Timeouts seit Start
+};
+
+// Exportformat (Little Endian):
+//
+//   0  "OBT" + Formatversion (TRACE_FORMAT_VERSION)
+//   4  uint32 Uptime in ms beim Export
+//   8  uint32 Anzahl Einträge
+//  12  uint32 seit dem Start überschriebene Einträge
+//  16  Einträge, älteste zuerst: uint8 TraceType, uint8 Länge n, uint32 Uptime in ms, n Bytes
+//
+// Im Ring liegen die Einträge genauso, nur ohne Kopf und ggf. über das Pufferende umgebrochen.
+static const uint8_t TRACE_FORMAT_VERSION = 1;
+
+struct TraceHeader {
+  uint32_t exported_ms;
+  uint32_t count;
+  uint32_t dropped;
+};
+
+struct TraceRecord {
+  uint8_t type;  // TraceType
+  uint32_t time_ms;
+  const uint8_t *data;
+  uint8_t len;
+};
+
+// Liest einen Export, z.B. im Werkzeug elm327_tracedump auf dem Host
+class ELM327TraceReader {
+ public:
+  // false = kein Trace (anderes Format oder zu kurz)
+  bool open(const uint8_t *data, size_t len);
+  bool next(TraceRecord &record);
+  const TraceHeader &header() const { return this->header_; }
+  // Nutzdaten eines TRACE_EVENT
+  static bool decode_event(const TraceRecord &record, TraceEvent &event, uint32_t &value);
+
+ protected:
+  const uint8_t *data_{nullptr};
+  size_t len_{0};
+  size_t pos_{0};
+  TraceHeader header_{};
+};
+
+// Mitschnitt der Kommunikation mit dem Adapter in einem Ring fester Größe: gesendete
+// Befehle, empfangene Notify-Chunks und BLE-Ereignisse mit Zeitstempel. Ein Eintrag
+// kostet einen memcpy, volle Ringe überschreiben die ältesten Einträge.
+class ELM327Trace {
+ public:
+  static const size_t HEADER_SIZE = 16;
+  static const size_t RECORD_HEADER_SIZE = 6;
+  static const size_t MAX_PAYLOAD = 255;  // längere Chunks werden auf mehrere Einträge verteilt
+
+  void set_buffer(uint8_t *buffer, size_t size);
+  bool is_enabled() const { return this->size_ > 0; }
+
+  void add(TraceType type, const uint8_t *data, size_t len, uint32_t now);
+  void add_event(TraceEvent event, uint32_t value, uint32_t now);
+
+  // Größe des Exports bzw. Kopie mit Kopf nach out (export_size() Bytes)
+  size_t export_size() const { return HEADER_SIZE + this->used_; }
+  void export_to(uint8_t *out, uint32_t now) const;
+  void clear();
+
+  uint32_t get_count() const { return this->count_; }
+  uint32_t get_dropped() const { return this->dropped_; }
+  size_t get_size() const { return this->size_; }
+
+ protected:
+  void add_record_(TraceType type, const uint8_t *data, size_t len, uint32_t now);
+  void copy_in_(size_t pos, const uint8_t *data, size_t len);
+  void copy_out_(size_t pos, uint8_t *out, size_t len) const;
+
+  uint8_t *buffer_{nullptr};
+  size_t size_{0};
+  size_t start_{0};  // ältester Eintrag
+  size_t used_{0};
+  uint32_t count_{0};    // Einträge im Ring
+  uint32_t dropped_{0};  // überschrieben
+};
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -0,0 +1,109 @@
+#include "elm327_trip.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace elm327_ble {
+
+static const char *TAG = "elm327_ble.trip";
+
+void ELM327TripComputer::add_sample(uint8_t pid, float value, uint32_t now) {
+  if (!this->enabled_ || std::isnan(value))
+    return;
+
+  switch (pid) {
+    case 0x0D: {
+      // Strecke: Trapez zwischen zwei Geschwindigkeiten, Leerlauf: Stillstand bei laufendem Motor
+      uint32_t dt = gap(this->speed_, now);
+      if (dt > 0) {
+        this->totals_.distance_km += (this->speed_.value + value) / 2.0 * dt / 3600000.0;
+        if (this->speed_.value < 1.0f && value < 1.0f && this->engine_running(now))
+          this->totals_.idle_s += dt / 1000.0;
+        this->revision_++;
+      }
+      this->speed_ = {value, now};
+      break;
+    }
+    case 0x5E:
+      this->fuel_rate_pid_ = true;
+      this->add_fuel_rate(value, now);
+      break;
+    case 0x10:
+      // Luftmasse g/s → Kraftstoff L/h über das stöchiometrische Verhältnis
+      if (!this->fuel_rate_pid_)
+        this->add_fuel_rate(value * 3600.0f / this->air_fuel_ratio_ / this->fuel_density_, now);
+      break;
+    case 0x0C:
+      this->rpm_ = {value, now};
+      break;
+    case 0x1F: {
+      uint16_t runtime = (uint16_t) value;
+      if ((this->totals_.flags & TRIP_FLAG_RUNTIME) && runtime < this->totals_.runtime_s &&
+          this->reset_on_engine_start_) {
+        ESP_LOGI(TAG, "Motor neu gestartet, neue Fahrt nach %.1f km", this->totals_.distance_km);
+        this->reset();
+      }
+      if (runtime != this->totals_.runtime_s || !(this->totals_.flags & TRIP_FLAG_RUNTIME))
+        this->revision_++;
+      this->totals_.runtime_s = runtime;
+      this->totals_.flags |= TRIP_FLAG_RUNTIME;
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void ELM327TripComputer::add_fuel_rate(float liters_per_hour, uint32_t now) {
+  uint32_t dt = gap(this->fuel_rate_, now);
+  if (dt > 0) {
+    this->totals_.fuel_l += (this->fuel_rate_.value + liters_per_hour) / 2.0 * dt / 3600000.0;
+    this->revision_++;
+  }
+  this->fuel_rate_ = {liters_per_hour, now};
+}
+
+// Ohne Drehzahl-Sensor gilt der Motor als laufend, solange das Steuergerät antwortet
+bool ELM327TripComputer::engine_running(uint32_t now) const {
+  if (std::isnan(this->rpm_.value) || now - this->rpm_.time > MAX_GAP_MS)
+    return true;
+  return this->rpm_.value > 0;
+}
+
+void ELM327TripComputer::reset() {
+  // Laufzeit bleibt, damit der nächste Motorstart erkannt wird
+  uint16_t runtime = this->totals_.runtime_s;
+  uint8_t flags = this->totals_.flags;
+  this->totals_ = {};
+  this->totals_.runtime_s = runtime;
+  this->totals_.flags = flags;
+  this->revision_++;
+}
+
+void ELM327TripComputer::restore(const TripTotals &totals) {
+  this->totals_ = totals;
+  this->revision_++;
+}
+
+float ELM327TripComputer::value(TripValue type) const {
+  switch (type) {
+    case TRIP_DISTANCE:
+      return this->totals_.distance_km;
+    case TRIP_FUEL_USED:
+      return this->totals_.fuel_l;
+    case TRIP_CONSUMPTION:
+      if (std::isnan(this->fuel_rate_.value) || !(this->speed_.value >= MIN_CONSUMPTION_SPEED))
+        return NAN;
+      return this->fuel_rate_.value / this->speed_.value * 100.0f;
+    case TRIP_AVERAGE_CONSUMPTION:
+      if (this->totals_.distance_km < 0.1)
+        return NAN;
+      return this->totals_.fuel_l / this->totals_.distance_km * 100.0;
+    case TRIP_IDLE_TIME:
+      return this->totals_.idle_s;
+    default:
+      return NAN;
+  }
+}
+
+}  // namespace elm327_ble
+}  // namespace esphome
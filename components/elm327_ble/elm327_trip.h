@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace esphome {
+namespace elm327_ble {
+
+// Abgeleitete Fahrtwerte (sensor.py: TRIP_TYPES)
+enum TripValue : uint8_t {
+  TRIP_DISTANCE,             // km
+  TRIP_FUEL_USED,            // L
+  TRIP_CONSUMPTION,          // L/100 km momentan, NAN unter MIN_CONSUMPTION_SPEED
+  TRIP_AVERAGE_CONSUMPTION,  // L/100 km seit Fahrtbeginn
+  TRIP_IDLE_TIME,            // s mit laufendem Motor im Stand
+  TRIP_VALUE_COUNT,
+};
+
+// Summen einer Fahrt, werden im NVS gespeichert. double, damit kleine Schritte
+// (0,003 km pro Abfrage) auch nach vielen tausend Kilometern nicht untergehen.
+struct TripTotals {
+  double distance_km;
+  double fuel_l;
+  double idle_s;
+  uint16_t runtime_s;  // letzter Wert von PID 0x1F, kleiner = Motor neu gestartet
+  uint8_t flags;       // TRIP_FLAG_*
+};
+
+static const uint8_t TRIP_FLAG_RUNTIME = 1 << 0;  // runtime_s ist gültig
+
+// Bordcomputer: integriert die ohnehin abgefragten Werte (0x0D Geschwindigkeit,
+// 0x5E Kraftstoffverbrauch bzw. 0x10 Luftmasse, 0x0C Drehzahl, 0x1F Laufzeit)
+// bei jedem dekodierten Wert, ohne zusätzliche Anfragen. Zwischen zwei Werten
+// wird linear interpoliert, Lücken über MAX_GAP_MS (Verbindungsabbruch, Stand)
+// werden nicht überbrückt.
+class ELM327TripComputer {
+ public:
+  void set_enabled(bool enabled) { this->enabled_ = enabled; }
+  bool is_enabled() const { return this->enabled_; }
+  // Für die Schätzung aus der Luftmasse, wenn das Fahrzeug 0x5E nicht meldet
+  void set_air_fuel_ratio(float ratio) { this->air_fuel_ratio_ = ratio; }
+  void set_fuel_density(float grams_per_liter) { this->fuel_density_ = grams_per_liter; }
+  // Neue Fahrt, sobald die Motorlaufzeit (0x1F) wieder bei 0 beginnt
+  void set_reset_on_engine_start(bool reset) { this->reset_on_engine_start_ = reset; }
+  float get_air_fuel_ratio() const { return this->air_fuel_ratio_; }
+  float get_fuel_density() const { return this->fuel_density_; }
+  bool get_reset_on_engine_start() const { return this->reset_on_engine_start_; }
+
+  // Dekodierter Mode-01-Wert, andere PIDs werden ignoriert
+  void add_sample(uint8_t pid, float value, uint32_t now);
+  void reset();
+  void restore(const TripTotals &totals);
+
+  float value(TripValue type) const;
+  const TripTotals &totals() const { return this->totals_; }
+  // Ändert sich mit jeder Änderung der Summen (Veröffentlichen, Speichern)
+  uint32_t revision() const { return this->revision_; }
+  // Verbrauch aus der Luftmasse geschätzt (kein 0x5E)
+  bool is_fuel_estimated() const { return !this->fuel_rate_pid_ && !std::isnan(this->fuel_rate_.value); }
+
+  static constexpr uint32_t MAX_GAP_MS = 10000;
+  static constexpr float MIN_CONSUMPTION_SPEED = 5.0f;  // km/h
+
+ protected:
+  struct Sample {
+    float value{NAN};
+    uint32_t time{0};
+  };
+
+  // Zeit seit dem letzten Wert in ms, 0 = kein verwertbarer Vorgänger
+  static uint32_t gap(const Sample &last, uint32_t now) {
+    if (std::isnan(last.value) || now - last.time > MAX_GAP_MS)
+      return 0;
+    return now - last.time;
+  }
+  void add_fuel_rate(float liters_per_hour, uint32_t now);
+  bool engine_running(uint32_t now) const;
+
+  bool enabled_{false};
+  float air_fuel_ratio_{14.7f};
+  float fuel_density_{745.0f};  // g/L
+  bool reset_on_engine_start_{false};
+
+  TripTotals totals_{};
+  uint32_t revision_{0};
+  Sample speed_;      // km/h
+  Sample fuel_rate_;  // L/h
+  Sample rpm_;
+  bool fuel_rate_pid_{false};  // 0x5E geliefert, Luftmasse wird dann ignoriert
+};
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace elm327_ble {
+
+// Formel-Art eines Mode-01-PIDs
+enum PIDFormula : uint8_t {
+  FORMULA_RAW,     // Länge bekannt, Formel nicht: Rohwert A
+  FORMULA_A,       // A * scale + offset
+  FORMULA_AB,      // ((A * 256) + B) * scale + offset
+  FORMULA_BITMAP,  // Bitfeld (z.B. unterstützte PIDs), kein Messwert
+};
+
+// Beschreibung eines PIDs: Datenlänge in Bytes (0 = unbekannt/variabel) und Umrechnung
+struct PIDDescriptor {
+  uint8_t pid;
+  uint8_t length;
+  PIDFormula formula;
+  float scale;
+  float offset;
+};
+
+// Mode-01-PIDs laut SAE J1979, Index = PID
+static constexpr PIDDescriptor OBD2_PID_TABLE[] = {
+    {0x00, 4, FORMULA_BITMAP, 1.0f, 0.0f},           // Unterstützte PIDs 01-20
+    {0x01, 4, FORMULA_BITMAP, 1.0f, 0.0f},           // Monitorstatus seit Fehlerlöschen
+    {0x02, 2, FORMULA_RAW, 1.0f, 0.0f},              // Freeze-Frame-DTC
+    {0x03, 2, FORMULA_BITMAP, 1.0f, 0.0f},           // Kraftstoffsystem-Status
+    {0x04, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Motorlast: A*100/255
+    {0x05, 1, FORMULA_A, 1.0f, -40.0f},              // Kühlmitteltemperatur: A - 40
+    {0x06, 1, FORMULA_A, 100.0f / 128.0f, -100.0f},  // Kurzzeit-Kraftstofftrimm Bank 1
+    {0x07, 1, FORMULA_A, 100.0f / 128.0f, -100.0f},  // Langzeit-Kraftstofftrimm Bank 1
+    {0x08, 1, FORMULA_A, 100.0f / 128.0f, -100.0f},  // Kurzzeit-Kraftstofftrimm Bank 2
+    {0x09, 1, FORMULA_A, 100.0f / 128.0f, -100.0f},  // Langzeit-Kraftstofftrimm Bank 2
+    {0x0A, 1, FORMULA_A, 3.0f, 0.0f},                // Kraftstoffdruck: 3*A
+    {0x0B, 1, FORMULA_A, 1.0f, 0.0f},                // MAP: A
+    {0x0C, 2, FORMULA_AB, 0.25f, 0.0f},              // Drehzahl: ((A*256)+B)/4
+    {0x0D, 1, FORMULA_A, 1.0f, 0.0f},                // Geschwindigkeit: A
+    {0x0E, 1, FORMULA_A, 0.5f, -64.0f},              // Zündzeitpunkt: A/2 - 64
+    {0x0F, 1, FORMULA_A, 1.0f, -40.0f},              // Ansauglufttemperatur: A - 40
+    {0x10, 2, FORMULA_AB, 0.01f, 0.0f},              // MAF: ((A*256)+B)/100
+    {0x11, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Drosselklappe: A*100/255
+    {0x12, 1, FORMULA_RAW, 1.0f, 0.0f},              // Sekundärluft-Status
+    {0x13, 1, FORMULA_BITMAP, 1.0f, 0.0f},           // Vorhandene Lambdasonden
+    {0x14, 2, FORMULA_A, 0.005f, 0.0f},              // Lambdasonde 1: A/200 V
+    {0x15, 2, FORMULA_A, 0.005f, 0.0f},              // Lambdasonde 2
+    {0x16, 2, FORMULA_A, 0.005f, 0.0f},              // Lambdasonde 3
+    {0x17, 2, FORMULA_A, 0.005f, 0.0f},              // Lambdasonde 4
+    {0x18, 2, FORMULA_A, 0.005f, 0.0f},              // Lambdasonde 5
+    {0x19, 2, FORMULA_A, 0.005f, 0.0f},              // Lambdasonde 6
+    {0x1A, 2, FORMULA_A, 0.005f, 0.0f},              // Lambdasonde 7
+    {0x1B, 2, FORMULA_A, 0.005f, 0.0f},              // Lambdasonde 8
+    {0x1C, 1, FORMULA_RAW, 1.0f, 0.0f},              // OBD-Standard
+    {0x1D, 1, FORMULA_BITMAP, 1.0f, 0.0f},           // Vorhandene Lambdasonden (4 Bänke)
+    {0x1E, 1, FORMULA_BITMAP, 1.0f, 0.0f},           // Nebenantrieb-Status
+    {0x1F, 2, FORMULA_AB, 1.0f, 0.0f},               // Motorlaufzeit: (A*256)+B
+    {0x20, 4, FORMULA_BITMAP, 1.0f, 0.0f},           // Unterstützte PIDs 21-40
+    {0x21, 2, FORMULA_AB, 1.0f, 0.0f},               // Strecke mit MIL an (km)
+    {0x22, 2, FORMULA_AB, 0.079f, 0.0f},             // Kraftstoffverteilerdruck relativ (kPa)
+    {0x23, 2, FORMULA_AB, 10.0f, 0.0f},              // Kraftstoffverteilerdruck (kPa)
+    {0x24, 4, FORMULA_RAW, 1.0f, 0.0f},              // Lambdasonde 1 (Breitband)
+    {0x25, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x26, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x27, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x28, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x29, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x2A, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x2B, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x2C, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // AGR-Sollwert
+    {0x2D, 1, FORMULA_A, 100.0f / 128.0f, -100.0f},  // AGR-Abweichung
+    {0x2E, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // AGR: A*100/255
+    {0x2F, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Kraftstoffstand: A*100/255
+    {0x30, 1, FORMULA_A, 1.0f, 0.0f},                // Warmlaufzyklen seit Fehlerlöschen
+    {0x31, 2, FORMULA_AB, 1.0f, 0.0f},               // Strecke seit Fehlerlöschen (km)
+    {0x32, 2, FORMULA_RAW, 1.0f, 0.0f},              // Dampfdruck Tankentlüftung
+    {0x33, 1, FORMULA_A, 1.0f, 0.0f},                // Barometrischer Druck: A
+    {0x34, 4, FORMULA_RAW, 1.0f, 0.0f},              // Lambdasonde 1 (Strom)
+    {0x35, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x36, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x37, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x38, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x39, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x3A, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x3B, 4, FORMULA_RAW, 1.0f, 0.0f},
+    {0x3C, 2, FORMULA_AB, 0.1f, -40.0f},             // Katalysatortemperatur B1S1
+    {0x3D, 2, FORMULA_AB, 0.1f, -40.0f},             // Katalysatortemperatur B2S1
+    {0x3E, 2, FORMULA_AB, 0.1f, -40.0f},             // Katalysatortemperatur B1S2
+    {0x3F, 2, FORMULA_AB, 0.1f, -40.0f},             // Katalysatortemperatur B2S2
+    {0x40, 4, FORMULA_BITMAP, 1.0f, 0.0f},           // Unterstützte PIDs 41-60
+    {0x41, 4, FORMULA_BITMAP, 1.0f, 0.0f},           // Monitorstatus dieses Fahrzyklus
+    {0x42, 2, FORMULA_AB, 0.001f, 0.0f},             // ECU Spannung: ((A*256)+B)/1000
+    {0x43, 2, FORMULA_AB, 100.0f / 255.0f, 0.0f},    // Absolute Last
+    {0x44, 2, FORMULA_AB, 2.0f / 65536.0f, 0.0f},    // Lambda-Sollwert
+    {0x45, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Relative Drosselklappenstellung
+    {0x46, 1, FORMULA_A, 1.0f, -40.0f},              // Umgebungstemperatur: A - 40
+    {0x47, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Drosselklappe B
+    {0x48, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Drosselklappe C
+    {0x49, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Fahrpedal D
+    {0x4A, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Fahrpedal E
+    {0x4B, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Fahrpedal F
+    {0x4C, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Drosselklappen-Sollwert
+    {0x4D, 2, FORMULA_AB, 1.0f, 0.0f},               // Laufzeit mit MIL an (min)
+    {0x4E, 2, FORMULA_AB, 1.0f, 0.0f},               // Zeit seit Fehlerlöschen (min)
+    {0x4F, 4, FORMULA_RAW, 1.0f, 0.0f},              // Maximalwerte Lambda/Spannung/Strom/MAP
+    {0x50, 4, FORMULA_A, 10.0f, 0.0f},               // Maximalwert MAF: A*10
+    {0x51, 1, FORMULA_RAW, 1.0f, 0.0f},              // Kraftstoffart
+    {0x52, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Ethanol-Anteil
+    {0x53, 2, FORMULA_AB, 0.005f, 0.0f},             // Dampfdruck Tankentlüftung absolut
+    {0x54, 2, FORMULA_RAW, 1.0f, 0.0f},              // Dampfdruck Tankentlüftung
+    {0x55, 2, FORMULA_A, 100.0f / 128.0f, -100.0f},  // Kurzzeit-Trimm Sekundär-Lambda B1/B3
+    {0x56, 2, FORMULA_A, 100.0f / 128.0f, -100.0f},  // Langzeit-Trimm Sekundär-Lambda B1/B3
+    {0x57, 2, FORMULA_A, 100.0f / 128.0f, -100.0f},  // Kurzzeit-Trimm Sekundär-Lambda B2/B4
+    {0x58, 2, FORMULA_A, 100.0f / 128.0f, -100.0f},  // Langzeit-Trimm Sekundär-Lambda B2/B4
+    {0x59, 2, FORMULA_AB, 10.0f, 0.0f},              // Kraftstoffverteilerdruck absolut (kPa)
+    {0x5A, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Relative Fahrpedalstellung
+    {0x5B, 1, FORMULA_A, 100.0f / 255.0f, 0.0f},     // Restlebensdauer Hybridbatterie
+    {0x5C, 1, FORMULA_A, 1.0f, -40.0f},              // Öltemperatur: A - 40
+    {0x5D, 2, FORMULA_AB, 1.0f / 128.0f, -210.0f},   // Einspritzzeitpunkt
+    {0x5E, 2, FORMULA_AB, 0.05f, 0.0f},              // Kraftstoffverbrauch: ((A*256)+B)/20
+    {0x5F, 1, FORMULA_BITMAP, 1.0f, 0.0f},           // Emissionsanforderungen
+    {0x60, 4, FORMULA_BITMAP, 1.0f, 0.0f},           // Unterstützte PIDs 61-80
+    {0x61, 1, FORMULA_A, 1.0f, -125.0f},             // Fahrer-Sollmoment (%)
+    {0x62, 1, FORMULA_A, 1.0f, -125.0f},             // Ist-Motormoment (%)
+    {0x63, 2, FORMULA_AB, 1.0f, 0.0f},               // Referenzmoment (Nm)
+    {0x64, 5, FORMULA_RAW, 1.0f, 0.0f},              // Motormoment-Stützstellen
+};
+
+static constexpr size_t OBD2_PID_TABLE_SIZE = sizeof(OBD2_PID_TABLE) / sizeof(OBD2_PID_TABLE[0]);
+
+constexpr bool obd2_pid_table_is_indexed(size_t i = 0) {
+  return i >= OBD2_PID_TABLE_SIZE || (OBD2_PID_TABLE[i].pid == i && obd2_pid_table_is_indexed(i + 1));
+}
+static_assert(obd2_pid_table_is_indexed(), "OBD2_PID_TABLE muss nach PID sortiert und lückenlos sein");
+
+// Beschreibung eines Mode-01-PIDs, nullptr = nicht in der Tabelle
+inline const PIDDescriptor *lookup_pid(uint8_t pid) {
+  return pid < OBD2_PID_TABLE_SIZE ? &OBD2_PID_TABLE[pid] : nullptr;
+}
+
+// Wert aus den Datenbytes berechnen (data muss descriptor.length Bytes enthalten)
+inline float decode_pid_value(const PIDDescriptor &descriptor, const uint8_t *data) {
+  switch (descriptor.formula) {
+    case FORMULA_A:
+      return data[0] * descriptor.scale + descriptor.offset;
+    case FORMULA_AB:
+      return ((data[0] * 256) + data[1]) * descriptor.scale + descriptor.offset;
+    default:
+      return data[0];
+  }
+}
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -1,3 +1,5 @@
+import re
+
 import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome.components import sensor
@@ -8,22 +10,45 @@ from esphome.const import (
     CONF_UNIT_OF_MEASUREMENT,
     CONF_ACCURACY_DECIMALS,
     CONF_DEVICE_CLASS,
+    CONF_UPDATE_INTERVAL,
+    CONF_ENTITY_CATEGORY,
+    CONF_STATE_CLASS,
+    ENTITY_CATEGORY_DIAGNOSTIC,
     STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
     DEVICE_CLASS_TEMPERATURE,
     DEVICE_CLASS_VOLTAGE,
     DEVICE_CLASS_PRESSURE,
     DEVICE_CLASS_SPEED,
+    DEVICE_CLASS_DISTANCE,
+    DEVICE_CLASS_VOLUME,
+    DEVICE_CLASS_DURATION,
     UNIT_CELSIUS,
     UNIT_PERCENT,
     UNIT_VOLT,
+    UNIT_MILLISECOND,
+    UNIT_KILOMETER,
+    UNIT_SECOND,
 )
 
-from . import ELM327BLEHub, CONF_ELM327_BLE_ID, elm327_ble_ns
+from . import ELM327BLEHub, CONF_ELM327_BLE_ID, elm327_ble_ns, validate_header
 
 CONF_PID = "pid"
 CONF_MODE = "mode"
 CONF_AT_COMMAND = "at_command"
 CONF_TYPE = "type"
+CONF_PRIORITY = "priority"
+CONF_DATA_BYTES = "data_bytes"
+CONF_SCALE = "scale"
+CONF_OFFSET = "offset"
+CONF_DEADBAND = "deadband"
+CONF_CAN_ID = "can_id"
+CONF_START_BYTE = "start_byte"
+CONF_HEARTBEAT = "heartbeat"
+CONF_DID = "did"
+CONF_HEADER = "header"
+CONF_ECU = "ecu"
+CONF_FORMULA = "formula"
 
 # Vordefinierte PID-Typen mit Standardwerten
 PID_TYPES = {
@@ -34,6 +59,8 @@ PID_TYPES = {
         "accuracy": 0,
         "device_class": DEVICE_CLASS_TEMPERATURE,
         "icon": "mdi:thermometer",
+        "update_interval": "10s",
+        "priority": 0,
     },
     "rpm": {
         "name": "Drehzahl",
@@ -42,6 +69,8 @@ PID_TYPES = {
         "accuracy": 0,
         "device_class": "",
         "icon": "mdi:engine",
+        "update_interval": "0s",
+        "priority": 2,
     },
     "speed": {
         "name": "Geschwindigkeit",
@@ -50,6 +79,8 @@ PID_TYPES = {
         "accuracy": 0,
         "device_class": "",
         "icon": "mdi:speedometer",
+        "update_interval": "0s",
+        "priority": 2,
     },
     "engine_load": {
         "name": "Motorlast",
@@ -58,6 +89,8 @@ PID_TYPES = {
         "accuracy": 1,
         "device_class": "",
         "icon": "mdi:gauge",
+        "update_interval": "0s",
+        "priority": 1,
     },
     "intake_temp": {
         "name": "Ansauglufttemperatur",
@@ -66,6 +99,8 @@ PID_TYPES = {
         "accuracy": 0,
         "device_class": DEVICE_CLASS_TEMPERATURE,
         "icon": "mdi:air-filter",
+        "update_interval": "10s",
+        "priority": 0,
     },
     "fuel_level": {
         "name": "Kraftstoffstand",
@@ -74,6 +109,8 @@ PID_TYPES = {
         "accuracy": 1,
         "device_class": "",
         "icon": "mdi:gas-station",
+        "update_interval": "60s",
+        "priority": 0,
     },
     "throttle": {
         "name": "Drosselklappe",
@@ -82,6 +119,8 @@ PID_TYPES = {
         "accuracy": 1,
         "device_class": "",
         "icon": "mdi:car-cruise-control",
+        "update_interval": "0s",
+        "priority": 2,
     },
     "battery_voltage": {
         "name": "Batteriespannung",
@@ -91,6 +130,8 @@ PID_TYPES = {
         "accuracy": 1,
         "device_class": DEVICE_CLASS_VOLTAGE,
         "icon": "mdi:car-battery",
+        "update_interval": "10s",
+        "priority": 0,
     },
     "intake_map": {
         "name": "Ansaugkrümmerdruck",
@@ -99,6 +140,8 @@ PID_TYPES = {
         "accuracy": 0,
         "device_class": DEVICE_CLASS_PRESSURE,
         "icon": "mdi:gauge-low",
+        "update_interval": "0s",
+        "priority": 1,
     },
     "maf": {
         "name": "Luftmassenmesser",
@@ -107,6 +150,8 @@ PID_TYPES = {
         "accuracy": 2,
         "device_class": "",
         "icon": "mdi:weather-windy",
+        "update_interval": "0s",
+        "priority": 1,
     },
     "engine_runtime": {
         "name": "Motorlaufzeit",
@@ -115,6 +160,8 @@ PID_TYPES = {
         "accuracy": 0,
         "device_class": "",
         "icon": "mdi:timer-outline",
+        "update_interval": "10s",
+        "priority": 0,
     },
     "oil_temp": {
         "name": "Motoröltemperatur",
@@ -123,6 +170,8 @@ PID_TYPES = {
         "accuracy": 0,
         "device_class": DEVICE_CLASS_TEMPERATURE,
         "icon": "mdi:oil-temperature",
+        "update_interval": "10s",
+        "priority": 0,
     },
     "ambient_temp": {
         "name": "Umgebungstemperatur",
@@ -131,6 +180,8 @@ PID_TYPES = {
         "accuracy": 0,
         "device_class": DEVICE_CLASS_TEMPERATURE,
         "icon": "mdi:thermometer",
+        "update_interval": "60s",
+        "priority": 0,
     },
     "ecu_voltage": {
         "name": "ECU Spannung",
@@ -139,6 +190,8 @@ PID_TYPES = {
         "accuracy": 3,
         "device_class": DEVICE_CLASS_VOLTAGE,
         "icon": "mdi:flash",
+        "update_interval": "10s",
+        "priority": 0,
     },
     "fuel_rate": {
         "name": "Kraftstoffverbrauch",
@@ -147,6 +200,8 @@ PID_TYPES = {
         "accuracy": 2,
         "device_class": "",
         "icon": "mdi:fuel",
+        "update_interval": "0s",
+        "priority": 1,
     },
     "baro_pressure": {
         "name": "Barometrischer Druck",
@@ -155,6 +210,8 @@ PID_TYPES = {
         "accuracy": 0,
         "device_class": DEVICE_CLASS_PRESSURE,
         "icon": "mdi:weather-partly-cloudy",
+        "update_interval": "60s",
+        "priority": 0,
     },
     "egr": {
         "name": "Abgasrückführung",
@@ -163,12 +220,344 @@ PID_TYPES = {
         "accuracy": 1,
         "device_class": "",
         "icon": "mdi:recycle",
+        "update_interval": "0s",
+        "priority": 0,
+    },
+}
+
+
+StatType = elm327_ble_ns.enum("StatType")
+
+# Diagnose-Sensoren: Verbindungsstatistik des Hubs statt Fahrzeugwerten.
+# "per_pid" = mit `pid:` auf einen abgefragten PID einschränkbar.
+STAT_TYPES = {
+    "latency_min": {
+        "name": "OBD Latenz min",
+        "stat": StatType.STAT_LATENCY_MIN,
+        "unit": UNIT_MILLISECOND,
+        "icon": "mdi:timer-outline",
+        "counter": False,
+        "per_pid": True,
+    },
+    "latency_avg": {
+        "name": "OBD Latenz",
+        "stat": StatType.STAT_LATENCY_AVG,
+        "unit": UNIT_MILLISECOND,
+        "icon": "mdi:timer-outline",
+        "counter": False,
+        "per_pid": True,
+    },
+    "latency_p95": {
+        "name": "OBD Latenz p95",
+        "stat": StatType.STAT_LATENCY_P95,
+        "unit": UNIT_MILLISECOND,
+        "icon": "mdi:timer-alert-outline",
+        "counter": False,
+        "per_pid": True,
+    },
+    "responses_per_second": {
+        "name": "OBD Antworten pro Sekunde",
+        "stat": StatType.STAT_RESPONSE_RATE,
+        "unit": "1/s",
+        "accuracy": 1,
+        "icon": "mdi:swap-vertical",
+        "counter": False,
+        "per_pid": True,
+    },
+    "timeouts": {
+        "name": "OBD Timeouts",
+        "stat": StatType.STAT_TIMEOUTS,
+        "unit": "",
+        "icon": "mdi:timer-off-outline",
+        "counter": True,
+        "per_pid": True,
+    },
+    "no_data": {
+        "name": "OBD NO DATA",
+        "stat": StatType.STAT_NO_DATA,
+        "unit": "",
+        "icon": "mdi:database-off-outline",
+        "counter": True,
+        "per_pid": True,
+    },
+    "errors": {
+        "name": "OBD Fehlerantworten",
+        "stat": StatType.STAT_ERRORS,
+        "unit": "",
+        "icon": "mdi:alert-circle-outline",
+        "counter": True,
+        "per_pid": True,
+    },
+    "write_failures": {
+        "name": "BLE Schreibfehler",
+        "stat": StatType.STAT_WRITE_FAILURES,
+        "unit": "",
+        "icon": "mdi:bluetooth-off",
+        "counter": True,
+        "per_pid": False,
+    },
+    "reconnects": {
+        "name": "BLE Reconnects",
+        "stat": StatType.STAT_RECONNECTS,
+        "unit": "",
+        "icon": "mdi:bluetooth-connect",
+        "counter": True,
+        "per_pid": False,
+    },
+    "connection_interval": {
+        "name": "BLE Verbindungsintervall",
+        "stat": StatType.STAT_CONNECTION_INTERVAL,
+        "unit": UNIT_MILLISECOND,
+        "accuracy": 2,  # Vielfache von 1,25 ms
+        "icon": "mdi:bluetooth-settings",
+        "counter": False,
+        "per_pid": False,
+    },
+    # ATST, mit adaptive_timing aus den gemessenen Antwortzeiten
+    "adapter_timeout": {
+        "name": "OBD Adapter-Timeout",
+        "stat": StatType.STAT_ADAPTER_TIMEOUT,
+        "unit": UNIT_MILLISECOND,
+        "icon": "mdi:timer-cog-outline",
+        "counter": False,
+        "per_pid": False,
+    },
+}
+
+
+TripValue = elm327_ble_ns.enum("TripValue")
+
+# Bordcomputer: aus Geschwindigkeit, Verbrauch/Luftmasse und Laufzeit berechnet,
+# ohne eigene Anfragen. "total" = Summe seit Fahrtbeginn (im Flash gespeichert).
+TRIP_TYPES = {
+    "trip_distance": {
+        "name": "Fahrtstrecke",
+        "trip": TripValue.TRIP_DISTANCE,
+        "unit": UNIT_KILOMETER,
+        "accuracy": 2,
+        "device_class": DEVICE_CLASS_DISTANCE,
+        "icon": "mdi:map-marker-distance",
+        "total": True,
+    },
+    "trip_fuel_used": {
+        "name": "Verbrauchter Kraftstoff",
+        "trip": TripValue.TRIP_FUEL_USED,
+        "unit": "L",
+        "accuracy": 2,
+        "device_class": DEVICE_CLASS_VOLUME,
+        "icon": "mdi:fuel",
+        "total": True,
+    },
+    "fuel_consumption": {
+        "name": "Momentanverbrauch",
+        "trip": TripValue.TRIP_CONSUMPTION,
+        "unit": "L/100km",
+        "accuracy": 1,
+        "device_class": None,
+        "icon": "mdi:gauge",
+        "total": False,
+    },
+    "average_consumption": {
+        "name": "Durchschnittsverbrauch",
+        "trip": TripValue.TRIP_AVERAGE_CONSUMPTION,
+        "unit": "L/100km",
+        "accuracy": 1,
+        "device_class": None,
+        "icon": "mdi:gas-station-outline",
+        "total": False,
+    },
+    "idle_time": {
+        "name": "Leerlaufzeit",
+        "trip": TripValue.TRIP_IDLE_TIME,
+        "unit": UNIT_SECOND,
+        "accuracy": 0,
+        "device_class": DEVICE_CLASS_DURATION,
+        "icon": "mdi:timer-sand",
+        "total": True,
     },
 }
 
 
+def validate_deadband(value):
+    """Absolute Mindeständerung (z.B. 50) oder relativ zum letzten Wert (z.B. "2%")."""
+    if isinstance(value, str) and value.strip().endswith("%"):
+        return {"value": cv.percentage(value), "percent": True}
+    return {"value": cv.positive_float(value), "percent": False}
+
+
+def validate_ecu(value):
+    """Antwort-ID: 3 Hex-Ziffern (11 Bit, z.B. 7E9) oder 8 (29 Bit, z.B. 18DAF118)."""
+    value = str(value).upper()
+    if not re.fullmatch(r"7E[89A-F]|18DAF1[0-9A-F]{2}", value):
+        raise cv.Invalid(
+            "Steuergerät muss eine OBD-Antwort-ID sein (7E8-7EF oder 18DAF1xx), z.B. 7E9"
+        )
+    return int(value, 16)
+
+
+def validate_stat_sensor(config):
+    """Standardwerte für Diagnose-Sensoren, Abfrage-Optionen sind hier sinnlos."""
+    defaults = STAT_TYPES[config[CONF_TYPE]]
+    for key in (
+        CONF_AT_COMMAND,
+        CONF_UPDATE_INTERVAL,
+        CONF_PRIORITY,
+        CONF_DATA_BYTES,
+        CONF_SCALE,
+        CONF_OFFSET,
+        CONF_DEADBAND,
+        CONF_HEARTBEAT,
+    ):
+        if key in config:
+            raise cv.Invalid(f"'{key}' ist bei type '{config[CONF_TYPE]}' nicht erlaubt")
+    if CONF_PID in config and not defaults["per_pid"]:
+        raise cv.Invalid(
+            f"type '{config[CONF_TYPE]}' gilt für den ganzen Hub, 'pid' nicht erlaubt"
+        )
+    if CONF_NAME not in config:
+        config[CONF_NAME] = defaults["name"]
+    if CONF_UNIT_OF_MEASUREMENT not in config and defaults["unit"]:
+        config[CONF_UNIT_OF_MEASUREMENT] = defaults["unit"]
+    if CONF_ACCURACY_DECIMALS not in config:
+        config[CONF_ACCURACY_DECIMALS] = defaults.get("accuracy", 0)
+    if CONF_ICON not in config:
+        config[CONF_ICON] = defaults["icon"]
+    if CONF_ENTITY_CATEGORY not in config:
+        config[CONF_ENTITY_CATEGORY] = cv.entity_category(ENTITY_CATEGORY_DIAGNOSTIC)
+    if defaults["counter"]:
+        # Zähler seit dem Start, beginnen nach einem Neustart wieder bei 0
+        config[CONF_STATE_CLASS] = sensor.validate_state_class(
+            STATE_CLASS_TOTAL_INCREASING
+        )
+    return config
+
+
+def validate_trip_sensor(config):
+    """Standardwerte für Bordcomputer-Sensoren, sie lösen keine Abfragen aus."""
+    defaults = TRIP_TYPES[config[CONF_TYPE]]
+    for key in (
+        CONF_PID,
+        CONF_DID,
+        CONF_HEADER,
+        CONF_ECU,
+        CONF_AT_COMMAND,
+        CONF_CAN_ID,
+        CONF_UPDATE_INTERVAL,
+        CONF_PRIORITY,
+        CONF_DATA_BYTES,
+        CONF_SCALE,
+        CONF_OFFSET,
+        CONF_FORMULA,
+        CONF_DEADBAND,
+        CONF_HEARTBEAT,
+    ):
+        if key in config:
+            raise cv.Invalid(f"'{key}' ist bei type '{config[CONF_TYPE]}' nicht erlaubt")
+    if CONF_NAME not in config:
+        config[CONF_NAME] = defaults["name"]
+    if CONF_UNIT_OF_MEASUREMENT not in config:
+        config[CONF_UNIT_OF_MEASUREMENT] = defaults["unit"]
+    if CONF_ACCURACY_DECIMALS not in config:
+        config[CONF_ACCURACY_DECIMALS] = defaults["accuracy"]
+    if CONF_DEVICE_CLASS not in config and defaults["device_class"]:
+        config[CONF_DEVICE_CLASS] = defaults["device_class"]
+    if CONF_ICON not in config:
+        config[CONF_ICON] = defaults["icon"]
+    if defaults["total"]:
+        # Summen wachsen bis reset_trip() oder zum nächsten Motorstart
+        config[CONF_STATE_CLASS] = sensor.validate_state_class(
+            STATE_CLASS_TOTAL_INCREASING
+        )
+    return config
+
+
+# Formel-Tokens: Zahlen, Datenbytes A-D, Operatoren und Klammern
+FORMULA_TOKEN = re.compile(r"\s*(?:(\d+\.\d*|\.\d+|\d+)|([A-D])|(<<|>>|[-+*/&|()]))")
+
+
+def compile_formula(formula):
+    """Übersetzt z.B. "(A*256+B)/100-40" in einen C++-Ausdruck über data[0..3].
+
+    Gibt (Ausdruck, benötigte Datenbytes) zurück. Die Formel wird beim Kompilieren
+    zu einer eigenen Funktion, zur Laufzeit wird nichts interpretiert.
+    """
+    cpp = []
+    py = []
+    pos = 0
+    length = 0
+    previous = "("  # Formelanfang verhält sich wie nach einer öffnenden Klammer
+    formula = formula.strip()
+    while pos < len(formula):
+        match = FORMULA_TOKEN.match(formula, pos)
+        if match is None or match.end() == pos:
+            raise cv.Invalid(
+                f"Ungültiges Zeichen in '{CONF_FORMULA}' an Position {pos + 1}: "
+                f"'{formula[pos:].strip()[:1]}'"
+            )
+        number, byte, op = match.groups()
+        if previous in ("<<", ">>") and not (number is not None and number.isdigit()
+                                             and int(number) < 32):
+            # int64_t verschiebt nur um 0..63 definiert, 0..31 reicht für 4 Bytes
+            raise cv.Invalid(
+                f"'{CONF_FORMULA}': nach '{previous}' muss eine ganze Zahl 0-31 stehen"
+            )
+        if number is not None:
+            if previous == "/" and float(number) == 0:
+                raise cv.Invalid(f"'{CONF_FORMULA}' teilt durch 0")
+            cpp.append(number + "f" if "." in number else number)
+            py.append(number)
+            previous = "number"
+        elif byte is not None:
+            index = ord(byte) - ord("A")
+            length = max(length, index + 1)
+            # 64 Bit, damit A<<24 oder A*256*256*256 nicht überlaufen
+            cpp.append(f"((int64_t) data[{index}])")
+            py.append(byte)
+            previous = "byte"
+        else:
+            # Vorzeichen-Minus nur am Anfang oder nach '(', sonst wäre z.B.
+            # "A**2" in Python gültig, in C++ aber nicht
+            if op not in "()" and previous not in ("number", "byte", ")") and not (
+                op == "-" and previous == "("
+            ):
+                raise cv.Invalid(
+                    f"'{CONF_FORMULA}': Operator '{op}' an Position {pos + 1} "
+                    "folgt keinem Wert"
+                )
+            # Division immer als Gleitkomma, wie in den OBD-Formeln gemeint
+            cpp.append("/ (float)" if op == "/" else op)
+            py.append(op)
+            previous = op
+        pos = match.end()
+    if length == 0:
+        raise cv.Invalid(f"'{CONF_FORMULA}' verwendet keines der Datenbytes A-D")
+    try:
+        code = compile(" ".join(py), "<formula>", "eval")
+    except SyntaxError as err:
+        raise cv.Invalid(f"'{CONF_FORMULA}' ist kein gültiger Ausdruck") from err
+    # Typen prüfen (Bit-Operatoren nur auf Ganzzahlen). Ein Teiler, der bei den
+    # Beispielbytes 0 wird (z.B. B-101), ist kein Fehler, dann andere Bytes nehmen.
+    for sample in ((37, 101, 211, 251), (149, 53, 7, 163)):
+        try:
+            eval(  # pylint: disable=eval-used
+                code, {"__builtins__": {}}, dict(zip("ABCD", sample))
+            )
+            break
+        except ZeroDivisionError:
+            continue
+        except TypeError as err:
+            raise cv.Invalid(
+                f"'{CONF_FORMULA}': Bit-Operatoren nur auf ganze Zahlen anwenden"
+            ) from err
+    return " ".join(cpp), length
+
+
 def validate_pid_sensor(config):
     """Setzt Standardwerte basierend auf dem PID-Typ."""
+    if config.get(CONF_TYPE) in STAT_TYPES:
+        return validate_stat_sensor(config)
+    if config.get(CONF_TYPE) in TRIP_TYPES:
+        return validate_trip_sensor(config)
     if CONF_TYPE in config:
         pid_type = config[CONF_TYPE]
         if pid_type in PID_TYPES:
@@ -187,6 +576,59 @@ def validate_pid_sensor(config):
                 config[CONF_ICON] = defaults["icon"]
             if CONF_DEVICE_CLASS not in config and defaults["device_class"]:
                 config[CONF_DEVICE_CLASS] = defaults["device_class"]
+            if CONF_UPDATE_INTERVAL not in config:
+                config[CONF_UPDATE_INTERVAL] = cv.positive_time_period_milliseconds(
+                    defaults["update_interval"]
+                )
+            if CONF_PRIORITY not in config:
+                config[CONF_PRIORITY] = defaults["priority"]
+    if CONF_DID in config:
+        # Mode 22 (UDS ReadDataByIdentifier) mit 16-Bit-DID
+        if CONF_PID in config:
+            raise cv.Invalid(f"'{CONF_PID}' und '{CONF_DID}' schließen sich aus")
+        config[CONF_MODE] = 0x22
+    if CONF_FORMULA in config:
+        for key in (CONF_SCALE, CONF_OFFSET, CONF_AT_COMMAND, CONF_CAN_ID):
+            if key in config:
+                raise cv.Invalid(
+                    f"'{key}' ist zusammen mit '{CONF_FORMULA}' nicht erlaubt"
+                )
+        expression, length = compile_formula(config[CONF_FORMULA])
+        config.setdefault(CONF_DATA_BYTES, length)
+        if config[CONF_DATA_BYTES] < length:
+            raise cv.Invalid(
+                f"'{CONF_FORMULA}' benötigt {length} Datenbytes, "
+                f"'{CONF_DATA_BYTES}' ist {config[CONF_DATA_BYTES]}"
+            )
+    if CONF_DID in config and CONF_DATA_BYTES not in config:
+        raise cv.Invalid(
+            f"'{CONF_DID}' benötigt '{CONF_DATA_BYTES}' oder '{CONF_FORMULA}'"
+        )
+    for key in (CONF_HEADER, CONF_ECU):
+        if key in config and CONF_PID not in config and CONF_DID not in config:
+            raise cv.Invalid(f"'{key}' benötigt '{CONF_PID}' oder '{CONF_DID}'")
+    if CONF_CAN_ID in config:
+        # Wert aus CAN-Broadcast (ATMA) statt aus einer Abfrage
+        for key in (
+            CONF_TYPE,
+            CONF_PID,
+            CONF_AT_COMMAND,
+            CONF_UPDATE_INTERVAL,
+            CONF_PRIORITY,
+        ):
+            if key in config:
+                raise cv.Invalid(
+                    f"'{key}' ist zusammen mit '{CONF_CAN_ID}' nicht erlaubt"
+                )
+        config.setdefault(CONF_DATA_BYTES, 1)
+        if config.get(CONF_START_BYTE, 0) + config[CONF_DATA_BYTES] > 8:
+            raise cv.Invalid(
+                f"'{CONF_START_BYTE}' + '{CONF_DATA_BYTES}' ist größer als 8"
+            )
+    elif CONF_START_BYTE in config:
+        raise cv.Invalid(f"'{CONF_START_BYTE}' benötigt '{CONF_CAN_ID}'")
+    if (CONF_SCALE in config or CONF_OFFSET in config) and CONF_DATA_BYTES not in config:
+        raise cv.Invalid(f"'{CONF_SCALE}'/'{CONF_OFFSET}' benötigen '{CONF_DATA_BYTES}'")
     return config
 
 
@@ -197,10 +639,37 @@ CONFIG_SCHEMA = cv.All(
     .extend(
         {
             cv.GenerateID(CONF_ELM327_BLE_ID): cv.use_id(ELM327BLEHub),
-            cv.Optional(CONF_TYPE): cv.one_of(*PID_TYPES, lower=True),
+            cv.Optional(CONF_TYPE): cv.one_of(
+                *PID_TYPES, *STAT_TYPES, *TRIP_TYPES, lower=True
+            ),
             cv.Optional(CONF_MODE, default=0x01): cv.hex_uint8_t,
             cv.Optional(CONF_PID): cv.hex_uint8_t,
             cv.Optional(CONF_AT_COMMAND): cv.string,
+            # Mode 22: herstellerspezifischer Wert, z.B. did: 0x1A10
+            cv.Optional(CONF_DID): cv.hex_uint16_t,
+            # Nur dieses Steuergerät fragen (ATSH), z.B. 7E1 = Getriebe
+            cv.Optional(CONF_HEADER): validate_header,
+            # Antwort-ID des Steuergeräts (7E9 oder 18DAF118), braucht headers: true am Hub
+            cv.Optional(CONF_ECU): validate_ecu,
+            # CAN-Broadcast: Frame-ID (11 oder 29 Bit) und erstes Datenbyte (Big Endian)
+            cv.Optional(CONF_CAN_ID): cv.All(
+                cv.hex_uint32_t, cv.Range(max=0x1FFFFFFF)
+            ),
+            cv.Optional(CONF_START_BYTE): cv.int_range(min=0, max=7),
+            # 0s = so oft wie möglich; Standardwerte je Typ in PID_TYPES
+            cv.Optional(CONF_UPDATE_INTERVAL): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_PRIORITY): cv.int_range(min=0, max=10),
+            # Eigene Formel: Wert = A * scale + offset (1 Byte)
+            # bzw. ((A * 256) + B) * scale + offset (ab 2 Bytes, CAN: alle Bytes)
+            cv.Optional(CONF_DATA_BYTES): cv.int_range(min=1, max=4),
+            cv.Optional(CONF_SCALE): cv.float_,
+            cv.Optional(CONF_OFFSET): cv.float_,
+            # Beliebige Formel über die Datenbytes A-D, z.B. "(A*256+B)/100-40"
+            cv.Optional(CONF_FORMULA): cv.string_strict,
+            # Nur veröffentlichen, wenn sich der Wert um mehr als deadband ändert,
+            # unveränderte Werte spätestens nach heartbeat erneut
+            cv.Optional(CONF_DEADBAND): validate_deadband,
+            cv.Optional(CONF_HEARTBEAT): cv.positive_time_period_milliseconds,
         }
     ),
     validate_pid_sensor,
@@ -211,7 +680,81 @@ async def to_code(config):
     hub = await cg.get_variable(config[CONF_ELM327_BLE_ID])
     var = await sensor.new_sensor(config)
 
-    if CONF_AT_COMMAND in config:
-        cg.add(hub.register_at_sensor(var, config[CONF_AT_COMMAND]))
+    interval = config.get(CONF_UPDATE_INTERVAL)
+    interval_ms = interval.total_milliseconds if interval is not None else 0
+    priority = config.get(CONF_PRIORITY, 0)
+    if config.get(CONF_TYPE) in STAT_TYPES:
+        cg.add(
+            hub.register_stats_sensor(
+                var, STAT_TYPES[config[CONF_TYPE]]["stat"], config.get(CONF_PID, -1)
+            )
+        )
+    elif config.get(CONF_TYPE) in TRIP_TYPES:
+        cg.add(hub.register_trip_sensor(var, TRIP_TYPES[config[CONF_TYPE]]["trip"]))
+    elif CONF_CAN_ID in config:
+        cg.add(
+            hub.register_can_sensor(
+                var,
+                config[CONF_CAN_ID],
+                config.get(CONF_START_BYTE, 0),
+                config[CONF_DATA_BYTES],
+                config.get(CONF_SCALE, 1.0),
+                config.get(CONF_OFFSET, 0.0),
+            )
+        )
+    elif CONF_AT_COMMAND in config:
+        cg.add(
+            hub.register_at_sensor(
+                var, config[CONF_AT_COMMAND], interval_ms, priority
+            )
+        )
+    elif (CONF_PID in config or CONF_DID in config) and CONF_DATA_BYTES in config:
+        cg.add(
+            hub.register_pid_sensor(
+                var,
+                config[CONF_MODE],
+                config.get(CONF_DID, config.get(CONF_PID)),
+                interval_ms,
+                priority,
+                config[CONF_DATA_BYTES],
+                config.get(CONF_SCALE, 1.0),
+                config.get(CONF_OFFSET, 0.0),
+            )
+        )
     elif CONF_PID in config:
-        cg.add(hub.register_pid_sensor(var, config[CONF_MODE], config[CONF_PID]))
+        cg.add(
+            hub.register_pid_sensor(
+                var,
+                config[CONF_MODE],
+                config[CONF_PID],
+                interval_ms,
+                priority,
+            )
+        )
+
+    if CONF_HEADER in config:
+        cg.add(hub.set_request_header(var, config[CONF_HEADER]))
+    if CONF_ECU in config:
+        cg.add(hub.set_response_ecu(var, config[CONF_ECU]))
+    if CONF_FORMULA in config:
+        expression, _ = compile_formula(config[CONF_FORMULA])
+        cg.add(
+            hub.set_value_formula(
+                var,
+                cg.RawExpression(
+                    f"[](const uint8_t *data) -> float {{ return {expression}; }}"
+                ),
+            )
+        )
+
+    if CONF_DEADBAND in config or CONF_HEARTBEAT in config:
+        deadband = config.get(CONF_DEADBAND, {"value": 0.0, "percent": False})
+        heartbeat = config.get(CONF_HEARTBEAT)
+        cg.add(
+            hub.set_publish_filter(
+                var,
+                deadband["value"],
+                deadband["percent"],
+                heartbeat.total_milliseconds if heartbeat is not None else 0,
+            )
+        )
@@ -1,12 +1,15 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome.components import text_sensor
-from esphome.const import CONF_ID, CONF_TYPE
+from esphome.const import CONF_ID, CONF_TYPE, CONF_UPDATE_INTERVAL
 
 from . import ELM327BLEHub, CONF_ELM327_BLE_ID
 
 CONF_DTC = "dtc"
 CONF_RAW = "raw"
+CONF_ADAPTER = "adapter"
+CONF_VIN = "vin"
+CONF_CALIBRATION_ID = "calibration_id"
 
 TEXT_SENSOR_TYPES = {
     CONF_DTC: {
@@ -17,12 +20,32 @@ TEXT_SENSOR_TYPES = {
         "name": "Letzte ELM327 Antwort",
         "icon": "mdi:message-text",
     },
+    # ATI/STI bei der Init
+    CONF_ADAPTER: {
+        "name": "Adapter",
+        "icon": "mdi:car-connected",
+    },
+    # Mode 09, einmal pro Fahrzeug gelesen
+    CONF_VIN: {
+        "name": "Fahrgestellnummer",
+        "icon": "mdi:car-info",
+        "info_pid": 0x02,
+    },
+    CONF_CALIBRATION_ID: {
+        "name": "Kalibrierungs-ID",
+        "icon": "mdi:chip",
+        "info_pid": 0x04,
+    },
 }
 
 CONFIG_SCHEMA = text_sensor.text_sensor_schema().extend(
     {
         cv.GenerateID(CONF_ELM327_BLE_ID): cv.use_id(ELM327BLEHub),
         cv.Required(CONF_TYPE): cv.one_of(*TEXT_SENSOR_TYPES, lower=True),
+        # Nur für type: dtc - Fehlerspeicher ändert sich selten
+        cv.Optional(
+            CONF_UPDATE_INTERVAL, default="60s"
+        ): cv.positive_time_period_milliseconds,
     }
 )
 
@@ -33,6 +56,18 @@ async def to_code(config):
 
     sensor_type = config[CONF_TYPE]
     if sensor_type == CONF_DTC:
-        cg.add(hub.register_dtc_text_sensor(var))
+        cg.add(
+            hub.register_dtc_text_sensor(
+                var, config[CONF_UPDATE_INTERVAL].total_milliseconds
+            )
+        )
     elif sensor_type == CONF_RAW:
         cg.add(hub.register_raw_text_sensor(var))
+    elif sensor_type == CONF_ADAPTER:
+        cg.add(hub.register_adapter_text_sensor(var))
+    else:
+        cg.add(
+            hub.register_vehicle_info_text_sensor(
+                var, TEXT_SENSOR_TYPES[sensor_type]["info_pid"]
+            )
+        )
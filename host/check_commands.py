@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+"""Erlaubte AT-Befehle für send_command: Liste in __init__.py (Konfiguration) gegen
+READ_ONLY_COMMANDS in elm327_protocol.cpp (Laufzeit) prüfen."""
+
+import ast
+import re
+import sys
+from pathlib import Path
+
+COMPONENT = Path(__file__).resolve().parent.parent / "components" / "elm327_ble"
+
+
+def python_commands():
+    tree = ast.parse((COMPONENT / "__init__.py").read_text(encoding="utf-8"))
+    for node in tree.body:
+        if isinstance(node, ast.Assign) and any(
+            isinstance(target, ast.Name) and target.id == "READ_ONLY_COMMANDS"
+            for target in node.targets
+        ):
+            return ast.literal_eval(node.value)
+    return None
+
+
+def cpp_commands():
+    source = (COMPONENT / "elm327_protocol.cpp").read_text(encoding="utf-8")
+    match = re.search(r"READ_ONLY_COMMANDS\[\]\s*=\s*\{([^}]*)\}", source)
+    return re.findall(r'"([^"]*)"', match.group(1)) if match else None
+
+
+def main():
+    python, cpp = python_commands(), cpp_commands()
+    if python is None or cpp is None:
+        print("READ_ONLY_COMMANDS nicht gefunden", file=sys.stderr)
+        return 1
+    if python != cpp:
+        print("READ_ONLY_COMMANDS unterschiedlich:", file=sys.stderr)
+        print(f"  __init__.py:         {python}", file=sys.stderr)
+        print(f"  elm327_protocol.cpp: {cpp}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,690 @@
+// Benchmark des ELM327-Protokollkerns gegen den simulierten Adapter.
+//
+//   make -C host bench            # 600 s simulierte Fahrt pro Szenario
+//   host/build/elm327_bench --seconds 60
+//   host/build/elm327_bench --quick
+//   host/build/elm327_bench --quick --log obd2log.bin   # Datenlogger-Export für elm327_logdump
+//   host/build/elm327_bench --quick --trace trace.bin   # Mitschnitt für elm327_tracedump
+//
+// Die Zeit ist simuliert (1 ms pro Schleifendurchlauf), Antworten/s hängen
+// daher nur von Protokoll und Emulator-Latenzen ab, nicht vom Host-Rechner.
+// Parse-Kosten werden dagegen in echter Zeit gemessen.
+
+#include "elm327_data_log.h"
+#include "elm327_emulator.h"
+#include "elm327_protocol.h"
+#include "elm327_trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <vector>
+
+// ============================================================
+// Allokationszähler
+// ============================================================
+static size_t g_allocations = 0;
+
+void *operator new(size_t size) {
+  g_allocations++;
+  void *ptr = malloc(size ? size : 1);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+// Abweichungen, die den Lauf fehlschlagen lassen (CI)
+static uint32_t g_failures = 0;
+
+using namespace esphome::elm327_ble;
+
+namespace {
+
+struct BenchListener : public ELM327Listener {
+  uint32_t now{0};
+  uint32_t responses{0};
+  uint32_t errors{0};
+  uint32_t values{0};
+  uint32_t dtcs{0};
+  std::string dtc_codes;
+  std::string info[2];  // VIN, Kalibrierungs-IDs
+  uint32_t ready_at{0};
+  uint32_t first_value_at{0};
+  bool ready{false};
+  std::vector<float> last;  // letzter Wert je Kanal
+  std::vector<uint32_t> last_at;  // und dessen Zeitpunkt
+  const ELM327Protocol *protocol{nullptr};
+  ELM327DataLog *log{nullptr};  // wie der Hub: jeder Wert in den Datenlogger
+  struct CommandResult {
+    std::string command;
+    std::string raw;  // leer = keine Antwort
+    uint32_t at;
+  };
+  std::vector<CommandResult> commands;
+
+  void on_value(int channel, float value) override {
+    if (this->values++ == 0)
+      this->first_value_at = this->now;
+    if (this->log != nullptr)
+      this->log->add_value(this->protocol->entries()[channel].config, value, this->now);
+    if (channel >= (int) this->last.size()) {
+      this->last.resize(channel + 1, NAN);
+      this->last_at.resize(channel + 1, 0);
+    }
+    this->last[channel] = value;
+    this->last_at[channel] = this->now;
+  }
+  void on_dtc(const std::string &codes) override {
+    this->dtcs++;
+    this->dtc_codes = codes;
+  }
+  void on_vehicle_info(int index, const std::string &value) override { this->info[index] = value; }
+  void on_command_result(const std::string &command, const ELM327Response *response) override {
+    this->commands.push_back({command, response != nullptr ? response->raw : "", this->now});
+  }
+  void on_response(const ELM327Response &response) override {
+    this->responses++;
+    if (response.status != RESPONSE_OK)
+      this->errors++;
+  }
+  void on_ready() override {
+    if (!this->ready)
+      this->ready_at = this->now;  // erneute Init nach dem Aufwachen zählt nicht
+    this->ready = true;
+  }
+};
+
+// Flash-Partition im RAM, Sektoren wie ELM327PartitionStorage
+struct MemoryLogStorage : public ELM327LogStorage {
+  static const uint32_t BLOCKS_PER_SECTOR = 4096 / ELM327DataLog::BLOCK_SIZE;
+  std::vector<uint8_t> flash;
+  uint32_t erases{0};
+
+  explicit MemoryLogStorage(size_t size) : flash(size, 0xFF) {}
+  uint32_t block_count() const override { return this->flash.size() / ELM327DataLog::BLOCK_SIZE; }
+  bool read(uint32_t block, uint8_t *data, size_t len) override {
+    memcpy(data, &this->flash[block * ELM327DataLog::BLOCK_SIZE], len);
+    return true;
+  }
+  bool write(uint32_t block, const uint8_t *data) override {
+    uint8_t *target = &this->flash[block * ELM327DataLog::BLOCK_SIZE];
+    if (block % BLOCKS_PER_SECTOR == 0) {
+      memset(target, 0xFF, 4096);
+      this->erases++;
+    }
+    memcpy(target, data, ELM327DataLog::BLOCK_SIZE);
+    return true;
+  }
+};
+
+// Weg zum Emulator: Mitschnitt wie im Hub (gesendete Befehle), die Allokationen des
+// Emulators zählen nicht zu Alloc/Tx des Kerns
+struct TraceTransport : public ELM327Transport {
+  ELM327Transport *target{nullptr};
+  ELM327Trace *trace{nullptr};
+  uint32_t now{0};
+  uint64_t trace_ns{0};
+
+  bool write(const uint8_t *data, size_t len) override {
+    auto start = std::chrono::steady_clock::now();
+    this->trace->add(TRACE_TX, data, len, this->now);
+    this->trace_ns +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    size_t allocations = g_allocations;
+    bool ok = this->target->write(data, len);
+    g_allocations = allocations;
+    return ok;
+  }
+};
+
+const char *g_log_path = nullptr;    // --log: Export des ersten Logger-Szenarios
+const char *g_trace_path = nullptr;  // --trace: Export des ersten Szenarios mit Mitschnitt
+
+struct Scenario {
+  const char *name;
+  bool batch_pids;
+  EmulatorConfig emulator;
+  bool reconnect;        // vorher eine Verbindung aufbauen, Protokoll/PID-Bitmaps bleiben gespeichert
+  char known_protocol;   // gespeichertes Protokoll überschreiben, 0 = das gelernte verwenden
+  bool can_monitor;      // Drehzahl und Geschwindigkeit zusätzlich aus Broadcast-Frames (ATMA)
+  uint32_t loop_interval{1};  // Abstand der loop()-Aufrufe in ms (ESPHome: ca. 16 ms)
+  bool max_throughput{false};
+  bool mode22{false};    // herstellerspezifische DIDs von Motor (7E0) und Getriebe (7E1)
+  bool power_profiles{false};  // Motor geht aus (emulator.engine_off_*), Stand und ATLP
+  bool trip{false};      // Bordcomputer: Strecke gegen das Fahrprofil des Emulators prüfen
+  bool data_log{false};  // alle Werte in den Datenlogger (16 KiB RAM, 1 MiB Flash)
+  bool commands{false};  // einmalige Befehle wie aus Aktionen: DTCs, Freeze Frame, Löschen
+  bool headers{false};   // ATH1: Antworten von Motor (7E8) und Getriebe (7E9) getrennt
+  uint32_t ecu{0};       // Mode-01-PIDs nur von diesem Steuergerät, physikalisch adressiert
+  bool adaptive_timing{false};  // Timeout pro Anfrage gelernt, ATST/ATAT angepasst
+  bool trace{false};     // Mitschnitt (4 KiB wie trace_size), Kosten in ns/Antw enthalten
+};
+
+// Befehle des Szenarios `commands`: nach 5 s lesen, nach 8 s löschen und erneut lesen
+struct BenchCommand {
+  uint32_t at;
+  const char *command;
+  uint8_t priority;
+  const char *header;
+  const char *expected;  // Rohantwort wie aus set_dtcs/set_tcu_dtcs
+};
+const BenchCommand BENCH_COMMANDS[] = {
+    {5000, "03", 0, "", "43020123C10043020700C100"},
+    {5000, "020200", 1, "7E0", "4202000123"},  // auslösender DTC aus Freeze Frame 0
+    {8000, "04", 2, "", "44"},
+    {8000, "03", 0, "", "43004300"},
+};
+
+// ============================================================
+// Sollwerte
+// ============================================================
+// Passt ein veröffentlichter Wert zum Fahrzeug des Emulators zur Zeit t der Anfrage?
+// Leer = PID nicht unterstützt, es darf kein Wert kommen.
+using ValueCheck = std::function<bool(float value, uint32_t t)>;
+
+// Dieselben Kurven wie pid_value_() und generate_frames_() in elm327_emulator.cpp
+double profile_phase(uint32_t t) { return sin(t / 20000.0 * 2 * M_PI); }
+uint32_t profile_rpm_x4(uint32_t t) { return (uint32_t) ((1800 + 900 * profile_phase(t)) * 4); }
+
+bool near(float value, double expected) { return fabs(value - expected) <= 0.01 + 1e-4 * fabs(expected); }
+ValueCheck constant(double expected) {
+  return [expected](float value, uint32_t) { return near(value, expected); };
+}
+
+// In der Reihenfolge von register_example_sensors
+std::vector<ValueCheck> example_sensor_checks(const Scenario &scenario) {
+  return {
+      [](float v, uint32_t t) { return near(v, profile_rpm_x4(t) / 4.0); },
+      [&scenario](float v, uint32_t t) {
+        // Ohne ecu: antwortet auch das Getriebe, dessen Wert darf ebenfalls ankommen
+        double engine = SimulatedELM327::speed_kmh(t);
+        return near(v, (uint8_t) engine) ||
+               (scenario.ecu == 0 && near(v, (uint8_t) std::min(255.0, engine * SimulatedELM327::TCU_SPEED_FACTOR)));
+      },
+      [](float v, uint32_t t) { return near(v, (uint8_t) (60 + 40 * profile_phase(t)) * 100 / 255.0); },
+      constant(100 * 100 / 255.0),
+      [](float v, uint32_t t) { return near(v, (uint32_t) ((30 + 15 * profile_phase(t)) * 100) / 100.0); },
+      [](float v, uint32_t t) { return near(v, (uint8_t) (110 + 30 * profile_phase(t))); },
+      nullptr,  // 0x5E fehlt beim Ducato
+      constant(0),
+      constant(90),
+      constant(25),
+      nullptr,  // 0x5C fehlt beim Ducato
+      constant(14.1),
+      [](float v, uint32_t t) { return near(v, t / 1000); },
+      constant(150 * 100 / 255.0),
+      constant(18),
+      constant(98),
+      [](float v, uint32_t) { return near(v, 12.4) || near(v, 13.9) || near(v, 14.3); },  // ATRV
+  };
+}
+
+// Letzten Wert jedes Kanals prüfen; die Anfrage kann bis VALUE_WINDOW ms zurückliegen
+const uint32_t VALUE_WINDOW = 2000;
+uint32_t check_values(const char *name, const ELM327Protocol &protocol, const BenchListener &listener,
+                      const std::vector<ValueCheck> &checks) {
+  uint32_t failures = 0;
+  for (int channel = 0; channel < (int) checks.size(); channel++) {
+    float value = channel < (int) listener.last.size() ? listener.last[channel] : NAN;
+    bool ok;
+    if (!checks[channel]) {
+      ok = std::isnan(value);
+    } else if (std::isnan(value)) {
+      ok = false;
+    } else {
+      uint32_t at = listener.last_at[channel];
+      uint32_t from = at > VALUE_WINDOW ? at - VALUE_WINDOW : 0;
+      ok = false;
+      for (uint32_t t = at + 1; t-- > from && !ok;)
+        ok = checks[channel](value, t);
+    }
+    if (!ok) {
+      const OBD2PIDConfig &config = protocol.entries()[channel].config;
+      printf("%-24s FEHLER Kanal %d (Mode %02X, PID %04X): %.2f\n", name, channel, config.mode, config.pid, value);
+      failures++;
+    }
+  }
+  return failures;
+}
+
+// Sensoren wie in example-component.yaml, Intervalle/Prioritäten wie sensor.py
+void register_example_sensors(ELM327Protocol &protocol) {
+  protocol.add_pid(0x01, 0x0C, 0, 2);      // rpm
+  protocol.add_pid(0x01, 0x0D, 0, 2);      // speed
+  protocol.add_pid(0x01, 0x11, 0, 2);      // throttle
+  protocol.add_pid(0x01, 0x04, 0, 1);      // engine_load
+  protocol.add_pid(0x01, 0x10, 0, 1);      // maf
+  protocol.add_pid(0x01, 0x0B, 0, 1);      // intake_map
+  protocol.add_pid(0x01, 0x5E, 0, 1);      // fuel_rate
+  protocol.add_pid(0x01, 0x2E, 0, 0);      // egr
+  protocol.add_pid(0x01, 0x05, 10000, 0);  // coolant_temp
+  protocol.add_pid(0x01, 0x0F, 10000, 0);  // intake_temp
+  protocol.add_pid(0x01, 0x5C, 10000, 0);  // oil_temp
+  protocol.add_pid(0x01, 0x42, 10000, 0);  // ecu_voltage
+  protocol.add_pid(0x01, 0x1F, 10000, 0);  // engine_runtime
+  protocol.add_pid(0x01, 0x2F, 60000, 0);  // fuel_level
+  protocol.add_pid(0x01, 0x46, 60000, 0);  // ambient_temp
+  protocol.add_pid(0x01, 0x33, 60000, 0);  // baro_pressure
+  protocol.add_at_command("ATRV\r", 10000, 0);
+  protocol.enable_dtc(60000);
+  protocol.enable_vehicle_info(0x02);  // vin
+  protocol.enable_vehicle_info(0x04);  // calibration_id
+}
+
+void run_scenario(const Scenario &scenario, uint32_t seconds) {
+  SimulatedELM327 adapter(scenario.emulator);
+  adapter.set_dtcs({0x0123, 0xC100});
+  adapter.set_tcu_dtcs({0x0700, 0xC100});  // U0100 melden beide Steuergeräte
+  BenchListener listener;
+
+  ELM327Protocol protocol;
+  protocol.set_transport(&adapter);
+  protocol.set_listener(&listener);
+  protocol.set_request_interval(0);
+  protocol.set_request_timeout(1000);
+  protocol.set_batch_pids(scenario.batch_pids);
+  protocol.set_max_throughput(scenario.max_throughput);
+  protocol.set_adaptive_timing(scenario.adaptive_timing);
+  register_example_sensors(protocol);
+  std::vector<ValueCheck> checks = example_sensor_checks(scenario);
+  const int speed_channel = 1;
+  protocol.set_headers(scenario.headers);
+  if (scenario.ecu != 0) {
+    // Wie sensor.py mit ecu: 7E8 an jedem PID-Sensor
+    for (int i = 0; i < (int) protocol.entries().size(); i++)
+      protocol.set_ecu(i, scenario.ecu);
+  }
+  if (scenario.can_monitor) {
+    protocol.add_can_signal(SimulatedELM327::CAN_ID_RPM, 1, 2, 0.25f, 0.0f);
+    protocol.add_can_signal(SimulatedELM327::CAN_ID_SPEED, 0, 2, 0.01f, 0.0f);
+    checks.push_back([](float v, uint32_t t) { return near(v, profile_rpm_x4(t) * 0.25); });
+    checks.push_back([](float v, uint32_t t) { return near(v, (uint32_t) (SimulatedELM327::speed_kmh(t) * 100) * 0.01); });
+  }
+  int gearbox_channel = -1;
+  if (scenario.mode22) {
+    // Wie sensor.py mit did/header/formula
+    int soot = protocol.add_did(SimulatedELM327::DID_SOOT_LOAD, 1000, 1, 2, 0.01f, 0.0f);
+    protocol.set_header(soot, "7E0");
+    int pressure = protocol.add_did(SimulatedELM327::DID_DPF_PRESSURE, 1000, 1, 2, 1.0f, 0.0f);
+    protocol.set_header(pressure, "7E0");
+    gearbox_channel = protocol.add_did(SimulatedELM327::DID_GEARBOX_TEMP, 1000, 1, 1, 1.0f, 0.0f);
+    protocol.set_header(gearbox_channel, "7E1");
+    protocol.set_formula(gearbox_channel, [](const uint8_t *data) -> float { return data[0] - 40; });
+    checks.push_back([](float v, uint32_t t) { return near(v, (uint32_t) (1250 + 250 * profile_phase(t)) * 0.01); });
+    checks.push_back([](float v, uint32_t t) { return near(v, (uint32_t) (40 + 20 * profile_phase(t))); });
+    checks.push_back(constant(85));
+  }
+
+  if (scenario.power_profiles) {
+    // Verkürzte Zeiten, damit auch --quick Stand, Schlaf und Neustart zeigt
+    PowerProfileConfig profiles;
+    profiles.enabled = true;
+    profiles.engine_off_delay = 2000;
+    profiles.parked_interval = 2000;
+    profiles.sleep_after = 4000;
+    profiles.wake_interval = 4000;
+    protocol.set_power_profiles(profiles);
+  }
+
+  protocol.trip().set_enabled(scenario.trip);
+
+  std::vector<uint8_t> log_buffer(16384);
+  MemoryLogStorage log_storage(1024 * 1024);
+  ELM327DataLog data_log;
+  if (scenario.data_log) {
+    data_log.set_buffer(log_buffer.data(), log_buffer.size());
+    data_log.set_storage(&log_storage);
+    data_log.set_flush_blocks(MemoryLogStorage::BLOCKS_PER_SECTOR);
+    listener.protocol = &protocol;
+    listener.log = &data_log;
+  }
+
+  std::vector<uint8_t> trace_buffer(4096);
+  ELM327Trace trace;
+  TraceTransport tracer;
+  tracer.target = &adapter;
+  tracer.trace = &trace;  // ohne Puffer verwirft der Mitschnitt alles
+  if (scenario.trace)
+    trace.set_buffer(trace_buffer.data(), trace_buffer.size());
+  uint32_t trace_timeouts = 0;
+
+  std::string chunk;
+  if (scenario.reconnect) {
+    // Erste Verbindung wie im Fahrzeug, danach gespeicherte Daten wie aus dem NVS
+    SimulatedELM327 first(scenario.emulator);
+    BenchListener ignored;
+    protocol.set_transport(&first);
+    protocol.set_listener(&ignored);
+    protocol.start(0);
+    for (uint32_t t = 0; t < 10000 && !ignored.ready; t++) {
+      first.set_time(t);
+      while (first.next_chunk(t, chunk))
+        protocol.receive((const uint8_t *) chunk.data(), chunk.size(), t);
+      protocol.loop(t);
+    }
+    protocol.stop();
+    protocol.reset_stats_window();
+    protocol.set_transport(&adapter);
+    protocol.set_listener(&listener);
+    if (scenario.known_protocol != 0)
+      protocol.set_known_protocol(scenario.known_protocol);
+  }
+  protocol.set_transport(&tracer);
+  protocol.start(0);
+
+  const uint32_t duration = seconds * 1000;
+  uint64_t parse_ns = 0;
+  size_t parse_allocations = 0;
+  size_t loop_allocations = 0;
+  uint32_t ready_responses = 0;
+  uint32_t profile_ms[3] = {0, 0, 0};
+  uint32_t off_commands = 0;   // Befehle bei ausgeschaltetem Motor
+  uint32_t restart_at = 0;     // Motor wieder als laufend erkannt
+  uint32_t command_wait = 0;   // längste Zeit vom Einreihen bis zum Ergebnis
+  double reference_km = 0;     // Strecke aus dem Fahrprofil ab dem ersten Wert
+
+  for (uint32_t t = 0; t < duration; t++) {
+    listener.now = t;
+    tracer.now = t;
+    uint32_t commands = adapter.commands();
+    adapter.set_time(t);
+    if (scenario.power_profiles) {
+      profile_ms[protocol.get_profile()]++;
+      if (restart_at == 0 && t >= scenario.emulator.engine_off_until_ms && protocol.get_profile() == PROFILE_RUNNING)
+        restart_at = t;
+    }
+    while (adapter.next_chunk(t, chunk)) {
+      size_t allocs = g_allocations;
+      auto start = std::chrono::steady_clock::now();
+      trace.add(TRACE_RX, (const uint8_t *) chunk.data(), chunk.size(), t);
+      protocol.receive((const uint8_t *) chunk.data(), chunk.size(), t);
+      parse_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+      if (listener.ready)
+        parse_allocations += g_allocations - allocs;
+    }
+    if (listener.ready && ready_responses == 0)
+      ready_responses = listener.responses;
+    if (listener.first_value_at != 0)
+      reference_km += SimulatedELM327::speed_kmh(t) / 3600000.0;
+
+    if (scenario.commands) {
+      for (const auto &command : BENCH_COMMANDS) {
+        if (command.at == t)
+          protocol.queue_command(command.command, command.priority, command.header);
+      }
+    }
+
+    if (t % scenario.loop_interval != 0)
+      continue;
+    size_t allocs = g_allocations;
+    protocol.loop(t);
+    if (listener.ready)
+      loop_allocations += g_allocations - allocs;
+    if (protocol.get_stats().timeouts != trace_timeouts) {
+      trace_timeouts = protocol.get_stats().timeouts;
+      trace.add_event(TRACE_EVENT_TIMEOUT, trace_timeouts, t);
+    }
+    if (!adapter.engine_running())
+      off_commands += adapter.commands() - commands;
+    if (scenario.data_log)
+      data_log.flush(false, 1);
+  }
+
+  if (!listener.ready) {
+    printf("%-24s Initialisierung nicht abgeschlossen\n", scenario.name);
+    return;
+  }
+
+  uint32_t responses = listener.responses - ready_responses;
+  // Im Monitor-Betrieb ist jede Frame-Zeile eine eigene Antwort
+  uint32_t received = listener.responses + protocol.get_monitor_frames();
+  uint32_t received_ready = responses + protocol.get_monitor_frames();
+  double active_s = (duration - listener.ready_at) / 1000.0;
+  const LatencyStats &latency = protocol.get_stats().latency;
+  printf("%-24s %8.1f %8.1f %7u %7.0f %7.0f %9.0f %9.2f %9.2f %8u %8u\n", scenario.name, responses / active_s,
+         listener.values / active_s, listener.errors, latency.average(), latency.percentile(95),
+         received ? (double) parse_ns / received : 0.0,
+         received_ready ? (double) parse_allocations / received_ready : 0.0, responses ? (double) loop_allocations / responses : 0.0,
+         listener.ready_at, listener.first_value_at);
+  // Multiframe-Antworten zweier Steuergeräte richtig zusammengesetzt?
+  std::string cal_ids = std::string(SimulatedELM327::ECU_CAL_ID) + ", " + SimulatedELM327::TCU_CAL_ID;
+  // Nach dem Löschen per Befehl meldet keines der Steuergeräte mehr Fehler
+  const char *expected_dtcs = scenario.commands ? "Keine Fehler" : "P0123, U0100, P0700";
+  if (listener.dtcs == 0 || listener.dtc_codes != expected_dtcs) {
+    printf("%-24s FEHLER DTCs: '%s'\n", "", listener.dtc_codes.c_str());
+    g_failures++;
+  }
+  if (listener.info[0] != SimulatedELM327::VIN || listener.info[1] != cal_ids) {
+    printf("%-24s FEHLER Fahrzeug-Info: '%s' / '%s'\n", "", listener.info[0].c_str(), listener.info[1].c_str());
+    g_failures++;
+  }
+  g_failures += check_values("", protocol, listener, checks);
+  if (scenario.can_monitor)
+    printf("%-24s CAN-Frames %u, BUFFER FULL %u\n", "", protocol.get_monitor_frames(),
+           protocol.get_buffer_full_count());
+  if (scenario.power_profiles) {
+    uint32_t off_ms = scenario.emulator.engine_off_until_ms - scenario.emulator.engine_off_from_ms;
+    printf("%-24s Laeuft %.1f s, Stand %.1f s, Schlaf %.1f s, ATLP %u, %.1f Befehle/min bei Motor aus, "
+           "Start erkannt nach %.1f s\n",
+           "", profile_ms[PROFILE_RUNNING] / 1000.0, profile_ms[PROFILE_PARKED] / 1000.0,
+           profile_ms[PROFILE_SLEEP] / 1000.0, protocol.get_sleep_count(), off_commands * 60000.0 / off_ms,
+           restart_at ? (restart_at - scenario.emulator.engine_off_until_ms) / 1000.0 : NAN);
+  }
+  if (scenario.trip) {
+    const ELM327TripComputer &trip = protocol.trip();
+    printf("%-24s Strecke %.3f km (Referenz %.3f km, %+.1f %%), Kraftstoff %.3f L%s, %.1f L/100km\n", "",
+           trip.value(TRIP_DISTANCE), reference_km, (trip.value(TRIP_DISTANCE) / reference_km - 1) * 100,
+           trip.value(TRIP_FUEL_USED), trip.is_fuel_estimated() ? " (MAF)" : "",
+           trip.value(TRIP_AVERAGE_CONSUMPTION));
+  }
+  if (scenario.data_log) {
+    // Alles exportieren und wieder dekodieren wie elm327_logdump
+    data_log.flush(true);
+    uint32_t count = data_log.begin_export();
+    uint32_t blocks = 0;
+    uint32_t decoded = 0;
+    std::vector<uint8_t> block(ELM327DataLog::BLOCK_SIZE);
+    FILE *file = g_log_path != nullptr ? fopen(g_log_path, "wb") : nullptr;
+    ELM327LogBlockReader reader;
+    LogRecord record;
+    for (uint32_t i = 0; i < count; i++) {
+      if (!data_log.export_block(i, block.data()) || !reader.open(block.data()))
+        continue;
+      blocks++;
+      while (reader.next(record))
+        decoded++;
+      if (file != nullptr)
+        fwrite(block.data(), 1, block.size(), file);
+    }
+    if (file != nullptr) {
+      fclose(file);
+      g_log_path = nullptr;
+    }
+    if (decoded != data_log.get_records())
+      g_failures++;
+    printf("%-24s Log %u Werte, %.1f Bytes/Wert, %u Bloecke, %u Sektoren geloescht, %.0f KiB/h%s\n", "",
+           data_log.get_records(), blocks * (double) ELM327DataLog::BLOCK_SIZE / data_log.get_records(), blocks,
+           log_storage.erases, blocks * ELM327DataLog::BLOCK_SIZE / 1024.0 / (duration / 3600000.0),
+           decoded == data_log.get_records() ? "" : " (Werte fehlen!)");
+  }
+  if (scenario.commands) {
+    uint32_t answered = 0;
+    uint32_t wrong = 0;
+    for (const auto &result : listener.commands) {
+      answered += !result.raw.empty();
+      // Eingereiht beim letzten gleichen Befehl vor dem Ergebnis
+      const BenchCommand *queued = nullptr;
+      for (const auto &command : BENCH_COMMANDS) {
+        if (result.command == command.command && command.at <= result.at &&
+            (queued == nullptr || command.at >= queued->at))
+          queued = &command;
+      }
+      command_wait = std::max(command_wait, result.at - (queued != nullptr ? queued->at : 0));
+      wrong += queued == nullptr || result.raw != queued->expected;
+    }
+    if (answered != sizeof(BENCH_COMMANDS) / sizeof(BENCH_COMMANDS[0]) || wrong > 0)
+      g_failures++;
+    printf("%-24s Befehle %u/%zu beantwortet, max. %u ms bis zum Ergebnis:", "", answered,
+           sizeof(BENCH_COMMANDS) / sizeof(BENCH_COMMANDS[0]), command_wait);
+    for (const auto &result : listener.commands)
+      printf(" %s=%s", result.command.c_str(), result.raw.empty() ? "-" : result.raw.c_str());
+    printf("%s\n", wrong > 0 ? " (FEHLER)" : "");
+  }
+  if (scenario.headers) {
+    // Das Getriebe meldet eine um TCU_SPEED_FACTOR höhere Geschwindigkeit
+    float speed = speed_channel < (int) listener.last.size() ? listener.last[speed_channel] : NAN;
+    double engine = SimulatedELM327::speed_kmh(duration);
+    printf("%-24s ATH1 %s, ATSH %u, Geschwindigkeit %.0f km/h (Motor %.0f, Getriebe %.0f)\n", "",
+           protocol.has_headers() ? "aktiv" : "abgelehnt", protocol.get_header_switches(), speed, engine,
+           engine * SimulatedELM327::TCU_SPEED_FACTOR);
+  }
+  if (scenario.mode22) {
+    float gearbox = gearbox_channel < (int) listener.last.size() ? listener.last[gearbox_channel] : NAN;
+    printf("%-24s ATSH %u (%.1f/min), STPX %u, Getriebe %.0f C\n", "", protocol.get_header_switches(),
+           protocol.get_header_switches() / active_s * 60, adapter.stpx_commands(), gearbox);
+  }
+  if (scenario.adaptive_timing || scenario.emulator.lost_rate > 0) {
+    // Ohne Prompt hängt jede verlorene Antwort bis zum Timeout
+    printf("%-24s ATST %u ms, ATAT%u, %u Timeouts, NO DATA %u\n", "", adapter.adapter_timeout(),
+           adapter.adaptive_timing(), protocol.get_stats().timeouts, protocol.get_stats().no_data);
+  }
+  if (scenario.trace) {
+    // Export wieder einlesen wie elm327_tracedump
+    std::vector<uint8_t> exported(trace.export_size());
+    trace.export_to(exported.data(), duration);
+    ELM327TraceReader reader;
+    TraceRecord record;
+    uint32_t read = 0;
+    uint32_t rx_bytes = 0;
+    uint32_t oldest = duration;
+    reader.open(exported.data(), exported.size());
+    while (reader.next(record)) {
+      if (read == 0)
+        oldest = record.time_ms;
+      read++;
+      if (record.type == TRACE_RX)
+        rx_bytes += record.len;
+    }
+    if (g_trace_path != nullptr) {
+      FILE *file = fopen(g_trace_path, "wb");
+      if (file != nullptr) {
+        fwrite(exported.data(), 1, exported.size(), file);
+        fclose(file);
+      }
+      g_trace_path = nullptr;
+    }
+    uint32_t total = trace.get_count() + trace.get_dropped();
+    if (read != trace.get_count() || total == 0)
+      g_failures++;
+    printf("%-24s Mitschnitt %u Eintraege (%.1f s, %u Bytes RX), %u ueberschrieben, %.0f ns/Befehl%s\n", "",
+           trace.get_count(), (duration - oldest) / 1000.0, rx_bytes, trace.get_dropped(),
+           adapter.commands() ? (double) tracer.trace_ns / adapter.commands() : 0.0,
+           read == trace.get_count() && total > 0 ? "" : " (Eintraege fehlen!)");
+  }
+  if (scenario.emulator.stn || !scenario.emulator.response_count) {
+    const AdapterInfo &info = protocol.get_adapter_info();
+    printf("%-24s Adapter %s, Antwortanzahl %s, STPX %s\n", "", info.id.c_str(), info.response_count ? "ja" : "nein",
+           info.stpx ? "ja" : "nein");
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 600;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--quick") == 0) {
+      seconds = 30;
+    } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+      g_log_path = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      g_trace_path = argv[++i];
+    } else {
+      fprintf(stderr, "Aufruf: %s [--seconds N] [--quick] [--log DATEI] [--trace DATEI]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  EmulatorConfig lossy;
+  lossy.no_data_rate = 0.05f;
+  lossy.error_rate = 0.02f;
+  lossy.lost_rate = 0.01f;
+
+  // MTU 247: bis zu 244 Bytes pro Notify
+  EmulatorConfig large_mtu;
+  large_mtu.chunk_size = 244;
+
+  // connection_parameters: 15 ms beim Abfragen gegen 50 ms (typischer Wert ohne Anpassung)
+  EmulatorConfig short_interval;
+  short_interval.connection_interval_ms = 15;
+  EmulatorConfig long_interval;
+  long_interval.connection_interval_ms = 50;
+
+  // Steuergerät nach 10 s langsamer als das gelernte ATST (Buslast, Diagnose im Hintergrund)
+  EmulatorConfig slow;
+  slow.slow_from_ms = 10000;
+
+  // Klon, der v1.5 meldet, aber keine Antwortanzahl kann; OBDLink mit STN2120
+  EmulatorConfig clone;
+  clone.response_count = false;
+  EmulatorConfig stn;
+  stn.stn = true;
+
+  // Broadcast-Verkehr schneller, als BLE ihn übertragen kann
+  EmulatorConfig busy;
+  busy.can_frame_period_ms = 5;
+
+  // Motor 10 s nach dem Start aus, nach 22 s wieder an
+  EmulatorConfig parking;
+  parking.engine_off_from_ms = 10000;
+  parking.engine_off_until_ms = 22000;
+
+  const Scenario scenarios[] = {
+      {"Einzel-PIDs", false, EmulatorConfig(), false, 0, false},
+      {"Multi-PID", true, EmulatorConfig(), false, 0, false, 1, false, false, false, true, true},
+      {"Multi-PID (MTU 247)", true, large_mtu, false, 0, false},
+      {"Multi-PID (Intervall 15)", true, short_interval, false, 0, false},
+      {"Multi-PID (Intervall 50)", true, long_interval, false, 0, false},
+      {"Multi-PID (ATH1)", true, EmulatorConfig(), false, 0, false, 1, false, false, false, false, false, false, true},
+      {"Multi-PID (ATH1, 7E8)", true, EmulatorConfig(), false, 0, false, 1, false, false, false, false, false, false,
+       true, 0x7E8},
+      {"Multi-PID (Klon)", true, clone, false, 0, false},
+      {"Multi-PID (Loop 16 ms)", true, EmulatorConfig(), false, 0, false, 16},
+      {"Multi-PID (max. Durchs.)", true, EmulatorConfig(), false, 0, false, 16, true},
+      {"Multi-PID + Fehler", true, lossy, false, 0, false},
+      {"Multi-PID + Fehler (AT)", true, lossy, false, 0, false, 1, false, false, false, false, false, false, false, 0,
+       true, true},
+      {"Multi-PID (Klon, AT)", true, clone, false, 0, false, 1, false, false, false, false, false, false, false, 0, true},
+      {"Multi-PID (langsam, AT)", true, slow, false, 0, false, 1, false, false, false, false, false, false, false, 0,
+       true},
+      {"Reconnect (Cache)", true, EmulatorConfig(), true, 0, false},
+      {"Reconnect (falsch)", true, EmulatorConfig(), true, '7', false},
+      {"Mode 22 (ATSH)", true, EmulatorConfig(), false, 0, false, 1, false, true, false, false, false, true},
+      {"Mode 22 (STPX)", true, stn, false, 0, false, 1, false, true, false, false, false, true},
+      {"Stand + ATLP", true, parking, false, 0, false, 1, false, false, true},
+      {"CAN-Monitor", true, EmulatorConfig(), false, 0, true, 1, false, false, false, false, false, true, false, 0,
+       false, true},
+      {"CAN-Monitor (Ueberlast)", true, busy, false, 0, true},
+  };
+
+  printf("Simulierte Dauer: %u s pro Szenario\n\n", seconds);
+  printf("%-24s %8s %8s %7s %7s %7s %9s %9s %9s %8s %8s\n", "Szenario", "Antw/s", "Werte/s", "Fehler", "Lat ms",
+         "p95 ms", "ns/Antw",
+         "Alloc/Rx", "Alloc/Tx", "Init ms", "1.Wert");
+  for (const auto &scenario : scenarios)
+    run_scenario(scenario, seconds);
+  if (g_failures > 0) {
+    printf("\nFEHLER: %u Abweichungen\n", g_failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,691 @@
+#include "elm327_emulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace elm327_ble {
+
+static const char *const PROMPT = "\r\r>";
+
+SimulatedELM327::SimulatedELM327(const EmulatorConfig &config) : config_(config), rng_(config.seed ? config.seed : 1) {
+  // Fiat Ducato 250: alles aus example-component.yaml außer Öltemperatur und Kraftstoffverbrauch
+  this->set_supported_pids({0x04, 0x05, 0x0B, 0x0C, 0x0D, 0x0F, 0x10, 0x11, 0x1F, 0x2E, 0x2F, 0x33, 0x42, 0x46});
+}
+
+void SimulatedELM327::set_supported_pids(const std::vector<uint8_t> &pids) {
+  for (bool &supported : this->supported_)
+    supported = false;
+  for (uint8_t pid : pids)
+    this->supported_[pid] = true;
+}
+
+// ============================================================
+// Befehle vom Protokollkern
+// ============================================================
+bool SimulatedELM327::write(const uint8_t *data, size_t len) {
+  if (this->sleeping_ && len > 0) {
+    // Aufwachen: Einstellungen wie nach ATZ, die Eingabe selbst wird verworfen
+    this->sleeping_ = false;
+    this->reset_settings_();
+    this->input_.clear();
+    this->queue_response_(std::string("\r\rELM327 v1.5") + PROMPT, this->config_.reset_latency_ms, 0);
+    return true;
+  }
+  for (size_t i = 0; i < len; i++) {
+    char c = (char) data[i];
+    if (c != '\r') {
+      if (c != ' ')
+        this->input_ += (char) toupper(c);
+      continue;
+    }
+
+    std::string cmd = this->input_;
+    this->input_.clear();
+    this->commands_++;
+
+    if (this->monitoring_) {
+      // Jedes Zeichen beendet ATMA, das Zeichen selbst wird verworfen
+      this->monitoring_ = false;
+      this->monitor_out_.clear();
+      this->queue_response_(std::string("STOPPED") + PROMPT, this->config_.at_latency_ms, 0);
+      continue;
+    }
+
+    if (!this->pending_.empty()) {
+      // Wie beim echten ELM327: Eingabe während einer Antwort bricht diese ab
+      this->pending_.clear();
+      this->queue_response_(std::string("STOPPED") + PROMPT, this->config_.at_latency_ms, 0);
+      continue;
+    }
+
+    if (cmd == "ATMA" && this->config_.monitor && this->pending_.empty()) {
+      // Kein Prompt, ab jetzt Datenstrom bis zur nächsten Eingabe
+      this->monitoring_ = true;
+      this->monitor_generated_ = this->now_;
+      this->monitor_next_chunk_ = this->now_ + this->config_.at_latency_ms;
+      continue;
+    }
+
+    uint32_t latency = this->config_.at_latency_ms;
+    uint32_t trailing = 0;
+    std::string body = this->handle_command_(cmd, latency, trailing);
+    if (this->lost_) {
+      this->lost_ = false;
+      continue;
+    }
+    std::string text = this->echo_ ? cmd + "\r" : std::string();
+    text += body + PROMPT;
+    this->queue_response_(text, latency, trailing);
+  }
+  return true;
+}
+
+std::string SimulatedELM327::handle_command_(const std::string &cmd, uint32_t &latency, uint32_t &trailing) {
+  if (cmd.empty())
+    return "?";
+  if (cmd.compare(0, 2, "AT") == 0)
+    return this->handle_at_(cmd, latency);
+  if (cmd == "STI")
+    return this->config_.stn ? "STN2120 v5.6.5" : "?";
+  if (cmd.compare(0, 4, "STPX") == 0)
+    return this->config_.stn ? this->handle_stpx_(cmd, latency, trailing) : "?";
+  // Ungerade Länge: letzte Ziffer = Anzahl erwarteter Antworten (z.B. "010C1")
+  std::string hex = cmd;
+  uint8_t responses = 0;
+  if (hex.size() % 2 == 1) {
+    if (!this->config_.response_count)
+      return "?";
+    responses = strtoul(hex.substr(hex.size() - 1).c_str(), nullptr, 16);
+    hex.pop_back();
+  }
+  return this->handle_obd_(hex, responses, latency, trailing);
+}
+
+// STPX H:7E0,D:221A10,R:1 (Leerzeichen sind schon entfernt): Header nur für diese Anfrage
+std::string SimulatedELM327::handle_stpx_(const std::string &cmd, uint32_t &latency, uint32_t &trailing) {
+  std::string header = this->header_;
+  std::string data;
+  uint8_t responses = 0;
+  size_t pos = 4;
+  while (pos < cmd.size()) {
+    size_t end = cmd.find(',', pos);
+    if (end == std::string::npos)
+      end = cmd.size();
+    std::string field = cmd.substr(pos, end - pos);
+    if (field.compare(0, 2, "H:") == 0) {
+      header = field.substr(2);
+      if (header == "7DF" || header == "DB33F1")
+        header.clear();
+    } else if (field.compare(0, 2, "D:") == 0) {
+      data = field.substr(2);
+    } else if (field.compare(0, 2, "R:") == 0) {
+      responses = strtoul(field.c_str() + 2, nullptr, 10);
+    } else {
+      return "?";
+    }
+    pos = end + 1;
+  }
+  if (data.empty() || data.size() % 2 != 0)
+    return "?";
+  this->stpx_commands_++;
+  std::swap(header, this->header_);
+  std::string out = this->handle_obd_(data, responses, latency, trailing);
+  std::swap(header, this->header_);
+  return out;
+}
+
+std::string SimulatedELM327::handle_at_(const std::string &cmd, uint32_t &latency) {
+  std::string arg = cmd.substr(2);
+  if (arg == "Z") {
+    latency = this->config_.reset_latency_ms;
+    this->reset_settings_();
+    return "\r\rELM327 v1.5";
+  }
+  if (arg == "LP") {
+    if (!this->config_.low_power)
+      return "?";
+    this->sleeping_ = true;  // Schläft nach dem "OK"
+    return "OK";
+  }
+  if (arg == "I")
+    return "ELM327 v1.5";
+  if (arg == "E0" || arg == "E1") {
+    this->echo_ = arg[1] == '1';
+    return "OK";
+  }
+  if (arg == "S0" || arg == "S1") {
+    this->spaces_ = arg[1] == '1';
+    return "OK";
+  }
+  if (arg == "L0" || arg == "L1") {
+    this->linefeeds_ = arg[1] == '1';
+    return "OK";
+  }
+  if (arg == "H0" || arg == "H1") {
+    this->headers_ = arg[1] == '1';
+    return "OK";
+  }
+  if (arg.compare(0, 2, "SH") == 0) {
+    // Ziel-Steuergerät, 7DF/DB33F1 = wieder funktional an alle
+    std::string header = arg.substr(2);
+    if (header.size() != 3 && header.size() != 6)
+      return "?";
+    this->header_ = header == "7DF" || header == "DB33F1" ? std::string() : header;
+    this->header_commands_++;
+    return "OK";
+  }
+  if (arg.compare(0, 2, "ST") == 0 && arg.size() == 4) {
+    char *end;
+    long value = strtol(arg.c_str() + 2, &end, 16);
+    if (*end != '\0')
+      return "?";
+    this->timeout_ = value == 0 ? 0x32 : value;  // ATST00 = Standardwert
+    return "OK";
+  }
+  if (arg == "AT0" || arg == "AT1" || arg == "AT2") {
+    this->adaptive_ = arg[2] - '0';
+    return "OK";
+  }
+  if (arg.compare(0, 3, "CRA") == 0) {
+    this->cra_ = arg.size() > 3 ? (int64_t) strtoul(arg.c_str() + 3, nullptr, 16) : -1;
+    return "OK";
+  }
+  if (arg.compare(0, 2, "CF") == 0 || arg.compare(0, 2, "CM") == 0) {
+    uint32_t value = strtoul(arg.c_str() + 2, nullptr, 16);
+    (arg[1] == 'F' ? this->cf_ : this->cm_) = value;
+    return "OK";
+  }
+  if (arg == "AR") {
+    // Automatische Empfangsadresse, manuelle Filter aufheben
+    this->cra_ = -1;
+    this->cm_ = 0;
+    return "OK";
+  }
+  if (arg == "MA")
+    return "?";  // Monitor nicht unterstützt
+  if (arg.compare(0, 2, "SP") == 0 && arg.size() >= 3) {
+    // ATSP0 = automatisch suchen, ATSPn = Protokoll fest vorgegeben
+    char protocol = arg.back();
+    this->fixed_protocol_ = (protocol == '0' || arg[2] == 'A') ? 0 : protocol;
+    this->protocol_detected_ = this->fixed_protocol_ != 0;
+    return "OK";
+  }
+  if (arg == "DPN") {
+    if (this->fixed_protocol_ != 0)
+      return std::string(1, this->fixed_protocol_);
+    return this->protocol_detected_ ? std::string("A") + this->config_.protocol : "0";
+  }
+  if (arg == "RV") {
+    char volt[8];
+    // Ladespannung schwankt im Minutentakt, bei stehendem Motor Ruhespannung
+    double volt_value = this->engine_running() ? 13.9 + 0.4 * (this->now_ / 60000 % 2) : 12.4;
+    snprintf(volt, sizeof(volt), "%.1fV", volt_value);
+    return volt;
+  }
+  return "OK";
+}
+
+void SimulatedELM327::reset_settings_() {
+  this->echo_ = true;
+  this->spaces_ = true;
+  this->linefeeds_ = false;
+  this->protocol_detected_ = false;
+  this->fixed_protocol_ = 0;
+  this->headers_ = false;
+  this->header_.clear();
+  this->timeout_ = 0x32;
+  this->adaptive_ = 1;
+  this->cra_ = -1;
+  this->cm_ = 0;
+}
+
+// responses = erwartete Antworten, 0 = bis trailing_wait_ms auf weitere Steuergeräte warten
+std::string SimulatedELM327::handle_obd_(const std::string &hex, uint8_t responses, uint32_t &latency,
+                                         uint32_t &trailing) {
+  uint32_t timeout = this->adapter_timeout();
+  trailing = 0;
+  std::vector<uint8_t> request;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    char *end;
+    std::string pair = hex.substr(i, 2);
+    long value = strtol(pair.c_str(), &end, 16);
+    if (*end != '\0')
+      return "?";
+    request.push_back(value);
+  }
+  if (request.empty())
+    return "?";
+
+  std::string prefix;
+  latency = this->ecu_latency();
+  if (this->fixed_protocol_ != 0 && this->fixed_protocol_ != this->config_.protocol) {
+    latency += this->config_.search_latency_ms;
+    return "UNABLE TO CONNECT";
+  }
+  if (!this->protocol_detected_) {
+    latency += this->config_.search_latency_ms;
+    this->protocol_detected_ = true;
+    prefix = "SEARCHING...\r";
+  }
+
+  // Ohne Antwort innerhalb von ATST meldet der Adapter "NO DATA", auch wenn ATST
+  // kürzer als die Antwortzeit des Steuergeräts eingestellt ist
+  uint32_t no_data_latency = latency - this->ecu_latency() + timeout;
+  if (!this->engine_running() || timeout < this->ecu_latency()) {
+    latency = no_data_latency;
+    return prefix + "NO DATA";  // Zündung aus bzw. ATST zu kurz
+  }
+
+  float r = this->random_();
+  if (r < this->config_.error_rate)
+    return prefix + "CAN ERROR";
+  if (r < this->config_.error_rate + this->config_.no_data_rate) {
+    latency = no_data_latency;
+    return prefix + "NO DATA";
+  }
+  if (r < this->config_.error_rate + this->config_.no_data_rate + this->config_.lost_rate) {
+    this->lost_ = true;
+    return "";
+  }
+  // Nach der letzten Antwort wartet der Adapter auf weitere Steuergeräte: ohne adaptives
+  // Timing die volle ATST-Zeit, mit ATAT1 kürzer, mit ATAT2 noch kürzer
+  trailing = this->adaptive_ == 0 ? timeout : this->config_.trailing_wait_ms / this->adaptive_;
+  trailing = std::min(trailing, timeout);
+
+  std::vector<uint8_t> payload{(uint8_t) (request[0] + 0x40)};
+  std::vector<uint8_t> tcu;  // Antwort des Getriebe-Steuergeräts, leer = keine
+  // Per ATSH adressiert antwortet nur das eine Steuergerät
+  bool ecu_addressed = this->header_.empty() || this->header_ == "7E0";
+  bool tcu_addressed = this->tcu_ && (this->header_.empty() || this->header_ == "7E1");
+  switch (request[0]) {
+    case 0x01: {
+      size_t count = this->config_.multi_pid ? request.size() - 1 : 1;
+      for (size_t i = 1; i <= count && i < request.size(); i++) {
+        std::vector<uint8_t> value;
+        if (tcu_addressed && request[i] == 0x0D) {
+          if (tcu.empty())
+            tcu.push_back(0x41);
+          tcu.insert(tcu.end(), {0x0D, (uint8_t) std::min(255.0, speed_kmh(this->now_) * TCU_SPEED_FACTOR)});
+        }
+        if (!ecu_addressed || !this->pid_value_(request[i], value))
+          continue;
+        payload.push_back(request[i]);
+        payload.insert(payload.end(), value.begin(), value.end());
+      }
+      break;
+    }
+    case 0x02:
+      // Freeze Frame 0 existiert, solange ein Fehler gespeichert ist. PID 02 = auslösender DTC,
+      // die übrigen PIDs liefern der Einfachheit halber die aktuellen Werte.
+      if (!ecu_addressed || request.size() < 3 || request[2] != 0 || this->dtcs_.empty())
+        break;
+      if (request[1] == 0x02) {
+        payload.insert(payload.end(), {0x02, 0x00, (uint8_t) (this->dtcs_[0] >> 8), (uint8_t) this->dtcs_[0]});
+      } else {
+        std::vector<uint8_t> value;
+        if (!this->pid_value_(request[1], value))
+          break;
+        payload.insert(payload.end(), {request[1], 0x00});
+        payload.insert(payload.end(), value.begin(), value.end());
+      }
+      break;
+    case 0x03:
+      if (ecu_addressed)
+        payload = this->dtc_payload_(this->dtcs_);
+      if (tcu_addressed)
+        tcu = this->dtc_payload_(this->tcu_dtcs_);
+      break;
+    case 0x04:
+      // Fehlerspeicher löschen, Bestätigung "44" ohne Daten
+      if (ecu_addressed)
+        this->dtcs_.clear();
+      if (tcu_addressed)
+        this->tcu_dtcs_.clear();
+      if (ecu_addressed || tcu_addressed)
+        return prefix + this->format_response_(payload, ecu_addressed ? 0x7E8 : 0x7E9, {});
+      break;
+    case 0x09:
+      // Fahrzeug-Informationen, Byte 2 = Anzahl der Einträge
+      if (request.size() < 2)
+        break;
+      if (request[1] == 0x02 && ecu_addressed) {
+        payload.insert(payload.end(), {0x02, 0x01});
+        payload.insert(payload.end(), VIN, VIN + strlen(VIN));
+      } else if (request[1] == 0x04) {
+        if (ecu_addressed)
+          payload = this->cal_id_payload_(ECU_CAL_ID);
+        if (tcu_addressed)
+          tcu = this->cal_id_payload_(TCU_CAL_ID);
+      }
+      break;
+    case 0x22:
+      // UDS ReadDataByIdentifier
+      if (request.size() < 3)
+        break;
+      if (ecu_addressed)
+        payload = this->did_response_(false, (request[1] << 8) | request[2]);
+      if (payload.empty())
+        payload = {0x62};
+      if (tcu_addressed)
+        tcu = this->did_response_(true, (request[1] << 8) | request[2]);
+      break;
+    default:
+      break;
+  }
+  uint32_t id = 0x7E8;
+  if (payload.size() == 1) {
+    payload.swap(tcu);  // nur das Getriebe hat geantwortet
+    tcu.clear();
+    id = 0x7E9;
+  }
+  if (payload.size() <= 1) {
+    latency = no_data_latency;
+    trailing = 0;
+    return prefix + "NO DATA";
+  }
+  // Mit Anzahl gibt der Adapter nach so vielen Antworten sofort den Prompt aus
+  if (responses == 1)
+    tcu.clear();
+  if (responses > 0 && (tcu.empty() ? 1 : 2) >= responses)
+    trailing = 0;
+  return prefix + this->format_response_(payload, id, tcu);
+}
+
+// "43 NN" + NN Codes à 2 Bytes (ISO 15765-4)
+std::vector<uint8_t> SimulatedELM327::dtc_payload_(const std::vector<uint16_t> &dtcs) const {
+  std::vector<uint8_t> payload{0x43, (uint8_t) dtcs.size()};
+  for (uint16_t dtc : dtcs) {
+    payload.push_back(dtc >> 8);
+    payload.push_back(dtc & 0xFF);
+  }
+  return payload;
+}
+
+// "49 04 01" + 16 Bytes, mit 0x00 aufgefüllt
+std::vector<uint8_t> SimulatedELM327::cal_id_payload_(const char *cal_id) const {
+  std::vector<uint8_t> payload{0x49, 0x04, 0x01};
+  payload.insert(payload.end(), cal_id, cal_id + strlen(cal_id));
+  payload.resize(3 + 16, 0x00);
+  return payload;
+}
+
+// ============================================================
+// Simuliertes Fahrzeug
+// ============================================================
+// "62 DID Daten" bzw. "7F 22 31" (requestOutOfRange) für unbekannte DIDs. Funktional
+// angefragt unterdrückt das Steuergerät die negative Antwort (ISO 14229).
+std::vector<uint8_t> SimulatedELM327::did_response_(bool tcu, uint16_t did) const {
+  double phase = sin(this->now_ / 20000.0 * 2 * M_PI);
+  uint32_t value;
+  size_t length = 2;
+  if (!tcu && did == DID_SOOT_LOAD) {
+    value = (uint32_t) (1250 + 250 * phase);  // 12,5 g
+  } else if (!tcu && did == DID_DPF_PRESSURE) {
+    value = (uint32_t) (40 + 20 * phase);  // hPa
+  } else if (tcu && did == DID_GEARBOX_TEMP) {
+    value = 125;  // 85 °C
+    length = 1;
+  } else if (this->header_.empty()) {
+    return {};
+  } else {
+    return {0x7F, 0x22, 0x31};
+  }
+  std::vector<uint8_t> out{0x62, (uint8_t) (did >> 8), (uint8_t) did};
+  for (size_t i = length; i > 0; i--)
+    out.push_back((uint8_t) (value >> (8 * (i - 1))));
+  return out;
+}
+
+bool SimulatedELM327::pid_value_(uint8_t pid, std::vector<uint8_t> &out) const {
+  // Unterstützte PIDs 01-20, 21-40, ...: Bit 31 = PID base+1, Bit 0 = PID base+32
+  if (pid % 0x20 == 0) {
+    uint32_t bitmap = 0;
+    for (int i = 1; i <= 0x20; i++) {
+      if (pid + i < 256 && this->supported_[pid + i])
+        bitmap |= 1u << (32 - i);
+    }
+    bool more = false;
+    for (int p = pid + 0x21; p < 256; p++)
+      more |= this->supported_[p];
+    if (more)
+      bitmap |= 1;
+    if (pid != 0 && bitmap == 0)
+      return false;
+    out = {(uint8_t) (bitmap >> 24), (uint8_t) (bitmap >> 16), (uint8_t) (bitmap >> 8), (uint8_t) bitmap};
+    return true;
+  }
+  if (!this->supported_[pid])
+    return false;
+
+  // Fahrprofil: Drehzahl und Geschwindigkeit schwanken mit 20 s Periode
+  double phase = sin(this->now_ / 20000.0 * 2 * M_PI);
+  auto word = [&out](uint32_t value) { out = {(uint8_t) (value >> 8), (uint8_t) value}; };
+  switch (pid) {
+    case 0x04: out = {100}; break;                                          // Last 39 %
+    case 0x05: out = {130}; break;                                          // 90 °C
+    case 0x0B: out = {(uint8_t) (110 + 30 * phase)}; break;                 // MAP
+    case 0x0C: word((uint32_t) ((1800 + 900 * phase) * 4)); break;          // Drehzahl
+    case 0x0D: out = {(uint8_t) speed_kmh(this->now_)}; break;              // km/h
+    case 0x0F: out = {65}; break;                                           // 25 °C
+    case 0x10: word((uint32_t) ((30 + 15 * phase) * 100)); break;           // MAF
+    case 0x11: out = {(uint8_t) (60 + 40 * phase)}; break;                  // Drosselklappe
+    case 0x1F: word(this->now_ / 1000); break;                              // Laufzeit
+    case 0x2F: out = {150}; break;                                          // Tank 59 %
+    case 0x33: out = {98}; break;                                           // kPa
+    case 0x42: word(14100); break;                                          // 14,1 V
+    case 0x46: out = {58}; break;                                           // 18 °C
+    default: {
+      const PIDDescriptor *known = lookup_pid(pid);
+      out.assign(known != nullptr && known->length > 0 ? known->length : 1, 0);
+      break;
+    }
+  }
+  return true;
+}
+
+// ============================================================
+// Ausgabeformat (CAN)
+// ============================================================
+// Antwort von id, danach ggf. die des Getriebes (7E9). Mit ATH1 kommen die CAN-Frames
+// beider Steuergeräte abwechselnd, wie bei gleichzeitigem Senden auf dem Bus.
+std::string SimulatedELM327::format_response_(const std::vector<uint8_t> &payload, uint32_t id,
+                                              const std::vector<uint8_t> &tcu) const {
+  const char *eol = this->linefeeds_ ? "\r\n" : "\r";
+  if (!this->headers_) {
+    if (tcu.empty())
+      return this->format_payload_(payload);
+    return this->format_payload_(payload) + eol + this->format_payload_(tcu);
+  }
+  std::vector<std::string> first = this->format_frames_(payload, id);
+  std::vector<std::string> second;
+  if (!tcu.empty())
+    second = this->format_frames_(tcu, 0x7E9);
+  std::string out;
+  for (size_t i = 0; i < std::max(first.size(), second.size()); i++) {
+    for (const auto *frames : {&first, &second}) {
+      if (i >= frames->size())
+        continue;
+      if (!out.empty())
+        out += eol;
+      out += (*frames)[i];
+    }
+  }
+  return out;
+}
+
+// ATH1: jede Zeile ein CAN-Frame mit ID, PCI-Byte und 8 Datenbytes (ISO 15765-2)
+std::vector<std::string> SimulatedELM327::format_frames_(const std::vector<uint8_t> &payload, uint32_t id) const {
+  std::vector<std::string> frames;
+  char header[8];
+  snprintf(header, sizeof(header), this->spaces_ ? "%03X " : "%03X", (unsigned) id);
+  uint8_t frame[8];
+  if (payload.size() <= 7) {
+    memset(frame, 0x00, sizeof(frame));
+    frame[0] = payload.size();
+    memcpy(frame + 1, payload.data(), payload.size());
+    frames.push_back(header + this->format_bytes_(frame, sizeof(frame)));
+    return frames;
+  }
+  frame[0] = 0x10 | (payload.size() >> 8);
+  frame[1] = payload.size() & 0xFF;
+  memcpy(frame + 2, payload.data(), 6);
+  frames.push_back(header + this->format_bytes_(frame, sizeof(frame)));
+  for (size_t start = 6, index = 1; start < payload.size(); start += 7, index++) {
+    memset(frame, 0x00, sizeof(frame));
+    frame[0] = 0x20 | (index & 0x0F);
+    memcpy(frame + 1, payload.data() + start, std::min<size_t>(7, payload.size() - start));
+    frames.push_back(header + this->format_bytes_(frame, sizeof(frame)));
+  }
+  return frames;
+}
+
+std::string SimulatedELM327::format_bytes_(const uint8_t *data, size_t len) const {
+  std::string out;
+  char hex[4];
+  for (size_t i = 0; i < len; i++) {
+    snprintf(hex, sizeof(hex), this->spaces_ && i + 1 < len ? "%02X " : "%02X", data[i]);
+    out += hex;
+  }
+  return out;
+}
+
+std::string SimulatedELM327::format_payload_(const std::vector<uint8_t> &payload) const {
+  const char *eol = this->linefeeds_ ? "\r\n" : "\r";
+  if (payload.size() <= 7)
+    return this->format_bytes_(payload.data(), payload.size());
+
+  // ISO-TP Multiframe: Länge, dann "0:" mit 6 Bytes und "1:", "2:", ... mit je 7 Bytes
+  char header[8];
+  snprintf(header, sizeof(header), "%03X", (unsigned) payload.size());
+  std::string out = std::string(header) + eol;
+  std::vector<uint8_t> padded = payload;
+  size_t frames = 1 + (payload.size() - 6 + 6) / 7;
+  padded.resize(6 + (frames - 1) * 7, 0x00);
+  for (size_t frame = 0; frame < frames; frame++) {
+    size_t start = frame == 0 ? 0 : 6 + (frame - 1) * 7;
+    size_t len = frame == 0 ? 6 : 7;
+    snprintf(header, sizeof(header), this->spaces_ ? "%X: " : "%X:", (unsigned) (frame & 0x0F));
+    out += header + this->format_bytes_(padded.data() + start, len);
+    if (frame + 1 < frames)
+      out += eol;
+  }
+  return out;
+}
+
+// ============================================================
+// Auslieferung in Notify-Chunks
+// ============================================================
+// Nächstes Connection Event ab t. Notifies im Abstand chunk_interval_ms, die in dasselbe
+// Intervall fallen, gehen gemeinsam im selben Event raus.
+uint32_t SimulatedELM327::next_event_(uint32_t t) const {
+  uint32_t interval = this->config_.connection_interval_ms;
+  return interval == 0 ? t : (t + interval - 1) / interval * interval;
+}
+
+void SimulatedELM327::queue_response_(const std::string &text, uint32_t latency, uint32_t trailing) {
+  uint32_t due = this->next_event_(this->now_) + latency;  // der Write kommt erst im nächsten Event an
+  for (size_t pos = 0; pos < text.size(); pos += this->config_.chunk_size) {
+    Chunk chunk{due, text.substr(pos, this->config_.chunk_size)};
+    if (pos + this->config_.chunk_size >= text.size())
+      chunk.due += trailing;  // Prompt erst nach der Wartezeit auf weitere Antworten
+    chunk.due = this->next_event_(chunk.due);
+    this->pending_.push_back(chunk);
+    due += this->config_.chunk_interval_ms;
+  }
+}
+
+bool SimulatedELM327::next_chunk(uint32_t now, std::string &chunk) {
+  this->now_ = now;
+  if (this->monitoring_)
+    return this->monitor_chunk_(now, chunk);
+  if (this->pending_.empty() || (int32_t) (now - this->pending_.front().due) < 0)
+    return false;
+  chunk = this->pending_.front().data;
+  this->pending_.pop_front();
+  this->notifies_++;
+  return true;
+}
+
+// ============================================================
+// CAN-Monitor: Broadcast-Verkehr des Fahrzeugs
+// ============================================================
+bool SimulatedELM327::frame_passes_(uint32_t id) const {
+  if (this->cra_ >= 0)
+    return id == (uint32_t) this->cra_;
+  return this->cm_ == 0 || (id & this->cm_) == (this->cf_ & this->cm_);
+}
+
+void SimulatedELM327::generate_frames_(uint32_t until) {
+  // Drehzahl im Grundtakt, Geschwindigkeit 2,5× langsamer, Fremdverkehr (Getriebe, Klima) dazwischen
+  const uint32_t period = this->config_.can_frame_period_ms > 0 ? this->config_.can_frame_period_ms : 1;
+  struct BusFrame {
+    uint32_t id;
+    uint32_t period;
+  };
+  const BusFrame frames[] = {
+      {CAN_ID_RPM, period},
+      {CAN_ID_SPEED, period * 5 / 2},
+      {0x2A0, std::max<uint32_t>(period / 2, 1)},
+      {0x4F0, period * 5},
+  };
+  const char *eol = this->linefeeds_ ? "\r\n" : "\r";
+
+  while ((int32_t) (until - this->monitor_generated_) > 0) {
+    uint32_t t = ++this->monitor_generated_;
+    double phase = sin(t / 20000.0 * 2 * M_PI);
+    for (const auto &frame : frames) {
+      if (t % frame.period != 0 || !this->frame_passes_(frame.id))
+        continue;
+      uint8_t data[8] = {0, 0, 0, 0, 0, 0, 0, (uint8_t) t};
+      if (frame.id == CAN_ID_RPM) {
+        uint32_t rpm = (uint32_t) ((1800 + 900 * phase) * 4);
+        data[1] = rpm >> 8;
+        data[2] = rpm & 0xFF;
+      } else if (frame.id == CAN_ID_SPEED) {
+        uint32_t speed = (uint32_t) (speed_kmh(t) * 100);
+        data[0] = speed >> 8;
+        data[1] = speed & 0xFF;
+      }
+      char id[12];
+      snprintf(id, sizeof(id), this->spaces_ ? "%03X " : "%03X", (unsigned) frame.id);
+      if (this->headers_)
+        this->monitor_out_ += id;
+      this->monitor_out_ += this->format_bytes_(data, sizeof(data)) + eol;
+    }
+  }
+}
+
+bool SimulatedELM327::monitor_chunk_(uint32_t now, std::string &chunk) {
+  this->generate_frames_(now);
+  if (this->monitor_out_.size() > this->config_.monitor_buffer) {
+    // BLE ist langsamer als der Bus: Puffer voll, ELM327 bricht ab
+    this->monitoring_ = false;
+    this->buffer_full_++;
+    std::string text = this->monitor_out_.substr(0, this->config_.monitor_buffer) + "\rBUFFER FULL" + PROMPT;
+    this->monitor_out_.clear();
+    this->queue_response_(text, 0, 0);
+    return this->next_chunk(now, chunk);
+  }
+  if (this->monitor_out_.empty() || (int32_t) (now - this->monitor_next_chunk_) < 0)
+    return false;
+  chunk = this->monitor_out_.substr(0, this->config_.chunk_size);
+  this->monitor_out_.erase(0, chunk.size());
+  this->monitor_next_chunk_ = now + this->config_.chunk_interval_ms;
+  this->notifies_++;
+  return true;
+}
+
+float SimulatedELM327::random_() {
+  // xorshift32, reproduzierbar über EmulatorConfig::seed
+  this->rng_ ^= this->rng_ << 13;
+  this->rng_ ^= this->rng_ >> 17;
+  this->rng_ ^= this->rng_ << 5;
+  return (this->rng_ & 0xFFFFFF) / (float) 0x1000000;
+}
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "elm327_protocol.h"
+
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace esphome {
+namespace elm327_ble {
+
+// Verhalten des simulierten Adapters und Fahrzeugs
+struct EmulatorConfig {
+  uint32_t ecu_latency_ms{35};       // Antwortzeit des Steuergeräts pro OBD-Anfrage
+  uint32_t slow_from_ms{0};          // > 0: ab hier antwortet das Steuergerät nach slow_latency_ms (Buslast)
+  uint32_t slow_latency_ms{120};
+  uint32_t at_latency_ms{2};         // Antwortzeit auf AT-Befehle
+  uint32_t reset_latency_ms{500};    // ATZ
+  uint32_t search_latency_ms{1500};  // Protokollsuche bei der ersten Anfrage nach ATSP0
+  uint32_t trailing_wait_ms{50};     // Wartezeit auf weitere Steuergeräte vor dem '>' (ATAT1, ATAT2 halb so lang)
+  uint32_t chunk_size{20};           // Bytes pro Notify (MTU - 3, Standard-MTU 23)
+  uint32_t chunk_interval_ms{8};     // Abstand der Notifies (≈ BLE Connection Interval)
+  uint32_t connection_interval_ms{0};  // > 0: Writes und Notifies nur zu Connection Events in diesem Takt
+  float no_data_rate{0.0f};          // Anteil der OBD-Anfragen mit "NO DATA"
+  float error_rate{0.0f};            // Anteil der OBD-Anfragen mit "CAN ERROR"
+  float lost_rate{0.0f};             // Anteil der OBD-Anfragen ganz ohne Antwort (z.B. verlorenes Notify)
+  bool multi_pid{true};              // Multi-PID-Anfragen werden unterstützt
+  char protocol{'6'};                // Protokoll des Fahrzeugs (ATDPN-Nummer)
+  bool monitor{true};                // ATMA wird unterstützt
+  uint32_t can_frame_period_ms{20};  // Broadcast-Takt des Drehzahl-Frames (0x0C9), die übrigen relativ dazu
+  uint32_t monitor_buffer{256};      // Ausgabepuffer im Monitor-Betrieb, darüber "BUFFER FULL"
+  uint32_t engine_off_from_ms{0};    // Motor und Zündung aus in [from, until), Steuergeräte schweigen
+  uint32_t engine_off_until_ms{0};
+  bool low_power{true};              // ATLP wird unterstützt
+  bool response_count{true};         // Anzahl erwarteter Antworten ("010C1"), sonst "?" (Klon)
+  bool stn{false};                   // STN2120 (OBDLink): STI und STPX
+  uint32_t seed{1};
+};
+
+// Simulierter ELM327 mit CAN-Steuergerät (ISO 15765-4, 11 Bit, 500 kBit).
+// Antworten werden wie über BLE in Notify-Chunks mit Latenz ausgeliefert.
+class SimulatedELM327 : public ELM327Transport {
+ public:
+  explicit SimulatedELM327(const EmulatorConfig &config);
+
+  // Mode-01-PIDs, die das Steuergerät beantwortet (Default: Ducato ohne 0x5C/0x5E)
+  void set_supported_pids(const std::vector<uint8_t> &pids);
+  // Gespeicherte Fehlercodes für Mode 03, z.B. 0x0123 = P0123
+  void set_dtcs(const std::vector<uint16_t> &dtcs) { this->dtcs_ = dtcs; }
+  // Zweites Steuergerät (Getriebe, 7E9): antwortet zusätzlich auf Mode 03, 0904 und 010D
+  // (Geschwindigkeit vom Getriebeausgang, TCU_SPEED_FACTOR über dem Wert des Motors)
+  void set_tcu_dtcs(const std::vector<uint16_t> &dtcs) {
+    this->tcu_dtcs_ = dtcs;
+    this->tcu_ = true;
+  }
+
+  static constexpr const char *VIN = "ZFA25000001234567";
+  static constexpr const char *ECU_CAL_ID = "55264839AB";
+  static constexpr const char *TCU_CAL_ID = "AISIN-TF80SC";
+
+  // Mode-22-DIDs: Motor (7E0) Rußbeladung (A*256+B)/100 g und Abgasdruck-Differenz
+  // (A*256+B) hPa, Getriebe (7E1) Öltemperatur A-40 °C
+  static const uint16_t DID_SOOT_LOAD = 0x2005;
+  static const uint16_t DID_DPF_PRESSURE = 0x2006;
+  static const uint16_t DID_GEARBOX_TEMP = 0x1A10;
+  static constexpr float TCU_SPEED_FACTOR = 1.05f;
+
+  bool write(const uint8_t *data, size_t len) override;
+
+  // Fahrprofil: Geschwindigkeit schwankt mit 20 s Periode zwischen 40 und 100 km/h
+  // (Referenz für den Bordcomputer im Benchmark)
+  static double speed_kmh(uint32_t t) { return 70 + 30 * sin(t / 20000.0 * 2 * M_PI); }
+
+  // Broadcast-Frames des simulierten Busses (für CAN-Signale im Benchmark)
+  static const uint32_t CAN_ID_RPM = 0x0C9;    // Byte 1-2: Drehzahl × 4
+  static const uint32_t CAN_ID_SPEED = 0x3E9;  // Byte 0-1: km/h × 100
+
+  // Nächsten bis `now` fälligen Notify-Chunk holen; false = nichts fällig
+  bool next_chunk(uint32_t now, std::string &chunk);
+  // Aktuelle Zeit setzen (vor protocol.loop(), damit write() sie kennt)
+  void set_time(uint32_t now) { this->now_ = now; }
+
+  uint32_t commands() const { return this->commands_; }
+  uint32_t notifies() const { return this->notifies_; }
+  uint32_t buffer_full() const { return this->buffer_full_; }
+  uint32_t header_commands() const { return this->header_commands_; }
+  // ATST in ms: so lange wartet der Adapter auf die erste Antwort bis "NO DATA"
+  uint32_t adapter_timeout() const { return this->timeout_ * 4; }
+  uint8_t adaptive_timing() const { return this->adaptive_; }
+  uint32_t stpx_commands() const { return this->stpx_commands_; }
+  bool sleeping() const { return this->sleeping_; }
+  uint32_t ecu_latency() const {
+    bool slow = this->config_.slow_from_ms > 0 && this->now_ >= this->config_.slow_from_ms;
+    return slow ? this->config_.slow_latency_ms : this->config_.ecu_latency_ms;
+  }
+  bool engine_running() const {
+    return this->now_ < this->config_.engine_off_from_ms || this->now_ >= this->config_.engine_off_until_ms;
+  }
+
+ protected:
+  struct Chunk {
+    uint32_t due;
+    std::string data;
+  };
+
+  std::string handle_command_(const std::string &cmd, uint32_t &latency, uint32_t &trailing);
+  std::string handle_at_(const std::string &cmd, uint32_t &latency);
+  std::string handle_stpx_(const std::string &cmd, uint32_t &latency, uint32_t &trailing);
+  std::string handle_obd_(const std::string &hex, uint8_t responses, uint32_t &latency, uint32_t &trailing);
+  void reset_settings_();
+  bool pid_value_(uint8_t pid, std::vector<uint8_t> &out) const;
+  std::string format_response_(const std::vector<uint8_t> &payload, uint32_t id, const std::vector<uint8_t> &tcu) const;
+  std::string format_payload_(const std::vector<uint8_t> &payload) const;
+  std::vector<std::string> format_frames_(const std::vector<uint8_t> &payload, uint32_t id) const;
+  std::string format_bytes_(const uint8_t *data, size_t len) const;
+  std::vector<uint8_t> dtc_payload_(const std::vector<uint16_t> &dtcs) const;
+  std::vector<uint8_t> cal_id_payload_(const char *cal_id) const;
+  std::vector<uint8_t> did_response_(bool tcu, uint16_t did) const;
+  void queue_response_(const std::string &text, uint32_t latency, uint32_t trailing);
+  uint32_t next_event_(uint32_t t) const;
+  float random_();
+  bool monitor_chunk_(uint32_t now, std::string &chunk);
+  void generate_frames_(uint32_t until);
+  bool frame_passes_(uint32_t id) const;
+
+  EmulatorConfig config_;
+  std::deque<Chunk> pending_;
+  std::string input_;
+  uint32_t now_{0};
+  uint32_t rng_;
+
+  // Adapter-Einstellungen (ATZ setzt sie zurück)
+  bool echo_{true};
+  bool spaces_{true};
+  bool linefeeds_{false};
+  bool protocol_detected_{false};
+  char fixed_protocol_{0};  // ATSPn, 0 = automatisch (ATSP0)
+  bool headers_{false};
+  std::string header_;      // ATSH, leer = funktional (7DF)
+  uint8_t timeout_{0x32};   // ATST, Einheit 4 ms
+  uint8_t adaptive_{1};     // ATAT0/1/2
+  bool lost_{false};        // Antwort auf den aktuellen Befehl geht verloren (lost_rate)
+  int64_t cra_{-1};         // ATCRA, -1 = kein Filter
+  uint32_t cf_{0};          // ATCF/ATCM, Maske 0 = kein Filter
+  uint32_t cm_{0};
+
+  // CAN-Monitor (ATMA)
+  bool monitoring_{false};
+  std::string monitor_out_;
+  uint32_t monitor_generated_{0};   // Frames bis zu diesem Zeitpunkt erzeugt
+  uint32_t monitor_next_chunk_{0};
+  uint32_t buffer_full_{0};
+  uint32_t header_commands_{0};
+  uint32_t stpx_commands_{0};
+  bool sleeping_{false};    // nach ATLP, jedes Zeichen weckt
+
+  bool supported_[256]{};
+  std::vector<uint16_t> dtcs_;
+  std::vector<uint16_t> tcu_dtcs_;
+  bool tcu_{false};
+
+  uint32_t commands_{0};
+  uint32_t notifies_{0};
+};
+
+}  // namespace elm327_ble
+}  // namespace esphome
@@ -0,0 +1,91 @@
+// Datenlogger-Download (nc <IP> 7327 > obd2log.bin) in CSV umwandeln
+//
+//   ./build/elm327_logdump obd2log.bin [weitere.bin ...] > fahrt.csv
+//
+// Spalten: boot, uptime_ms, unix_time (leer ohne time_id), source, id, name, value.
+// Blöcke werden nach Sequenznummer sortiert, doppelt heruntergeladene nur einmal ausgegeben.
+
+#include "elm327_data_log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace esphome::elm327_ble;
+
+namespace {
+
+struct Block {
+  uint32_t sequence;
+  std::vector<uint8_t> data;
+};
+
+// Lesbarer Name wie im Log des Hubs: 010C, 221A10, ATRV, CAN 0C9/1
+void format_name(uint8_t source, uint16_t id, char *out, size_t len) {
+  if (source == LOG_SOURCE_AT)
+    snprintf(out, len, "AT%c%c", (char) (id >> 8), (char) id);
+  else if (source >= LOG_SOURCE_CAN && source < LOG_SOURCE_CAN + 8)
+    snprintf(out, len, "CAN %03X/%u", id, source - LOG_SOURCE_CAN);
+  else if (id > 0xFF)
+    snprintf(out, len, "%02X%04X", source, id);
+  else
+    snprintf(out, len, "%02X%02X", source, id);
+}
+
+bool read_file(const char *path, std::vector<Block> &blocks) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    perror(path);
+    return false;
+  }
+  std::vector<uint8_t> data(ELM327DataLog::BLOCK_SIZE);
+  ELM327LogBlockReader reader;
+  while (fread(data.data(), 1, data.size(), file) == data.size()) {
+    if (reader.open(data.data()))
+      blocks.push_back({reader.header().sequence, data});
+  }
+  fclose(file);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Aufruf: %s DATEI.bin [...]\n", argv[0]);
+    return 1;
+  }
+  std::vector<Block> blocks;
+  for (int i = 1; i < argc; i++) {
+    if (!read_file(argv[i], blocks))
+      return 1;
+  }
+  std::stable_sort(blocks.begin(), blocks.end(),
+                   [](const Block &a, const Block &b) { return (int32_t) (a.sequence - b.sequence) < 0; });
+  blocks.erase(std::unique(blocks.begin(), blocks.end(),
+                           [](const Block &a, const Block &b) { return a.sequence == b.sequence; }),
+               blocks.end());
+
+  printf("boot,uptime_ms,unix_time,source,id,name,value\n");
+  uint32_t records = 0;
+  ELM327LogBlockReader reader;
+  LogRecord record;
+  char name[16];
+  char unix_time[24];
+  for (const auto &block : blocks) {
+    reader.open(block.data.data());
+    const LogBlockHeader &header = reader.header();
+    while (reader.next(record)) {
+      format_name(record.source, record.id, name, sizeof(name));
+      unix_time[0] = '\0';
+      if (header.epoch != 0)
+        snprintf(unix_time, sizeof(unix_time), "%.3f", header.epoch + (record.time_ms - header.start_ms) / 1000.0);
+      printf("%u,%u,%s,%u,%u,%s,%g\n", header.boot, record.time_ms, unix_time, record.source, record.id, name,
+             record.value);
+      records++;
+    }
+  }
+  fprintf(stderr, "%zu Bloecke, %u Werte\n", blocks.size(), records);
+  return 0;
+}
@@ -0,0 +1,274 @@
+// Mitschnitt des Hubs (elm327_ble.dump_trace) lesbar ausgeben und offline erneut parsen
+//
+//   esphome logs obd2.yaml > log.txt     # währenddessen elm327_ble.dump_trace auslösen
+//   ./build/elm327_tracedump log.txt
+//   ./build/elm327_tracedump --replay log.txt
+//
+// Gelesen wird der letzte vollständige Dump aus dem Log (Zeilen mit dem Tag
+// elm327_ble.trace) oder eine Binärdatei im Exportformat aus elm327_trace.h.
+// Mit --replay gehen die empfangenen Chunks durch den ELM327ResponseParser wie auf dem
+// ESP32, nach jedem Prompt folgt die dekodierte Antwort. ATH1/ATH0 und der Zeilenmodus
+// von ATMA/STM bis zum nächsten Prompt werden aus den gesendeten Befehlen nachgestellt.
+
+#include "elm327_parser.h"
+#include "elm327_trace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace esphome::elm327_ble;
+
+namespace {
+
+const char *event_name(uint8_t event) {
+  switch (event) {
+    case TRACE_EVENT_CONNECT:
+      return "BLE verbunden, Intervall (1,25 ms)";
+    case TRACE_EVENT_OPEN:
+      return "GATT geoeffnet, Status";
+    case TRACE_EVENT_DISCONNECT:
+      return "BLE getrennt, Grund";
+    case TRACE_EVENT_SERVICES:
+      return "Handles TX/RX";
+    case TRACE_EVENT_NOTIFY:
+      return "Notify registriert";
+    case TRACE_EVENT_MTU:
+      return "MTU";
+    case TRACE_EVENT_WRITE_ACK:
+      return "Write quittiert, Status";
+    case TRACE_EVENT_WRITE_ERROR:
+      return "Write fehlgeschlagen";
+    case TRACE_EVENT_CONN_PARAMS:
+      return "Verbindungsparameter Intervall/Latency";
+    case TRACE_EVENT_TIMEOUT:
+      return "Antwort-Timeout Nr.";
+    default:
+      return "unbekannt";
+  }
+}
+
+// Steuerzeichen sichtbar machen: \r, \n, \xNN
+std::string escape(const uint8_t *data, size_t len) {
+  std::string out;
+  char hex[8];
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = data[i];
+    if (c == '\r') {
+      out += "\\r";
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c < 0x20 || c >= 0x7F || c == '\\') {
+      snprintf(hex, sizeof(hex), "\\x%02X", c);
+      out += hex;
+    } else {
+      out += (char) c;
+    }
+  }
+  return out;
+}
+
+bool read_file(const char *path, std::vector<uint8_t> &data) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    perror(path);
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  fclose(file);
+  return true;
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+// Letzten Dump aus einem ESPHome-Log zusammensetzen:
+//   [I][elm327_ble.trace:123]: Beginn: 4112 Bytes, ...
+//   [I][elm327_ble.trace:140]: 0000 4F425401...
+bool parse_log(const std::vector<uint8_t> &text, std::vector<uint8_t> &out) {
+  std::string content(text.begin(), text.end());
+  bool found = false;
+  bool broken = false;
+  size_t pos = 0;
+  while (pos < content.size()) {
+    size_t end = content.find('\n', pos);
+    if (end == std::string::npos)
+      end = content.size();
+    std::string line = content.substr(pos, end - pos);
+    pos = end + 1;
+    if (line.find("elm327_ble.trace") == std::string::npos)
+      continue;
+    size_t start = line.rfind("]: ");
+    if (start == std::string::npos)
+      continue;
+    std::string message = line.substr(start + 3);
+    // Farbcodes des Loggers am Zeilenende entfernen
+    size_t escape_pos = message.find('\033');
+    if (escape_pos != std::string::npos)
+      message.resize(escape_pos);
+    while (!message.empty() && (message.back() == '\r' || message.back() == ' '))
+      message.pop_back();
+    if (message.compare(0, 7, "Beginn:") == 0) {
+      out.clear();  // nur der letzte Dump zählt
+      found = true;
+      broken = false;
+      continue;
+    }
+    if (!found || broken)
+      continue;
+    char *rest = nullptr;
+    unsigned long offset = strtoul(message.c_str(), &rest, 16);
+    if (rest == message.c_str() || *rest != ' ')
+      continue;  // "Ende" oder andere Meldung
+    if (offset != out.size()) {
+      fprintf(stderr, "Logzeile fehlt bei Offset %04zX, Dump wird dort abgeschnitten\n", out.size());
+      broken = true;
+      continue;
+    }
+    for (const char *p = rest + 1; p[0] != '\0' && p[1] != '\0'; p += 2) {
+      int high = hex_value(p[0]);
+      int low = hex_value(p[1]);
+      if (high < 0 || low < 0)
+        break;
+      out.push_back(high << 4 | low);
+    }
+  }
+  return found;
+}
+
+struct Replay {
+  ELM327ResponseParser parser;
+  uint32_t responses{0};
+  uint32_t errors{0};
+
+  void on_tx(const uint8_t *data, size_t len) {
+    std::string cmd((const char *) data, len);
+    cmd = cmd.substr(0, cmd.find('\r'));
+    if (cmd == "ATH1")
+      this->parser.set_headers(true);
+    else if (cmd == "ATH0" || cmd == "ATZ" || cmd == "ATD")
+      this->parser.set_headers(false);
+    else if (cmd == "ATMA" || cmd.compare(0, 3, "STM") == 0)
+      this->parser.set_line_mode(true);  // bis zum Prompt nach dem Abbruch
+  }
+
+  void on_rx(const uint8_t *data, size_t len) {
+    this->parser.push(data, len);
+    while (this->parser.poll()) {
+      const ELM327Response &response = this->parser.response();
+      this->responses++;
+      const char *status = response.status == RESPONSE_OK ? "OK" : response.status == RESPONSE_NO_DATA ? "NO DATA" : "FEHLER";
+      if (response.status == RESPONSE_ERROR)
+        this->errors++;
+      printf("%27s-> %s '%s'", "", status, response.raw);
+      for (size_t i = 0; i < response.message_count; i++) {
+        printf(" [");
+        if (response.sender(i) != 0)
+          printf("%X: ", (unsigned) response.sender(i));
+        for (size_t j = 0; j < response.message_length(i); j++)
+          printf("%02X", response.message(i)[j]);
+        printf("]");
+      }
+      printf("%s%s\n", response.overflow ? " (Ueberlauf)" : "", response.incomplete ? " (unvollstaendig)" : "");
+      if (response.prompt && this->parser.is_line_mode())
+        this->parser.set_line_mode(false);
+    }
+  }
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  bool replay = false;
+  const char *path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--replay") == 0)
+      replay = true;
+    else
+      path = argv[i];
+  }
+  if (path == nullptr) {
+    fprintf(stderr, "Aufruf: %s [--replay] LOG.txt|TRACE.bin\n", argv[0]);
+    return 1;
+  }
+  std::vector<uint8_t> file;
+  if (!read_file(path, file))
+    return 1;
+  std::vector<uint8_t> data;
+  if (file.size() >= 3 && memcmp(file.data(), "OBT", 3) == 0) {
+    data.swap(file);
+  } else if (!parse_log(file, data)) {
+    fprintf(stderr, "%s: kein Mitschnitt gefunden\n", path);
+    return 1;
+  }
+
+  ELM327TraceReader reader;
+  if (!reader.open(data.data(), data.size())) {
+    fprintf(stderr, "%s: unbekanntes Format\n", path);
+    return 1;
+  }
+  const TraceHeader &header = reader.header();
+  printf("Export bei %.3f s, %u Eintraege, %u davor ueberschrieben\n", header.exported_ms / 1000.0, header.count,
+         header.dropped);
+
+  Replay parser;
+  TraceRecord record;
+  uint32_t counts[4] = {0, 0, 0, 0};
+  uint32_t bytes[4] = {0, 0, 0, 0};
+  uint32_t previous = 0;
+  bool first = true;
+  while (reader.next(record)) {
+    uint32_t delta = first ? 0 : record.time_ms - previous;
+    previous = record.time_ms;
+    first = false;
+    uint8_t type = record.type < 4 ? record.type : 0;
+    counts[type]++;
+    bytes[type] += record.len;
+    printf("%12.3f +%6u ms  ", record.time_ms / 1000.0, delta);
+    TraceEvent event;
+    uint32_t value;
+    if (record.type == TRACE_TX) {
+      printf("TX  \"%s\"\n", escape(record.data, record.len).c_str());
+      if (replay)
+        parser.on_tx(record.data, record.len);
+    } else if (record.type == TRACE_RX) {
+      printf("RX  \"%s\"\n", escape(record.data, record.len).c_str());
+      if (replay)
+        parser.on_rx(record.data, record.len);
+    } else if (ELM327TraceReader::decode_event(record, event, value)) {
+      if (event == TRACE_EVENT_SERVICES || event == TRACE_EVENT_CONN_PARAMS)
+        printf("--  %s: %u/%u\n", event_name(event), (unsigned) (value >> 16), (unsigned) (value & 0xFFFF));
+      else if (event == TRACE_EVENT_NOTIFY)
+        printf("--  %s\n", event_name(event));
+      else
+        printf("--  %s: %u\n", event_name(event), (unsigned) value);
+      // Der Hub verwirft nach einem Timeout die angefangene Antwort
+      if (replay && event == TRACE_EVENT_TIMEOUT)
+        parser.parser.reset();
+    } else {
+      printf("??  Typ %u, %u Bytes\n", record.type, record.len);
+    }
+  }
+
+  uint32_t total = counts[0] + counts[TRACE_TX] + counts[TRACE_RX] + counts[TRACE_EVENT];
+  if (total != header.count)
+    fprintf(stderr, "Nur %u von %u Eintraegen gelesen\n", total, header.count);
+  fprintf(stderr, "TX %u (%u Bytes), RX %u (%u Bytes), Ereignisse %u", counts[TRACE_TX], bytes[TRACE_TX],
+          counts[TRACE_RX], bytes[TRACE_RX], counts[TRACE_EVENT]);
+  if (replay)
+    fprintf(stderr, ", %u Antworten geparst (%u Fehler)", parser.responses, parser.errors);
+  fprintf(stderr, "\n");
+  return 0;
+}
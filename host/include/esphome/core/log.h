@@ -0,0 +1,53 @@
+#pragma once
+
+// Ersatz für esphome/core/log.h beim Host-Build des Protokollkerns.
+// Ausgabe auf stderr. Wie in ESPHome werden Level oberhalb von
+// ELM327_HOST_LOG_LEVEL (0 = aus, 1 = E, 2 = W, 3 = I, 4 = D, 5 = V) wegkompiliert.
+
+#include <cstdarg>
+#include <cstdio>
+
+#ifndef ELM327_HOST_LOG_LEVEL
+#define ELM327_HOST_LOG_LEVEL 1
+#endif
+
+inline void elm327_host_log(char letter, const char *tag, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "[%c][%s] ", letter, tag);
+  vfprintf(stderr, format, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+#define ELM327_HOST_LOG_NONE(...) \
+  do { \
+  } while (0)
+
+#if ELM327_HOST_LOG_LEVEL >= 1
+#define ESP_LOGE(tag, ...) elm327_host_log('E', tag, __VA_ARGS__)
+#else
+#define ESP_LOGE ELM327_HOST_LOG_NONE
+#endif
+#if ELM327_HOST_LOG_LEVEL >= 2
+#define ESP_LOGW(tag, ...) elm327_host_log('W', tag, __VA_ARGS__)
+#else
+#define ESP_LOGW ELM327_HOST_LOG_NONE
+#endif
+#if ELM327_HOST_LOG_LEVEL >= 3
+#define ESP_LOGI(tag, ...) elm327_host_log('I', tag, __VA_ARGS__)
+#define ESP_LOGCONFIG(tag, ...) elm327_host_log('C', tag, __VA_ARGS__)
+#else
+#define ESP_LOGI ELM327_HOST_LOG_NONE
+#define ESP_LOGCONFIG ELM327_HOST_LOG_NONE
+#endif
+#if ELM327_HOST_LOG_LEVEL >= 4
+#define ESP_LOGD(tag, ...) elm327_host_log('D', tag, __VA_ARGS__)
+#else
+#define ESP_LOGD ELM327_HOST_LOG_NONE
+#endif
+#if ELM327_HOST_LOG_LEVEL >= 5
+#define ESP_LOGV(tag, ...) elm327_host_log('V', tag, __VA_ARGS__)
+#else
+#define ESP_LOGV ELM327_HOST_LOG_NONE
+#endif